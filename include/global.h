@@ -25,5 +25,6 @@
 #include "jerryscript.h"
 
 void km_global_init();
+void km_global_cleanup();
 
 #endif /* __KM_GLOBAL_H */
\ No newline at end of file
@@ -33,11 +33,15 @@
 #ifdef KALUMA_MODULE_TCP
 #include "tcp.h"
 #endif//KALUMA_MODULE_TCP
+#ifdef KALUMA_IO_POLL
+#include "fdpoll.h"
+#endif//KALUMA_IO_POLL
 
 typedef struct km_io_loop_s km_io_loop_t;
 typedef struct km_io_handle_s km_io_handle_t;
 typedef struct km_io_handle_list_s km_io_handle_list_t;
 typedef struct km_io_timer_handle_s km_io_timer_handle_t;
+typedef struct km_io_periodic_handle_s km_io_periodic_handle_t;
 typedef struct km_io_tty_handle_s km_io_tty_handle_t;
 typedef struct km_io_watch_handle_s km_io_watch_handle_t;
 typedef struct km_io_uart_handle_s km_io_uart_handle_t;
@@ -47,12 +51,23 @@ typedef struct km_io_ieee80211_handle_s km_io_ieee80211_handle_t;
 #ifdef KALUMA_MODULE_TCP
 typedef struct km_io_tcp_handle_s km_io_tcp_handle_t;
 #endif//KALUMA_MODULE_TCP
+#ifdef KALUMA_IO_POLL
+typedef struct km_io_poll_handle_s km_io_poll_handle_t;
+#endif//KALUMA_IO_POLL
+typedef struct km_io_work_handle_s km_io_work_handle_t;
+typedef struct km_io_immediate_handle_s km_io_immediate_handle_t;
 typedef struct km_io_idle_handle_s km_io_idle_handle_t;
 
+/* timeout value meaning "no timer is armed" */
+
+#define KM_IO_TIMEOUT_NONE UINT64_MAX
+
 /* handle flags */
 
 #define KM_IO_FLAG_ACTIVE 0x01
 #define KM_IO_FLAG_CLOSING 0x02
+#define KM_IO_FLAG_PENDING 0x04
+#define KM_IO_FLAG_UNREF 0x08
 
 #define KM_IO_SET_FLAG_ON(field, flag) ((field) |= (flag))
 #define KM_IO_SET_FLAG_OFF(field, flag) ((field) &= ~(flag))
@@ -62,6 +77,7 @@ typedef struct km_io_idle_handle_s km_io_idle_handle_t;
 
 typedef enum km_io_type {
   KM_IO_TIMER,
+  KM_IO_PERIODIC,
   KM_IO_TTY,
   KM_IO_WATCH,
   KM_IO_UART,
@@ -71,9 +87,28 @@ typedef enum km_io_type {
 #ifdef KALUMA_MODULE_TCP
   KM_IO_TCP,
 #endif//KALUMA_MODULE_TCP
+#ifdef KALUMA_IO_POLL
+  KM_IO_POLL,
+#endif//KALUMA_IO_POLL
+  KM_IO_WORK,
+  KM_IO_IMMEDIATE,
   KM_IO_IDLE
 } km_io_type_t;
 
+/**
+ * Handle priorities. Ready realtime handles are serviced at the start of
+ * each iteration and again before every lower-priority callback, instead
+ * of waiting for their phase. Background handles are dispatched after the
+ * normal handles of their phase, so they are the first to roll over when
+ * the loop budget is used up. Supported by timer, watch and UART handles
+ * (periodic handles support realtime only).
+ */
+typedef enum {
+  KM_IO_PRIORITY_REALTIME,
+  KM_IO_PRIORITY_NORMAL,
+  KM_IO_PRIORITY_BACKGROUND
+} km_io_priority_t;
+
 typedef void (* km_io_close_cb)(km_io_handle_t *);
 
 struct km_io_handle_s {
@@ -81,6 +116,7 @@ struct km_io_handle_s {
   uint32_t id;
   km_io_type_t type;
   uint8_t flags;
+  uint8_t priority; // km_io_priority_t, set before starting the handle
   km_io_close_cb close_cb;
 };
 
@@ -90,6 +126,9 @@ typedef void (* km_io_timer_cb)(km_io_timer_handle_t *);
 
 struct km_io_timer_handle_s {
   km_io_handle_t base;
+  km_heap_node_t heap_node;
+  km_io_timer_handle_t *expired_next;
+  uint32_t start_id; // order of timers with the same timeout
   km_io_timer_cb timer_cb;
   jerry_value_t timer_js_cb;
   uint64_t clamped_timeout;
@@ -98,6 +137,38 @@ struct km_io_timer_handle_s {
   uint32_t tag; // for application use
 };
 
+/* periodic handle types (microsecond period on a fixed schedule, so the
+   callbacks do not drift even if some of them are late) */
+
+typedef enum {
+  KM_IO_PERIODIC_SKIP, // skip the periods missed
+  KM_IO_PERIODIC_CATCHUP // call back once per missed period until caught up
+} km_io_periodic_policy_t;
+
+typedef struct {
+  uint32_t fired;
+  uint32_t late; /* called a period or more after the schedule */
+  uint32_t skipped; /* periods skipped by KM_IO_PERIODIC_SKIP */
+  uint32_t max_latency; /* in microseconds */
+  uint64_t latency_sum; /* in microseconds */
+  uint64_t latency_sq_sum; /* for the jitter (standard deviation) */
+} km_io_periodic_stats_t;
+
+typedef void (* km_io_periodic_cb)(km_io_periodic_handle_t *);
+
+struct km_io_periodic_handle_s {
+  km_io_handle_t base;
+  km_heap_node_t heap_node;
+  km_io_periodic_handle_t *expired_next;
+  uint32_t start_id; // order of handles with the same deadline
+  km_io_periodic_cb periodic_cb;
+  jerry_value_t periodic_js_cb;
+  uint64_t deadline; // in microseconds (km_micro_gettime)
+  uint32_t period; // in microseconds
+  uint8_t policy; // km_io_periodic_policy_t
+  km_io_periodic_stats_t stats;
+};
+
 /* TTY handle types */
 
 typedef void (* km_io_tty_read_cb)(uint8_t *, size_t);
@@ -133,6 +204,12 @@ struct km_io_watch_handle_s {
   uint32_t debounce_delay;
   uint8_t last_val;
   uint8_t val;
+  bool irq; /* edges are recorded by the pin interrupt */
+  bool pending; /* an edge waits for debounce */
+  uint8_t pending_val;
+  uint32_t pending_time; /* time of the pending edge in microseconds */
+  uint32_t edge_index; /* next edge to read from the edge ring of the pin */
+  uint32_t edge_time; /* time of the edge which fired the callback in microseconds */
   km_io_watch_cb watch_cb;
   jerry_value_t watch_js_cb;
 };
@@ -185,7 +262,52 @@ struct km_io_tcp_handle_s {
 };
 #endif//KALUMA_MODULE_TCP
 
-/* idle handle types */
+/* poll handle types (file descriptors, for the ports with an OS) */
+#ifdef KALUMA_IO_POLL
+typedef void (* km_io_poll_cb)(km_io_poll_handle_t *, uint8_t);
+
+struct km_io_poll_handle_s {
+  km_io_handle_t base;
+  km_io_poll_cb poll_cb;
+  jerry_value_t poll_js_cb;
+  int fd;
+  uint8_t events; // KM_POLL_READABLE and/or KM_POLL_WRITABLE
+};
+#endif//KALUMA_IO_POLL
+
+/* work handle types (work_cb runs on a worker of the port, and then
+   after_work_cb runs in the work phase of the loop) */
+
+#define KM_IO_WORK_NO_SLOT 0xFF
+
+typedef void (* km_io_work_cb)(km_io_work_handle_t *);
+typedef void (* km_io_after_work_cb)(km_io_work_handle_t *);
+
+struct km_io_work_handle_s {
+  km_io_handle_t base;
+  km_io_work_cb work_cb; // must not call any JerryScript API
+  km_io_after_work_cb after_work_cb;
+  km_io_work_cb cleanup_cb; // frees what work_cb left in data, if not completed
+  jerry_value_t work_js_cb;
+  void *data; // km_malloc'd memory shared with work_cb, freed at cleanup
+  uint8_t slot; // KM_IO_WORK_NO_SLOT until passed to a worker
+};
+
+/* immediate handle types (called once in the immediate phase of the next
+   iteration, or right after the current callback when queued as a tick) */
+
+typedef void (* km_io_immediate_cb)(km_io_immediate_handle_t *);
+
+struct km_io_immediate_handle_s {
+  km_io_handle_t base;
+  km_io_immediate_cb immediate_cb;
+  jerry_value_t immediate_js_cb;
+  uint32_t seq; // order of queueing
+  bool tick;
+};
+
+/* idle handle types (called once per loop iteration, but do not keep the
+   loop from waiting for the next timer or I/O activity) */
 
 typedef void (* km_io_idle_cb)(km_io_idle_handle_t *);
 
@@ -194,12 +316,78 @@ struct km_io_idle_handle_s {
   km_io_idle_cb idle_cb;
 };
 
+/* loop statistics types */
+
+typedef enum {
+  KM_IO_PHASE_TIMER,
+  KM_IO_PHASE_PERIODIC,
+  KM_IO_PHASE_TTY,
+  KM_IO_PHASE_WATCH,
+  KM_IO_PHASE_UART,
+#ifdef KALUMA_MODULE_IEEE80211
+  KM_IO_PHASE_IEEE80211,
+#endif//KALUMA_MODULE_IEEE80211
+#ifdef KALUMA_MODULE_TCP
+  KM_IO_PHASE_TCP,
+#endif//KALUMA_MODULE_TCP
+#ifdef KALUMA_IO_POLL
+  KM_IO_PHASE_POLL,
+#endif//KALUMA_IO_POLL
+  KM_IO_PHASE_WORK,
+  KM_IO_PHASE_IMMEDIATE,
+  KM_IO_PHASE_IDLE,
+  KM_IO_PHASE_CLOSING,
+  KM_IO_PHASE_COUNT
+} km_io_phase_t;
+
+/**
+ * Loop lag (busy time of an iteration) histogram buckets:
+ * [0] < 1ms, [n] < 2^n ms, and the last bucket for everything above.
+ */
+#define KM_IO_LAG_BUCKETS 8
+
+typedef struct {
+  uint64_t time; /* cumulative time in microseconds */
+  uint32_t max_time; /* max time of a run in microseconds */
+  uint32_t count; /* runs */
+  uint32_t callbacks; /* callbacks invoked */
+} km_io_phase_stats_t;
+
+typedef struct {
+  km_io_phase_stats_t phases[KM_IO_PHASE_COUNT];
+  uint32_t iterations;
+  uint32_t yields; /* phases cut short by the loop budget */
+  uint32_t max_lag; /* in microseconds */
+  uint32_t lag[KM_IO_LAG_BUCKETS];
+} km_io_loop_stats_t;
+
+/**
+ * Loop budget. The timer, UART, poll, work and immediate phases stop
+ * dispatching when the callbacks or the time spent in the current iteration
+ * (or the callbacks of the phase) exceed the budget, and the remaining work
+ * rolls over to the next iteration. Each of those phases dispatches at least one
+ * callback per iteration. TTY, watch and closing callbacks are not limited.
+ * Zero means no limit.
+ */
+typedef struct {
+  uint32_t max_callbacks; /* per iteration */
+  uint32_t max_micros; /* per iteration */
+  uint32_t max_phase_callbacks; /* per phase */
+} km_io_budget_t;
+
 /* loop type */
 
 struct km_io_loop_s {
   bool stop_flag;
   uint64_t time;
   km_list_t timer_handles;
+  km_heap_t timer_heap;
+  km_heap_t realtime_timer_heap;
+  km_list_t periodic_handles;
+  km_heap_t periodic_heap;
+  km_heap_t realtime_periodic_heap;
+  uint32_t realtime_count; /* active realtime handles */
+  bool in_realtime; /* servicing realtime handles */
   km_list_t tty_handles;
   km_list_t watch_handles;
   km_list_t uart_handles;
@@ -209,20 +397,50 @@ struct km_io_loop_s {
 #ifdef KALUMA_MODULE_TCP
   km_list_t tcp_handles;
 #endif//KALUMA_MODULE_TCP
+#ifdef KALUMA_IO_POLL
+  km_list_t poll_handles;
+#endif//KALUMA_IO_POLL
+  km_list_t work_handles; /* queued and running works in order */
+  km_list_t immediate_handles;
+  km_list_t tick_handles;
+  uint32_t immediate_seq;
   km_list_t idle_handles;
   km_list_t closing_handles;
+  km_io_handle_t **handles; /* open addressing table of handles by id */
+  uint32_t handles_size;
+  uint32_t handles_count;
+  km_io_loop_stats_t stats;
+  km_io_budget_t budget;
+  uint64_t iteration_start; /* in microseconds */
+  uint32_t iteration_callbacks;
+  uint32_t phase_callbacks;
+  uint32_t dispatched; /* I/O callbacks dispatched (except idle callbacks) */
 };
 
 /* loop functions */
 
 void io_init();
 void io_run();
+void io_run_alive();
+bool km_io_alive();
+km_io_loop_stats_t *km_io_stats();
+void km_io_stats_reset();
+km_io_budget_t *km_io_budget();
+uint32_t km_io_dispatched();
+const char *km_io_phase_name(km_io_phase_t phase);
 
 /* general handle functions */
 
-void km_io_handle_init(km_io_handle_t *handle, km_io_type_t type);
+bool km_io_handle_init(km_io_handle_t *handle, km_io_type_t type);
 void km_io_handle_close(km_io_handle_t *handle, km_io_close_cb close_cb);
-km_io_handle_t *km_io_handle_get_by_id(uint32_t id, km_list_t *handle_list);
+km_io_handle_t *km_io_handle_get_by_id(uint32_t id, km_io_type_t type);
+km_io_handle_t *km_io_handle_find(uint32_t id);
+void km_io_handle_ref(km_io_handle_t *handle);
+void km_io_handle_unref(km_io_handle_t *handle);
+bool km_io_handle_has_ref(km_io_handle_t *handle);
+km_io_handle_t *km_io_handle_alloc(km_io_type_t type);
+void km_io_handle_free(km_io_handle_t *handle);
+km_pool_t *km_io_handle_pool(km_io_type_t type);
 
 /* timer functions */
 
@@ -230,11 +448,21 @@ void km_io_timer_init(km_io_timer_handle_t *timer);
 void km_io_timer_start(km_io_timer_handle_t *timer, km_io_timer_cb timer_cb, uint64_t interval, bool repeat);
 void km_io_timer_stop(km_io_timer_handle_t *timer);
 km_io_timer_handle_t *km_io_timer_get_by_id(uint32_t id);
+uint64_t km_io_timer_next_timeout();
 void km_io_timer_cleanup();
 
+/* periodic functions */
+
+void km_io_periodic_init(km_io_periodic_handle_t *periodic);
+void km_io_periodic_start(km_io_periodic_handle_t *periodic, km_io_periodic_cb periodic_cb, uint32_t period, km_io_periodic_policy_t policy);
+void km_io_periodic_stop(km_io_periodic_handle_t *periodic);
+km_io_periodic_handle_t *km_io_periodic_get_by_id(uint32_t id);
+uint64_t km_io_periodic_next_deadline();
+void km_io_periodic_cleanup();
+
 /* TTY functions */
 
-void km_io_tty_init(km_io_tty_handle_t *tty);
+bool km_io_tty_init(km_io_tty_handle_t *tty);
 void km_io_tty_read_start(km_io_tty_handle_t *tty, km_io_tty_read_cb read_cb);
 void km_io_tty_read_stop(km_io_tty_handle_t *tty);
 void km_io_tty_cleanup();
@@ -245,6 +473,7 @@ void km_io_watch_init(km_io_watch_handle_t *watch);
 void km_io_watch_start(km_io_watch_handle_t *watch, km_io_watch_cb watch_cb, uint8_t pin, km_io_watch_mode_t mode, uint32_t debounce);
 void km_io_watch_stop(km_io_watch_handle_t *watch);
 km_io_watch_handle_t *km_io_watch_get_by_id(uint32_t id);
+uint32_t km_io_watch_missed_edges(uint8_t pin);
 void km_io_watch_cleanup();
 
 /* UART function */
@@ -257,7 +486,7 @@ void km_io_uart_cleanup();
 
 /* IEEE80211 function */
 #ifdef KALUMA_MODULE_IEEE80211
-void km_io_ieee80211_init(km_io_ieee80211_handle_t *ieee80211);
+bool km_io_ieee80211_init(km_io_ieee80211_handle_t *ieee80211);
 void km_io_ieee80211_start(km_io_ieee80211_handle_t *ieee80211, km_io_ieee80211_scan_cb scan_cb, km_io_ieee80211_assoc_cb assoc_cb, km_io_ieee80211_connect_cb connect_cb, km_io_ieee80211_disconnect_cb disconnect_cb);
 void km_io_ieee80211_stop(km_io_ieee80211_handle_t *ieee80211);
 void km_io_ieee80211_scan(km_io_ieee80211_handle_t *ieee80211, km_io_ieee80211_scan_cb scan_cb);
@@ -267,7 +496,7 @@ km_io_ieee80211_handle_t *km_io_ieee80211_get_by_id(uint32_t id);
 void km_io_ieee80211_cleanup();
 #endif//KALUMA_MODULE_IEEE80211
 #ifdef KALUMA_MODULE_TCP
-void km_io_tcp_init(km_io_tcp_handle_t *tcp);
+bool km_io_tcp_init(km_io_tcp_handle_t *tcp);
 void km_io_tcp_start(km_io_tcp_handle_t *tcp, km_io_tcp_connect_cb connect_cb, km_io_tcp_disconnect_cb disconnect_cb, km_io_tcp_read_cb read_cb);
 void km_io_tcp_stop(km_io_tcp_handle_t *tcp);
 km_io_tcp_handle_t *km_io_tcp_get_by_fd(int fd);
@@ -276,6 +505,33 @@ int km_io_tcp_connect(km_io_tcp_handle_t *tcp, const char* address, int port);
 int km_io_tcp_send(km_io_tcp_handle_t* tcp, const char* message, int len);
 int km_io_tcp_close(km_io_tcp_handle_t* tcp);
 #endif//KALUMA_MODULE_TCP
+
+/* poll functions */
+#ifdef KALUMA_IO_POLL
+void km_io_poll_init(km_io_poll_handle_t *poll);
+int km_io_poll_start(km_io_poll_handle_t *poll, int fd, uint8_t events, km_io_poll_cb poll_cb);
+int km_io_poll_update(km_io_poll_handle_t *poll, uint8_t events);
+void km_io_poll_stop(km_io_poll_handle_t *poll);
+km_io_poll_handle_t *km_io_poll_get_by_id(uint32_t id);
+void km_io_poll_cleanup();
+#endif//KALUMA_IO_POLL
+
+/* work functions */
+
+void km_io_work_init(km_io_work_handle_t *work);
+void km_io_work_queue(km_io_work_handle_t *work, km_io_work_cb work_cb, km_io_after_work_cb after_work_cb);
+km_io_work_handle_t *km_io_work_get_by_id(uint32_t id);
+void km_io_work_cleanup();
+
+/* immediate functions */
+
+void km_io_immediate_init(km_io_immediate_handle_t *immediate);
+void km_io_immediate_start(km_io_immediate_handle_t *immediate, km_io_immediate_cb immediate_cb);
+void km_io_immediate_tick(km_io_immediate_handle_t *immediate, km_io_immediate_cb immediate_cb);
+void km_io_immediate_stop(km_io_immediate_handle_t *immediate);
+km_io_immediate_handle_t *km_io_immediate_get_by_id(uint32_t id);
+void km_io_immediate_cleanup();
+
 /* idle function */
 
 void km_io_idle_init(km_io_idle_handle_t *idle);
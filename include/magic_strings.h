@@ -53,6 +53,25 @@
 #define MSTR_SET_INTERVAL "setInterval"
 #define MSTR_CLEAR_TIMEOUT "clearTimeout"
 #define MSTR_CLEAR_INTERVAL "clearInterval"
+#define MSTR_PRIORITY "priority"
+#define MSTR_PRIORITY_REALTIME "PRIORITY_REALTIME"
+#define MSTR_PRIORITY_NORMAL "PRIORITY_NORMAL"
+#define MSTR_PRIORITY_BACKGROUND "PRIORITY_BACKGROUND"
+#define MSTR_SET_PERIODIC "setPeriodic"
+#define MSTR_CLEAR_PERIODIC "clearPeriodic"
+#define MSTR_GET_PERIODIC_STATS "getPeriodicStats"
+#define MSTR_POLICY "policy"
+#define MSTR_PERIODIC_SKIP "PERIODIC_SKIP"
+#define MSTR_PERIODIC_CATCHUP "PERIODIC_CATCHUP"
+#define MSTR_PERIOD "period"
+#define MSTR_FIRED "fired"
+#define MSTR_LATE "late"
+#define MSTR_SKIPPED "skipped"
+#define MSTR_MAX_LATENCY "maxLatency"
+#define MSTR_AVG_LATENCY "avgLatency"
+#define MSTR_JITTER "jitter"
+#define MSTR_SET_IMMEDIATE "setImmediate"
+#define MSTR_CLEAR_IMMEDIATE "clearImmediate"
 #define MSTR_DELAY "delay"
 #define MSTR_MILLIS "millis"
 #define MSTR_CONSOLE "console"
@@ -70,6 +89,64 @@
 #define MSTR_BINDING "binding"
 #define MSTR_BUILTIN_MODULES "builtin_modules"
 #define MSTR_GET_BUILTIN_MODULE "getBuiltinModule"
+#define MSTR_NEXT_TICK "nextTick"
+#define MSTR_LOOP_STATS "loopStats"
+#define MSTR_ITERATIONS "iterations"
+#define MSTR_MAX_LAG "maxLag"
+#define MSTR_LAG "lag"
+#define MSTR_PHASES "phases"
+#define MSTR_TIME "time"
+#define MSTR_MAX_TIME "maxTime"
+#define MSTR_COUNT "count"
+#define MSTR_CALLBACKS "callbacks"
+#define MSTR_YIELDS "yields"
+#define MSTR_SET_LOOP_BUDGET "setLoopBudget"
+#define MSTR_REF "ref"
+#define MSTR_UNREF "unref"
+#define MSTR_HAS_REF "hasRef"
+#define MSTR_BOOT_TRACE "bootTrace"
+#define MSTR_STAGE "stage"
+#define MSTR_DURATION "duration"
+#define MSTR_PROFILE "profile"
+#define MSTR_START "start"
+#define MSTR_STOP "stop"
+#define MSTR_MEMORY_USAGE "memoryUsage"
+#define MSTR_HEAP_TOTAL "heapTotal"
+#define MSTR_HEAP_USED "heapUsed"
+#define MSTR_HEAP_PEAK "heapPeak"
+#define MSTR_OBJECTS "objects"
+#define MSTR_TOTAL "total"
+#define MSTR_FUNCTIONS "functions"
+#define MSTR_ARRAYS "arrays"
+#define MSTR_TYPED_ARRAYS "typedArrays"
+#define MSTR_ARRAY_BUFFERS "arrayBuffers"
+#define MSTR_ARRAY_BUFFER_BYTES "arrayBufferBytes"
+#define MSTR_PROMISES "promises"
+#define MSTR_NATIVE "native"
+#define MSTR_ARENA "arena"
+#define MSTR_USED "used"
+#define MSTR_FREE "free"
+#define MSTR_TAGS "tags"
+#define MSTR_CURRENT "current"
+#define MSTR_PEAK "peak"
+#define MSTR_BLOCKS "blocks"
+#define MSTR_ALLOCS "allocs"
+#define MSTR_TLSF "tlsf"
+#define MSTR_SIZE "size"
+#define MSTR_FREE_BLOCKS "freeBlocks"
+#define MSTR_LARGEST_FREE "largestFree"
+#define MSTR_FRAGMENTATION "fragmentation"
+#define MSTR_FALLBACKS "fallbacks"
+#define MSTR_SET_MEMORY_PRESSURE "setMemoryPressure"
+#define MSTR_MEMORY_PRESSURE "memoryPressure"
+#define MSTR_EMIT "emit"
+#define MSTR_LEVEL "level"
+#define MSTR_GC "gc"
+#define MSTR_MODERATE "moderate"
+#define MSTR_CRITICAL "critical"
+#define MSTR_MAX_CALLBACKS "maxCallbacks"
+#define MSTR_MAX_MICROS "maxMicros"
+#define MSTR_MAX_PHASE_CALLBACKS "maxPhaseCallbacks"
 #define MSTR_DEVICES "devices"
 #define MSTR_BOARD "board"
 #define MSTR_NAME "name"
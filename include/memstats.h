@@ -0,0 +1,99 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __KM_MEMSTATS_H
+#define __KM_MEMSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Tags of the native allocations to attribute the memory to the owners
+ */
+typedef enum {
+  KM_MEM_CORE,
+  KM_MEM_UART,
+  KM_MEM_I2C,
+  KM_MEM_SPI,
+  KM_MEM_STORAGE,
+  KM_MEM_FLASH,
+  KM_MEM_GRAPHICS,
+  KM_MEM_NET,
+  KM_MEM_WIFI,
+  KM_MEM_TAGS /* number of the tags */
+} km_mem_tag_t;
+
+/**
+ * Native allocations of a tag. Blocks are the live allocations and allocs
+ * are all the allocations made so far.
+ */
+typedef struct {
+  uint32_t current; /* bytes */
+  uint32_t peak; /* bytes */
+  uint32_t blocks;
+  uint32_t allocs;
+} km_mem_tag_stats_t;
+
+/**
+ * Memory usage of the JS heap (with the live objects by type) and the
+ * native heap (malloc)
+ */
+typedef struct {
+  /* JS heap */
+  uint32_t heap_size;
+  uint32_t heap_used;
+  uint32_t heap_peak;
+  /* live objects */
+  uint32_t objects; /* all objects including the below */
+  uint32_t functions;
+  uint32_t arrays;
+  uint32_t typed_arrays;
+  uint32_t array_buffers;
+  uint32_t array_buffer_bytes;
+  uint32_t promises;
+  /* native heap */
+  uint32_t native_size; /* arena obtained from the system */
+  uint32_t native_used;
+  uint32_t native_free; /* free in the arena */
+  /* TLSF arena of the tagged allocations (zero if not KALUMA_TLSF) */
+  uint32_t tlsf_size;
+  uint32_t tlsf_used;
+  uint32_t tlsf_free;
+  uint32_t tlsf_free_blocks;
+  uint32_t tlsf_largest_free;
+  uint32_t tlsf_fallbacks; /* allocations from the system heap */
+  /* tagged native allocations */
+  km_mem_tag_stats_t tags[KM_MEM_TAGS];
+} km_memstats_t;
+
+void km_memstats_get(km_memstats_t *stats);
+void km_memtags_get(km_memstats_t *stats);
+const char *km_mem_tag_name(km_mem_tag_t tag);
+
+/**
+ * Tagged allocation. The pointers must be freed with km_free(), and only
+ * in the main loop thread since the stats are not locked.
+ */
+void *km_malloc(km_mem_tag_t tag, size_t size);
+void *km_calloc(km_mem_tag_t tag, size_t count, size_t size);
+void km_free(void *ptr);
+
+#endif /* __KM_MEMSTATS_H */
@@ -0,0 +1,74 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __KM_FDPOLL_H
+#define __KM_FDPOLL_H
+
+#include <stdint.h>
+
+/**
+ * File descriptor polling, for the ports with an OS (built with
+ * KALUMA_IO_POLL). The registered descriptors are waited for together
+ * with the deadline in km_system_wait_until(), so the loop blocks in a
+ * single system call for all of them.
+ */
+
+#define KM_POLL_READABLE 0x01
+#define KM_POLL_WRITABLE 0x02
+#define KM_POLL_ERROR 0x04 /* error or hang up, always reported */
+
+typedef struct {
+  uint32_t id; /* id given at km_poll_add() */
+  uint8_t events;
+} km_poll_event_t;
+
+/**
+ * Start to watch the events of the file descriptor
+ *
+ * @param fd
+ * @param events KM_POLL_READABLE and/or KM_POLL_WRITABLE
+ * @param id Reported with the events
+ * @return 0 on success, or -1 on error
+ */
+int km_poll_add(int fd, uint8_t events, uint32_t id);
+
+/**
+ * Change the events to watch
+ */
+int km_poll_modify(int fd, uint8_t events, uint32_t id);
+
+/**
+ * Stop to watch the file descriptor
+ */
+int km_poll_remove(int fd);
+
+/**
+ * Take the events of the descriptors. Returns the events recorded by the
+ * last km_system_wait_until() if it waited, or checks the descriptors
+ * without blocking otherwise.
+ *
+ * @param events Array to store the events
+ * @param max Size of the array
+ * @return Number of events stored
+ */
+int km_poll_events(km_poll_event_t *events, int max);
+
+#endif /* __KM_FDPOLL_H */
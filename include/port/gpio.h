@@ -39,6 +39,21 @@ typedef enum {
 
 #define KM_GPIOPORT_ERROR -1
 
+typedef enum {
+  KM_GPIO_IRQ_EDGE_FALL = 1,
+  KM_GPIO_IRQ_EDGE_RISE = 2,
+  KM_GPIO_IRQ_EDGE_BOTH = 3,
+} km_gpio_irq_mode_t;
+
+/**
+ * Pin interrupt callback. Called in interrupt context for each edge.
+ *
+ * @param {uint8_t} pin
+ * @param {uint8_t} value Pin value after the edge
+ * @param {uint64_t} time Time of the edge in microseconds (km_micro_gettime)
+ */
+typedef void (* km_gpio_irq_cb)(uint8_t pin, uint8_t value, uint64_t time);
+
 /**
  * Initialize all GPIO when system started
  */
@@ -54,4 +69,22 @@ int km_gpio_write(uint8_t pin, uint8_t value);
 int km_gpio_toggle(uint8_t pin);
 int km_gpio_read(uint8_t pin);
 
+/**
+ * Enable the interrupt of the pin for the edges.
+ *
+ * @param {uint8_t} pin
+ * @param {km_gpio_irq_mode_t} mode
+ * @param {km_gpio_irq_cb} cb
+ * @return Returns 0 on success or KM_GPIOPORT_ERROR if the pin interrupt is
+ *   not supported (then the pin should be polled)
+ */
+int km_gpio_irq_enable(uint8_t pin, km_gpio_irq_mode_t mode, km_gpio_irq_cb cb);
+
+/**
+ * Disable the interrupt of the pin.
+ *
+ * @param {uint8_t} pin
+ */
+int km_gpio_irq_disable(uint8_t pin);
+
 #endif /* __KM_GPIO_H */
@@ -65,6 +65,47 @@ uint64_t km_micro_gettime(void);
 */
 void km_micro_delay(uint32_t usec);
 
+/**
+ * Wait until the deadline or any I/O activity (e.g. TTY, UART or GPIO
+ * interrupt) to save power while the loop has nothing to do. It may return
+ * earlier than the deadline, so the caller should check the time again.
+ *
+ * @param {uint64_t} deadline Time in milliseconds (same base with km_gettime),
+ *   or UINT64_MAX to wait for I/O activity only
+ */
+void km_system_wait_until(uint64_t deadline);
+
+/**
+ * Same as km_system_wait_until(), but the deadline is in microseconds (same
+ * base with km_micro_gettime) to sleep a fraction of a millisecond without
+ * missing any I/O activity. Ports whose sleep is coarser than the remaining
+ * time may return immediately.
+ *
+ * @param {uint64_t} deadline Time in microseconds
+ */
+void km_system_wait_until_us(uint64_t deadline);
+
+/**
+ * Event sources which ports notify to the event loop
+ */
+typedef enum {
+  KM_SYSTEM_EVENT_UART,
+  KM_SYSTEM_EVENT_GPIO,
+  KM_SYSTEM_EVENT_COUNT
+} km_system_event_t;
+
+/**
+ * Notify the event loop that the source (UART port or GPIO pin) has pending
+ * data or an edge. This is implemented by the event loop (not by ports) and
+ * can be called from an interrupt handler. Handlers calling it must not
+ * preempt each other (e.g. use the same interrupt priority), and it must
+ * not be called from other threads (see km_worker_take_done()).
+ *
+ * @param {km_system_event_t} event
+ * @param {uint8_t} source Port or pin number (less than 32)
+ */
+void km_system_notify(km_system_event_t event, uint8_t source);
+
 /**
  * check script running mode - skipping or running user script
  */
@@ -0,0 +1,63 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __KM_WORKER_H
+#define __KM_WORKER_H
+
+#include <stdint.h>
+
+typedef void (*km_worker_fn)(void *arg);
+
+/**
+ * Start the workers which run blocking works (e.g. flash programming) off
+ * the event loop, such as a thread pool or the other core.
+ *
+ * @return The number of workers. Zero if the port has no workers, then the
+ *   event loop runs the works by itself in the work phase.
+ */
+int km_worker_init();
+
+/**
+ * Wait until all the queued and running works are done
+ */
+void km_worker_cleanup();
+
+/**
+ * Run fn(arg) on a worker. When fn returns, the port marks the slot done
+ * and wakes up the event loop if it is in km_system_wait_until(). The loop
+ * takes the done slots by km_worker_take_done(). Workers must not call
+ * km_system_notify(), which is not safe with more than one producer.
+ *
+ * @param {uint8_t} slot Slot of the work (less than 32)
+ * @param {km_worker_fn} fn Function to run. It must not call JerryScript.
+ * @param {void *} arg
+ * @return Return 0 on success or -1 on failure
+ */
+int km_worker_queue(uint8_t slot, km_worker_fn fn, void *arg);
+
+/**
+ * Take the slots of the works done since the last call
+ *
+ * @return Bit mask of the done slots
+ */
+uint32_t km_worker_take_done();
+
+#endif /* __KM_WORKER_H */
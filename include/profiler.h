@@ -0,0 +1,57 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __KM_PROFILER_H
+#define __KM_PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Sampling profiler of JS code. The VM exec stop callback takes a sample
+ * (the JS backtrace) when the interval has passed, and the samples are
+ * aggregated as collapsed stacks ("root;...;leaf count", frames as
+ * "resource:line") in a fixed buffer, to be turned into a flamegraph.
+ * Samples are taken only while JS code is running.
+ */
+#define KM_PROFILER_BUFFER_SIZE 4096
+#define KM_PROFILER_MAX_DEPTH 16
+#define KM_PROFILER_STACK_MAX 256 /* max length of a collapsed stack */
+#define KM_PROFILER_FRAME_MAX 48 /* max length of a frame */
+#define KM_PROFILER_DEFAULT_INTERVAL 1000 /* microseconds */
+
+typedef struct {
+  bool running;
+  uint32_t interval; /* in microseconds */
+  uint32_t samples;
+  uint32_t dropped; /* samples not recorded as the buffer is full */
+  uint32_t stacks; /* number of the distinct stacks */
+} km_profiler_stats_t;
+
+typedef void (*km_profiler_stack_cb)(const char *stack, uint32_t count, void *arg);
+
+int km_profiler_start(uint32_t interval);
+void km_profiler_stop();
+void km_profiler_sample();
+void km_profiler_foreach(km_profiler_stack_cb stack_cb, void *arg);
+km_profiler_stats_t *km_profiler_stats();
+
+#endif /* __KM_PROFILER_H */
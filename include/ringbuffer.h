@@ -1,17 +1,47 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
 #ifndef __RINGBUFFER_H
 #define __RINGBUFFER_H
 
 #include <stdint.h>
 
+/**
+ * Single-producer/single-consumer ring buffer. One side (e.g. an interrupt
+ * handler) may write while the other side (e.g. the loop) reads without
+ * locking. The read and write pointers run freely and are masked by the
+ * size, which is a power of two.
+ */
 typedef struct {
   uint8_t * buf;
-  uint32_t length;
-  uint32_t r_ptr;
-  uint32_t w_ptr;
+  uint32_t length; /* size of the buffer (power of two) */
+  uint32_t mask;
+  uint32_t r_ptr; /* written by the reader only */
+  uint32_t w_ptr; /* written by the writer only */
 } ringbuffer_t;
 
 /**
- * Initialize a ringbuffer with a given alocated buffer.
+ * Initialize a ringbuffer with a given alocated buffer. Only the largest
+ * power of two bytes not exceeding the length are used.
  *
  * @param ringbuffer
  * @param pbuf pointer to internal buffer
@@ -19,6 +49,14 @@ typedef struct {
  */
 void ringbuffer_init(ringbuffer_t *ringbuffer, uint8_t *buf, uint32_t len);
 
+/**
+ * Round up a length to the buffer size used in full by ringbuffer_init().
+ *
+ * @param len requested length
+ * @return the smallest power of two not less than len (0 if len is 0)
+ */
+uint32_t ringbuffer_round_size(uint32_t len);
+
 /**
  * Return the size of ring buffer.
  *
@@ -53,7 +91,8 @@ uint32_t ringbuffer_freespace(ringbuffer_t *ringbuffer);
 void ringbuffer_read(ringbuffer_t *ringbuffer, uint8_t *buf, uint32_t len);
 
 /**
- * Write into data from the ring buffer.
+ * Write into data from the ring buffer. Data exceeding the free space is
+ * dropped.
  *
  * @param ringbuffer
  * @param buf data to write.
@@ -24,9 +24,68 @@
 
 #include "jerryscript.h"
 
+/**
+ * User code compiled to a snapshot is stored in the flash with this header
+ * followed by the snapshot (aligned to 4 bytes), and executed in place.
+ */
+#define KM_SNAPSHOT_MAGIC 0x4E534D4B /* "KMSN" */
+#define KM_SNAPSHOT_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size; /* size of the snapshot */
+  uint32_t source_size; /* size of the source compiled */
+} km_snapshot_header_t;
+
+/**
+ * Boot trace entry. A stage ends when the previous one ends (duration is
+ * the time between), while a span (module load, board) has its own start
+ * and may be nested in a stage. Times are in microseconds from the start.
+ */
+#define KM_BOOT_TRACE_MAX 32
+
+typedef struct {
+  const char *stage;
+  const char *name; /* e.g. module name, or NULL */
+  uint32_t time; /* end time */
+  uint32_t duration;
+} km_boot_trace_t;
+
+/**
+ * Memory pressure thresholds in percent of the JS heap (0 to disable).
+ * A low pressure GC runs in idle time when the heap use crosses the GC
+ * watermark, and `process` emits 'memoryPressure' when the use (after the
+ * GC) goes up to the moderate or critical level.
+ */
+#define KM_RUNTIME_GC_WATERMARK 70
+#define KM_RUNTIME_MODERATE_PRESSURE 80
+#define KM_RUNTIME_CRITICAL_PRESSURE 90
+
+#define KM_RUNTIME_PRESSURE_NONE 0
+#define KM_RUNTIME_PRESSURE_MODERATE 1
+#define KM_RUNTIME_PRESSURE_CRITICAL 2
+
+typedef struct {
+  uint8_t gc;
+  uint8_t moderate;
+  uint8_t critical;
+} km_runtime_memory_pressure_t;
+
 void km_runtime_init(bool load, bool first);
 void km_runtime_cleanup();
 void km_runtime_load();
+bool km_runtime_run_script(const uint8_t *script, size_t size);
+bool km_runtime_is_snapshot(const uint8_t *data, size_t size);
+bool km_runtime_run_snapshot(const uint8_t *data, size_t size);
+size_t km_runtime_compile(const uint8_t *script, size_t size, uint32_t *buffer, size_t buffer_size);
+bool km_runtime_in_place();
+void km_boot_trace_reset();
+void km_boot_trace(const char *stage);
+void km_boot_trace_span(const char *stage, const char *name, uint64_t begin);
+uint8_t km_boot_trace_get(const km_boot_trace_t **trace);
+void km_runtime_set_memory_pressure(km_runtime_memory_pressure_t *pressure);
+km_runtime_memory_pressure_t *km_runtime_get_memory_pressure();
 void km_runtime_set_vm_stop(uint8_t stop);
 
 #endif /* __KM_RUNTIME_H */
\ No newline at end of file
@@ -0,0 +1,82 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __KM_TLSF_H
+#define __KM_TLSF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Two-Level Segregated Fit allocator on a fixed arena. Both allocation
+ * and free take constant time regardless of the number of blocks.
+ *
+ * Free blocks are kept in lists by size class: the first level is the
+ * power of two of the size and the second level splits it linearly into
+ * KM_TLSF_SL_COUNT classes. Bitmaps of the non-empty lists are searched
+ * with a find-first-set.
+ */
+
+#define KM_TLSF_ALIGN 8
+#define KM_TLSF_SL_LOG2 4
+#define KM_TLSF_SL_COUNT (1 << KM_TLSF_SL_LOG2)
+#define KM_TLSF_FL_SHIFT (KM_TLSF_SL_LOG2 + 3) /* log2 of KM_TLSF_ALIGN */
+#ifndef KM_TLSF_FL_MAX
+#define KM_TLSF_FL_MAX 24 /* the arena up to 16MB */
+#endif
+#define KM_TLSF_FL_COUNT (KM_TLSF_FL_MAX - KM_TLSF_FL_SHIFT + 1)
+
+typedef struct km_tlsf_block_s km_tlsf_block_t;
+
+struct km_tlsf_block_s {
+  km_tlsf_block_t *prev_phys; /* the block right before in the arena */
+  size_t size; /* payload size with KM_TLSF_FREE flag */
+  /* below are valid only in free blocks (overlapped with payload) */
+  km_tlsf_block_t *next_free;
+  km_tlsf_block_t *prev_free;
+};
+
+typedef struct {
+  uint32_t fl_bitmap;
+  uint32_t sl_bitmap[KM_TLSF_FL_COUNT];
+  km_tlsf_block_t *blocks[KM_TLSF_FL_COUNT][KM_TLSF_SL_COUNT];
+  uint8_t *start;
+  uint8_t *end;
+  size_t free_bytes; /* payload bytes of the free blocks */
+  uint32_t free_blocks;
+} km_tlsf_t;
+
+typedef struct {
+  uint32_t size; /* arena size */
+  uint32_t used; /* allocated bytes including the block headers */
+  uint32_t free;
+  uint32_t free_blocks;
+  uint32_t largest_free; /* the largest free block */
+} km_tlsf_stats_t;
+
+bool km_tlsf_init(km_tlsf_t *tlsf, void *mem, size_t size);
+void *km_tlsf_malloc(km_tlsf_t *tlsf, size_t size);
+void km_tlsf_free(km_tlsf_t *tlsf, void *ptr);
+bool km_tlsf_owns(km_tlsf_t *tlsf, void *ptr);
+void km_tlsf_stats(km_tlsf_t *tlsf, km_tlsf_stats_t *stats);
+
+#endif /* __KM_TLSF_H */
@@ -23,9 +23,17 @@
 #define __KM_UTILS_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define KM_CONTAINER_OF(ptr, type, field) \
+  ((type *) ((char *) (ptr) - offsetof(type, field)))
 
 typedef struct km_list_node_s km_list_node_t;
 typedef struct km_list_s km_list_t;
+typedef struct km_heap_node_s km_heap_node_t;
+typedef struct km_heap_s km_heap_t;
+typedef struct km_pool_s km_pool_t;
 
 struct km_list_node_s {
   km_list_node_t *prev;
@@ -41,6 +49,44 @@ void km_list_init(km_list_t *list);
 void km_list_append(km_list_t *list, km_list_node_t *node);
 void km_list_remove(km_list_t *list, km_list_node_t *node);
 
+/* intrusive binary min-heap (no allocation, embed a node in the item) */
+
+struct km_heap_node_s {
+  km_heap_node_t *left;
+  km_heap_node_t *right;
+  km_heap_node_t *parent;
+};
+
+struct km_heap_s {
+  km_heap_node_t *min;
+  uint32_t length;
+};
+
+typedef bool (* km_heap_less_cb)(km_heap_node_t *a, km_heap_node_t *b);
+
+void km_heap_init(km_heap_t *heap);
+km_heap_node_t *km_heap_min(km_heap_t *heap);
+void km_heap_insert(km_heap_t *heap, km_heap_node_t *node, km_heap_less_cb less_than);
+void km_heap_remove(km_heap_t *heap, km_heap_node_t *node, km_heap_less_cb less_than);
+
+/* fixed-size object pool (objects are carved from slabs which are never
+   returned to the heap, so churn does not fragment the heap) */
+
+struct km_pool_s {
+  size_t obj_size;
+  uint16_t slab_objs;
+  void *free_list;
+  void *slabs;
+  uint32_t total; /* objects in all slabs */
+  uint32_t used; /* objects in use */
+  uint32_t high_water; /* max objects in use */
+  uint32_t slab_count;
+};
+
+void km_pool_init(km_pool_t *pool, size_t obj_size, uint16_t slab_objs);
+void *km_pool_alloc(km_pool_t *pool);
+void km_pool_free(km_pool_t *pool, void *obj);
+
 uint8_t km_hex1(char hex);
 uint8_t km_hex2bin(unsigned char *hex);
 
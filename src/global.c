@@ -19,6 +19,7 @@
  * SOFTWARE.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "utils.h"
@@ -38,6 +39,8 @@
 #include "system.h"
 #include "kaluma_config.h"
 #include "base64.h"
+#include "profiler.h"
+#include "memstats.h"
 
 static void register_global_objects() {
   jerry_value_t global_object = jerry_get_global_object ();
@@ -231,8 +234,21 @@ JERRYXX_FUN(pulse_write_fn) {
   return jerry_create_number(length);
 }
 
+/**
+ * Read the priority of a handle from the options (PRIORITY_NORMAL if not
+ * given). Returns -1 if the priority is invalid.
+ */
+static int get_priority_option(jerry_value_t options) {
+  double priority = jerryxx_get_property_number(options, MSTR_PRIORITY, KM_IO_PRIORITY_NORMAL);
+  if (priority != KM_IO_PRIORITY_REALTIME && priority != KM_IO_PRIORITY_NORMAL &&
+      priority != KM_IO_PRIORITY_BACKGROUND) {
+    return -1;
+  }
+  return (int) priority;
+}
+
 static void watch_close_cb(km_io_handle_t *handle) {
-  free(handle);
+  km_io_handle_free(handle);
 }
 
 static void set_watch_cb(km_io_watch_handle_t *watch) {
@@ -257,12 +273,24 @@ JERRYXX_FUN(set_watch_fn) {
   JERRYXX_CHECK_ARG_NUMBER(1, "pin");
   JERRYXX_CHECK_ARG_NUMBER_OPT(2, "mode");
   JERRYXX_CHECK_ARG_NUMBER_OPT(3, "debounce");
+  JERRYXX_CHECK_ARG_OBJECT_OPT(4, "options");
   jerry_value_t callback = JERRYXX_GET_ARG(0);
   uint8_t pin = (uint8_t) JERRYXX_GET_ARG_NUMBER(1);
   km_io_watch_mode_t mode = JERRYXX_GET_ARG_NUMBER_OPT(2, KM_IO_WATCH_MODE_CHANGE);
   uint32_t debounce = JERRYXX_GET_ARG_NUMBER_OPT(3, 0);
-  km_io_watch_handle_t *watch = malloc(sizeof(km_io_watch_handle_t));
+  int priority = KM_IO_PRIORITY_NORMAL;
+  if (JERRYXX_HAS_ARG(4)) {
+    priority = get_priority_option(JERRYXX_GET_ARG(4));
+    if (priority < 0) {
+      return jerry_create_error(JERRY_ERROR_RANGE, (const jerry_char_t *) "Invalid priority.");
+    }
+  }
+  km_io_watch_handle_t *watch = (km_io_watch_handle_t *) km_io_handle_alloc(KM_IO_WATCH);
+  if (watch == NULL) {
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
   km_io_watch_init(watch);
+  watch->base.priority = priority;
   watch->watch_js_cb = jerry_acquire_value(callback);
   km_io_watch_start(watch, set_watch_cb, pin, mode, debounce);
   return jerry_create_number(watch->base.id);
@@ -280,30 +308,6 @@ JERRYXX_FUN(clear_watch_fn) {
   return jerry_create_undefined();
 }
 
-static void register_global_digital_io() {
-  jerry_value_t global = jerry_get_global_object();
-  jerryxx_set_property_number(global, MSTR_HIGH, KM_GPIO_HIGH);
-  jerryxx_set_property_number(global, MSTR_LOW, KM_GPIO_LOW);
-  jerryxx_set_property_number(global, MSTR_INPUT, (double) KM_GPIO_IO_MODE_INPUT);
-  jerryxx_set_property_number(global, MSTR_OUTPUT, (double) KM_GPIO_IO_MODE_OUTPUT);
-  jerryxx_set_property_number(global, MSTR_INPUT_PULLUP, (double) KM_GPIO_IO_MODE_INPUT_PULLUP);
-  jerryxx_set_property_number(global, MSTR_INPUT_PULLDOWN, (double) KM_GPIO_IO_MODE_INPUT_PULLDOWN);
-  jerryxx_set_property_number(global, MSTR_CHANGE, (double) KM_IO_WATCH_MODE_CHANGE);
-  jerryxx_set_property_number(global, MSTR_RISING, (double) KM_IO_WATCH_MODE_RISING);
-  jerryxx_set_property_number(global, MSTR_FALLING, (double) KM_IO_WATCH_MODE_FALLING);
-  jerryxx_set_property_number(global, MSTR_PULLNO, (double) KM_IO_PULL_NO);
-  jerryxx_set_property_number(global, MSTR_PULLUP, (double) KM_IO_PULL_UP);
-  jerryxx_set_property_number(global, MSTR_PULLDOWN, (double) KM_IO_PULL_DOWN);
-  jerryxx_set_property_function(global, MSTR_PIN_MODE, pin_mode_fn);
-  jerryxx_set_property_function(global, MSTR_DIGITAL_READ, digital_read_fn);
-  jerryxx_set_property_function(global, MSTR_DIGITAL_WRITE, digital_write_fn);
-  jerryxx_set_property_function(global, MSTR_DIGITAL_TOGGLE, digital_toggle_fn);
-  jerryxx_set_property_function(global, MSTR_PULSE_READ, pulse_read_fn);
-  jerryxx_set_property_function(global, MSTR_PULSE_WRITE, pulse_write_fn);
-  jerryxx_set_property_function(global, MSTR_SET_WATCH, set_watch_fn);
-  jerryxx_set_property_function(global, MSTR_CLEAR_WATCH, clear_watch_fn);
-  jerry_release_value(global);
-}
 
 /****************************************************************************/
 /*                                                                          */
@@ -372,7 +376,11 @@ JERRYXX_FUN(tone_fn) {
     km_pwm_start(pin);
     // setup timer for duration
     if (duration > 0) {
-      km_io_timer_handle_t *timer = malloc(sizeof(km_io_timer_handle_t));
+      km_io_timer_handle_t *timer = (km_io_timer_handle_t *) km_io_handle_alloc(KM_IO_TIMER);
+      if (timer == NULL) {
+        km_pwm_stop(pin);
+        return JERRYXX_CREATE_ERROR("Out of memory.");
+      }
       km_io_timer_init(timer);
       timer->tag = pin;
       km_io_timer_start(timer, tone_timeout_cb, duration, false);
@@ -392,14 +400,6 @@ JERRYXX_FUN(no_tone_fn) {
   return jerry_create_undefined();
 }
 
-static void register_global_analog_io() {
-  jerry_value_t global = jerry_get_global_object();
-  jerryxx_set_property_function(global, MSTR_ANALOG_READ, analog_read_fn);
-  jerryxx_set_property_function(global, MSTR_ANALOG_WRITE, analog_write_fn);
-  jerryxx_set_property_function(global, MSTR_TONE, tone_fn);
-  jerryxx_set_property_function(global, MSTR_NO_TONE, no_tone_fn);
-  jerry_release_value(global);
-}
 
 /****************************************************************************/
 /*                                                                          */
@@ -408,7 +408,7 @@ static void register_global_analog_io() {
 /****************************************************************************/
 
 static void timer_close_cb(km_io_handle_t *handle) {
-  free(handle);
+  km_io_handle_free(handle);
 }
 
 static void set_timer_cb(km_io_timer_handle_t *timer) {
@@ -437,10 +437,22 @@ static void set_timer_cb(km_io_timer_handle_t *timer) {
 JERRYXX_FUN(set_timeout_fn) {
   JERRYXX_CHECK_ARG_FUNCTION(0, "callback");
   JERRYXX_CHECK_ARG_NUMBER(1, "delay");
+  JERRYXX_CHECK_ARG_OBJECT_OPT(2, "options");
   jerry_value_t callback = JERRYXX_GET_ARG(0);
   uint64_t delay = (uint64_t) JERRYXX_GET_ARG_NUMBER(1);
-  km_io_timer_handle_t *timer = malloc(sizeof(km_io_timer_handle_t));
+  int priority = KM_IO_PRIORITY_NORMAL;
+  if (JERRYXX_HAS_ARG(2)) {
+    priority = get_priority_option(JERRYXX_GET_ARG(2));
+    if (priority < 0) {
+      return jerry_create_error(JERRY_ERROR_RANGE, (const jerry_char_t *) "Invalid priority.");
+    }
+  }
+  km_io_timer_handle_t *timer = (km_io_timer_handle_t *) km_io_handle_alloc(KM_IO_TIMER);
+  if (timer == NULL) {
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
   km_io_timer_init(timer);
+  timer->base.priority = priority;
   timer->timer_js_cb = jerry_acquire_value(callback);
   km_io_timer_start(timer, set_timer_cb, delay, false);
   return jerry_create_number(timer->base.id);
@@ -449,10 +461,22 @@ JERRYXX_FUN(set_timeout_fn) {
 JERRYXX_FUN(set_interval_fn) {
   JERRYXX_CHECK_ARG_FUNCTION(0, "callback");
   JERRYXX_CHECK_ARG_NUMBER(1, "delay");
+  JERRYXX_CHECK_ARG_OBJECT_OPT(2, "options");
   jerry_value_t callback = JERRYXX_GET_ARG(0);
   uint64_t delay = (uint64_t) JERRYXX_GET_ARG_NUMBER(1);
-  km_io_timer_handle_t *timer = malloc(sizeof(km_io_timer_handle_t));
+  int priority = KM_IO_PRIORITY_NORMAL;
+  if (JERRYXX_HAS_ARG(2)) {
+    priority = get_priority_option(JERRYXX_GET_ARG(2));
+    if (priority < 0) {
+      return jerry_create_error(JERRY_ERROR_RANGE, (const jerry_char_t *) "Invalid priority.");
+    }
+  }
+  km_io_timer_handle_t *timer = (km_io_timer_handle_t *) km_io_handle_alloc(KM_IO_TIMER);
+  if (timer == NULL) {
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
   km_io_timer_init(timer);
+  timer->base.priority = priority;
   timer->timer_js_cb = jerry_acquire_value(callback);
   km_io_timer_start(timer, set_timer_cb, delay, true);
   return jerry_create_number(timer->base.id);
@@ -470,6 +494,167 @@ JERRYXX_FUN(clear_timer_fn) {
   return jerry_create_undefined();
 }
 
+static void periodic_close_cb(km_io_handle_t *handle) {
+  km_io_handle_free(handle);
+}
+
+static void periodic_cb(km_io_periodic_handle_t *periodic) {
+  if (jerry_value_is_function(periodic->periodic_js_cb)) {
+    jerry_value_t this_val = jerry_create_undefined();
+    jerry_value_t ret_val = jerry_call_function(periodic->periodic_js_cb, this_val, NULL, 0);
+    if (jerry_value_is_error(ret_val)) {
+      jerryxx_print_error(ret_val, true);
+      jerry_release_value(periodic->periodic_js_cb);
+      km_io_periodic_stop(periodic);
+      km_io_handle_close((km_io_handle_t *) periodic, periodic_close_cb);
+    }
+    jerry_release_value(ret_val);
+    jerry_release_value(this_val);
+  }
+}
+
+/**
+ * setPeriodic(callback, period[, options]). The period is in microseconds.
+ * Options are the priority (realtime or not) and the policy for the missed
+ * periods (PERIODIC_SKIP or PERIODIC_CATCHUP).
+ */
+JERRYXX_FUN(set_periodic_fn) {
+  JERRYXX_CHECK_ARG_FUNCTION(0, "callback");
+  JERRYXX_CHECK_ARG_NUMBER(1, "period");
+  JERRYXX_CHECK_ARG_OBJECT_OPT(2, "options");
+  jerry_value_t callback = JERRYXX_GET_ARG(0);
+  double period = JERRYXX_GET_ARG_NUMBER(1);
+  if (period < 1 || period > UINT32_MAX) {
+    return jerry_create_error(JERRY_ERROR_RANGE, (const jerry_char_t *) "Invalid period.");
+  }
+  int priority = KM_IO_PRIORITY_NORMAL;
+  int policy = KM_IO_PERIODIC_SKIP;
+  if (JERRYXX_HAS_ARG(2)) {
+    priority = get_priority_option(JERRYXX_GET_ARG(2));
+    if (priority < 0) {
+      return jerry_create_error(JERRY_ERROR_RANGE, (const jerry_char_t *) "Invalid priority.");
+    }
+    policy = (int) jerryxx_get_property_number(JERRYXX_GET_ARG(2), MSTR_POLICY, KM_IO_PERIODIC_SKIP);
+    if (policy != KM_IO_PERIODIC_SKIP && policy != KM_IO_PERIODIC_CATCHUP) {
+      return jerry_create_error(JERRY_ERROR_RANGE, (const jerry_char_t *) "Invalid policy.");
+    }
+  }
+  km_io_periodic_handle_t *periodic = (km_io_periodic_handle_t *) km_io_handle_alloc(KM_IO_PERIODIC);
+  if (periodic == NULL) {
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
+  km_io_periodic_init(periodic);
+  periodic->base.priority = priority;
+  periodic->periodic_js_cb = jerry_acquire_value(callback);
+  km_io_periodic_start(periodic, periodic_cb, (uint32_t) period, policy);
+  return jerry_create_number(periodic->base.id);
+}
+
+JERRYXX_FUN(clear_periodic_fn) {
+  JERRYXX_CHECK_ARG_NUMBER(0, "id");
+  int id = (int) JERRYXX_GET_ARG_NUMBER(0);
+  km_io_periodic_handle_t *periodic = km_io_periodic_get_by_id(id);
+  if (periodic != NULL) {
+    jerry_release_value(periodic->periodic_js_cb);
+    km_io_periodic_stop(periodic);
+    km_io_handle_close((km_io_handle_t *) periodic, periodic_close_cb);
+  }
+  return jerry_create_undefined();
+}
+
+static uint32_t isqrt(uint64_t n) {
+  uint64_t x = 0;
+  uint64_t bit = (uint64_t) 1 << 62;
+  while (bit > n) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (n >= x + bit) {
+      n -= x + bit;
+      x = (x >> 1) + bit;
+    } else {
+      x >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t) x;
+}
+
+/**
+ * getPeriodicStats(id). Returns the latencies of the callbacks from their
+ * schedule in microseconds, or undefined if the id is not active.
+ */
+JERRYXX_FUN(get_periodic_stats_fn) {
+  JERRYXX_CHECK_ARG_NUMBER(0, "id");
+  int id = (int) JERRYXX_GET_ARG_NUMBER(0);
+  km_io_periodic_handle_t *periodic = km_io_periodic_get_by_id(id);
+  if (periodic == NULL) {
+    return jerry_create_undefined();
+  }
+  km_io_periodic_stats_t *stats = &periodic->stats;
+  uint32_t avg = 0;
+  uint32_t jitter = 0;
+  if (stats->fired > 0) {
+    uint64_t mean = stats->latency_sum / stats->fired;
+    uint64_t mean_sq = stats->latency_sq_sum / stats->fired;
+    avg = (uint32_t) mean;
+    jitter = (mean_sq > mean * mean) ? isqrt(mean_sq - mean * mean) : 0;
+  }
+  jerry_value_t obj = jerry_create_object();
+  jerryxx_set_property_number(obj, MSTR_PERIOD, periodic->period);
+  jerryxx_set_property_number(obj, MSTR_FIRED, stats->fired);
+  jerryxx_set_property_number(obj, MSTR_LATE, stats->late);
+  jerryxx_set_property_number(obj, MSTR_SKIPPED, stats->skipped);
+  jerryxx_set_property_number(obj, MSTR_MAX_LATENCY, stats->max_latency);
+  jerryxx_set_property_number(obj, MSTR_AVG_LATENCY, avg);
+  jerryxx_set_property_number(obj, MSTR_JITTER, jitter);
+  return obj;
+}
+
+static void immediate_close_cb(km_io_handle_t *handle) {
+  km_io_handle_free(handle);
+}
+
+static void immediate_cb(km_io_immediate_handle_t *immediate) {
+  jerry_value_t callback = immediate->immediate_js_cb;
+  km_io_handle_close((km_io_handle_t *) immediate, immediate_close_cb);
+  if (jerry_value_is_function(callback)) {
+    jerry_value_t this_val = jerry_create_undefined();
+    jerry_value_t ret_val = jerry_call_function(callback, this_val, NULL, 0);
+    if (jerry_value_is_error(ret_val)) {
+      jerryxx_print_error(ret_val, true);
+    }
+    jerry_release_value(ret_val);
+    jerry_release_value(this_val);
+  }
+  jerry_release_value(callback);
+}
+
+JERRYXX_FUN(set_immediate_fn) {
+  JERRYXX_CHECK_ARG_FUNCTION(0, "callback");
+  jerry_value_t callback = JERRYXX_GET_ARG(0);
+  km_io_immediate_handle_t *immediate = (km_io_immediate_handle_t *) km_io_handle_alloc(KM_IO_IMMEDIATE);
+  if (immediate == NULL) {
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
+  km_io_immediate_init(immediate);
+  immediate->immediate_js_cb = jerry_acquire_value(callback);
+  km_io_immediate_start(immediate, immediate_cb);
+  return jerry_create_number(immediate->base.id);
+}
+
+JERRYXX_FUN(clear_immediate_fn) {
+  JERRYXX_CHECK_ARG_NUMBER(0, "id");
+  int id = (int) JERRYXX_GET_ARG_NUMBER(0);
+  km_io_immediate_handle_t *immediate = km_io_immediate_get_by_id(id);
+  if (immediate != NULL) {
+    jerry_release_value(immediate->immediate_js_cb);
+    km_io_immediate_stop(immediate);
+    km_io_handle_close((km_io_handle_t *) immediate, immediate_close_cb);
+  }
+  return jerry_create_undefined();
+}
+
 JERRYXX_FUN(delay_fn) {
   JERRYXX_CHECK_ARG_NUMBER_OPT(0, "id");
   uint32_t delay_val = (uint32_t) JERRYXX_GET_ARG_NUMBER_OPT(0, 0);
@@ -482,16 +667,6 @@ JERRYXX_FUN(millis_fn) {
   return jerry_create_number(msec);
 }
 
-static void register_global_timers() {
-  jerry_value_t global = jerry_get_global_object();
-  jerryxx_set_property_function(global, MSTR_SET_TIMEOUT, set_timeout_fn);
-  jerryxx_set_property_function(global, MSTR_SET_INTERVAL, set_interval_fn);
-  jerryxx_set_property_function(global, MSTR_CLEAR_TIMEOUT, clear_timer_fn);
-  jerryxx_set_property_function(global, MSTR_CLEAR_INTERVAL, clear_timer_fn);
-  jerryxx_set_property_function(global, MSTR_DELAY, delay_fn);
-  jerryxx_set_property_function(global, MSTR_MILLIS, millis_fn);
-  jerry_release_value(global);
-}
 
 /****************************************************************************/
 /*                                                                          */
@@ -553,14 +728,62 @@ static void register_global_console_object() {
 /*                                                                          */
 /****************************************************************************/
 
+/**
+ * Exports of the native modules initialized, indexed as builtin_modules
+ * (0 if not initialized yet, which is never an object value)
+ */
+static jerry_value_t *native_module_cache = NULL;
+
+/**
+ * Find the builtin module by name (binary search as builtin_modules is
+ * sorted by name). Returns the index or -1.
+ */
+static int find_builtin_module(const char *name) {
+  int low = 0;
+  int high = (int) builtin_modules_length - 1;
+  while (low <= high) {
+    int mid = (low + high) / 2;
+    int cmp = strcmp(builtin_modules[mid].name, name);
+    if (cmp == 0) {
+      return mid;
+    } else if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid - 1;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Return the exports of the native module, initialized only once
+ */
+static jerry_value_t get_native_module(int index) {
+  if (native_module_cache == NULL) {
+    native_module_cache = (jerry_value_t *) calloc(builtin_modules_length, sizeof(jerry_value_t));
+    if (native_module_cache == NULL) {
+      return builtin_modules[index].fn();
+    }
+  }
+  if (native_module_cache[index] == 0) {
+    uint64_t begin = km_micro_gettime();
+    jerry_value_t exports = builtin_modules[index].fn();
+    km_boot_trace_span("native", builtin_modules[index].name, begin);
+    if (jerry_value_is_error(exports)) {
+      return exports;
+    }
+    native_module_cache[index] = exports;
+  }
+  return jerry_acquire_value(native_module_cache[index]);
+}
+
 JERRYXX_FUN(process_binding_fn) {
   JERRYXX_CHECK_ARG_STRING(0, "native_module_name")
   JERRYXX_GET_ARG_STRING_AS_CHAR(0, native_module_name)
   /* Return a native initialized object */
-  for (int i = 0; i < builtin_modules_length; i++) {
-    if (strcmp(builtin_modules[i].name, native_module_name) == 0 && builtin_modules[i].fn != NULL) {
-      return builtin_modules[i].fn();
-    }
+  int index = find_builtin_module(native_module_name);
+  if (index >= 0 && builtin_modules[index].fn != NULL) {
+    return get_native_module(index);
   }
   /* If no corresponding module, return undefined */
   return jerry_create_undefined();
@@ -578,35 +801,271 @@ JERRYXX_FUN(native_module_wrapper_fn) {
   module_name[module_name_sz] = '\0';
   jerry_release_value(id);
   /* Find corresponding native module */
-  for (int i = 0; i < builtin_modules_length; i++) {
-    if (strcmp(builtin_modules[i].name, module_name) == 0 && builtin_modules[i].fn != NULL) {
-      jerry_value_t res = builtin_modules[i].fn();
-      jerryxx_set_property(module, MSTR_EXPORTS, res);
-      jerry_release_value(res);
-    }
+  int index = find_builtin_module(module_name);
+  if (index >= 0 && builtin_modules[index].fn != NULL) {
+    jerry_value_t res = get_native_module(index);
+    jerryxx_set_property(module, MSTR_EXPORTS, res);
+    jerry_release_value(res);
   }
   return jerry_create_undefined();
 }
 
+/**
+ * Return the function of the builtin module, or undefined if not found
+ */
 JERRYXX_FUN(process_get_builtin_module_fn) {
   JERRYXX_CHECK_ARG_STRING(0, "builtin_module_name")
   JERRYXX_GET_ARG_STRING_AS_CHAR(0, builtin_module_name)
   /* Find a builtin js module, return the module function */
-  for (int i = 0; i < builtin_modules_length; i++) {
-    if (strcmp(builtin_modules[i].name, builtin_module_name) == 0) {
-      if (builtin_modules[i].size > 0) { /* has js module */
-        jerry_value_t fn = jerry_exec_snapshot(builtin_modules[i].code, builtin_modules[i].size, 0, JERRY_SNAPSHOT_EXEC_ALLOW_STATIC);
-        return fn;
-      } else if (builtin_modules[i].fn != NULL) { /* has native module */
-        jerry_value_t fn = jerry_create_external_function(native_module_wrapper_fn);
-        return fn;
-      }
+  int index = find_builtin_module(builtin_module_name);
+  if (index >= 0) {
+    if (builtin_modules[index].size > 0) { /* has js module */
+      uint64_t begin = km_micro_gettime();
+      jerry_value_t fn = jerry_exec_snapshot(builtin_modules[index].code, builtin_modules[index].size, 0, JERRY_SNAPSHOT_EXEC_ALLOW_STATIC);
+      km_boot_trace_span("module", builtin_modules[index].name, begin);
+      return fn;
+    } else if (builtin_modules[index].fn != NULL) { /* has native module */
+      jerry_value_t fn = jerry_create_external_function(native_module_wrapper_fn);
+      return fn;
     }
   }
   /* return undefined */
   return jerry_create_undefined();
 }
 
+JERRYXX_FUN(process_next_tick_fn) {
+  JERRYXX_CHECK_ARG_FUNCTION(0, "callback");
+  jerry_value_t callback = JERRYXX_GET_ARG(0);
+  km_io_immediate_handle_t *immediate = (km_io_immediate_handle_t *) km_io_handle_alloc(KM_IO_IMMEDIATE);
+  if (immediate == NULL) {
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
+  km_io_immediate_init(immediate);
+  immediate->immediate_js_cb = jerry_acquire_value(callback);
+  km_io_immediate_tick(immediate, immediate_cb);
+  return jerry_create_undefined();
+}
+
+JERRYXX_FUN(process_loop_stats_fn) {
+  JERRYXX_CHECK_ARG_BOOLEAN_OPT(0, "reset");
+  bool reset = JERRYXX_GET_ARG_BOOLEAN_OPT(0, false);
+  km_io_loop_stats_t *stats = km_io_stats();
+  jerry_value_t obj = jerry_create_object();
+  jerryxx_set_property_number(obj, MSTR_ITERATIONS, stats->iterations);
+  jerryxx_set_property_number(obj, MSTR_MAX_LAG, stats->max_lag);
+  jerryxx_set_property_number(obj, MSTR_YIELDS, stats->yields);
+  jerry_value_t lag = jerry_create_array(KM_IO_LAG_BUCKETS);
+  for (int i = 0; i < KM_IO_LAG_BUCKETS; i++) {
+    jerry_value_t value = jerry_create_number(stats->lag[i]);
+    jerry_value_t ret = jerry_set_property_by_index(lag, i, value);
+    jerry_release_value(ret);
+    jerry_release_value(value);
+  }
+  jerryxx_set_property(obj, MSTR_LAG, lag);
+  jerry_release_value(lag);
+  jerry_value_t phases = jerry_create_object();
+  for (int i = 0; i < KM_IO_PHASE_COUNT; i++) {
+    jerry_value_t phase = jerry_create_object();
+    jerryxx_set_property_number(phase, MSTR_TIME, stats->phases[i].time);
+    jerryxx_set_property_number(phase, MSTR_MAX_TIME, stats->phases[i].max_time);
+    jerryxx_set_property_number(phase, MSTR_COUNT, stats->phases[i].count);
+    jerryxx_set_property_number(phase, MSTR_CALLBACKS, stats->phases[i].callbacks);
+    jerryxx_set_property(phases, km_io_phase_name(i), phase);
+    jerry_release_value(phase);
+  }
+  jerryxx_set_property(obj, MSTR_PHASES, phases);
+  jerry_release_value(phases);
+  if (reset) {
+    km_io_stats_reset();
+  }
+  return obj;
+}
+
+JERRYXX_FUN(process_set_loop_budget_fn) {
+  JERRYXX_CHECK_ARG_OBJECT_OPT(0, "options");
+  km_io_budget_t *budget = km_io_budget();
+  budget->max_callbacks = 0;
+  budget->max_micros = 0;
+  budget->max_phase_callbacks = 0;
+  if (JERRYXX_HAS_ARG(0)) {
+    jerry_value_t options = JERRYXX_GET_ARG(0);
+    budget->max_callbacks = (uint32_t) jerryxx_get_property_number(options, MSTR_MAX_CALLBACKS, 0);
+    budget->max_micros = (uint32_t) jerryxx_get_property_number(options, MSTR_MAX_MICROS, 0);
+    budget->max_phase_callbacks = (uint32_t) jerryxx_get_property_number(options, MSTR_MAX_PHASE_CALLBACKS, 0);
+  }
+  return jerry_create_undefined();
+}
+
+/**
+ * process.ref(id) and process.unref(id). An unreferenced handle (e.g. a
+ * timer id) does not keep the host runtime from exiting.
+ */
+JERRYXX_FUN(process_ref_fn) {
+  JERRYXX_CHECK_ARG_NUMBER(0, "id");
+  km_io_handle_t *handle = km_io_handle_find((uint32_t) JERRYXX_GET_ARG_NUMBER(0));
+  if (handle != NULL) {
+    km_io_handle_ref(handle);
+  }
+  return jerry_create_undefined();
+}
+
+JERRYXX_FUN(process_unref_fn) {
+  JERRYXX_CHECK_ARG_NUMBER(0, "id");
+  km_io_handle_t *handle = km_io_handle_find((uint32_t) JERRYXX_GET_ARG_NUMBER(0));
+  if (handle != NULL) {
+    km_io_handle_unref(handle);
+  }
+  return jerry_create_undefined();
+}
+
+JERRYXX_FUN(process_has_ref_fn) {
+  JERRYXX_CHECK_ARG_NUMBER(0, "id");
+  km_io_handle_t *handle = km_io_handle_find((uint32_t) JERRYXX_GET_ARG_NUMBER(0));
+  return jerry_create_boolean(handle != NULL && km_io_handle_has_ref(handle));
+}
+
+/**
+ * process.bootTrace() function. Returns an array of the boot stages
+ * ({ stage, name, time, duration } in microseconds).
+ */
+JERRYXX_FUN(process_boot_trace_fn) {
+  const km_boot_trace_t *trace;
+  uint8_t count = km_boot_trace_get(&trace);
+  jerry_value_t array = jerry_create_array(count);
+  for (int i = 0; i < count; i++) {
+    jerry_value_t entry = jerry_create_object();
+    jerryxx_set_property_string(entry, MSTR_STAGE, (char *) trace[i].stage);
+    if (trace[i].name != NULL) {
+      jerryxx_set_property_string(entry, MSTR_NAME, (char *) trace[i].name);
+    }
+    jerryxx_set_property_number(entry, MSTR_TIME, trace[i].time);
+    jerryxx_set_property_number(entry, MSTR_DURATION, trace[i].duration);
+    jerry_value_t ret = jerry_set_property_by_index(array, i, entry);
+    jerry_release_value(ret);
+    jerry_release_value(entry);
+  }
+  return array;
+}
+
+/**
+ * process.profile.start([interval]) function. Start the sampling profiler
+ * with the interval in microseconds (1000 by default).
+ */
+JERRYXX_FUN(process_profile_start_fn) {
+  JERRYXX_CHECK_ARG_NUMBER_OPT(0, "interval")
+  uint32_t interval = (uint32_t) JERRYXX_GET_ARG_NUMBER_OPT(0, KM_PROFILER_DEFAULT_INTERVAL);
+  if (km_profiler_start(interval) < 0) {
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
+  return jerry_create_undefined();
+}
+
+static void profile_length_cb(const char *stack, uint32_t count, void *arg) {
+  *((size_t *) arg) += strlen(stack) + 12; /* " <count>\n" */
+}
+
+static void profile_print_cb(const char *stack, uint32_t count, void *arg) {
+  char *buf = (char *) arg;
+  sprintf(buf + strlen(buf), "%s %u\n", stack, (unsigned) count);
+}
+
+/**
+ * process.profile.stop() function. Stop the profiler and return the
+ * samples as collapsed stacks ("root;...;leaf count" lines).
+ */
+JERRYXX_FUN(process_profile_stop_fn) {
+  km_profiler_stop();
+  size_t size = 1;
+  km_profiler_foreach(profile_length_cb, &size);
+  char *buf = (char *) malloc(size);
+  if (buf == NULL) {
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
+  buf[0] = '\0';
+  km_profiler_foreach(profile_print_cb, buf);
+  jerry_value_t ret = jerry_create_string((const jerry_char_t *) buf);
+  free(buf);
+  return ret;
+}
+
+/**
+ * process.memoryUsage() function. Returns the usage of the JS heap (with
+ * the live objects by type) and the native heap (with the allocations by
+ * tag) in bytes.
+ */
+JERRYXX_FUN(process_memory_usage_fn) {
+  km_memstats_t stats;
+  km_memstats_get(&stats);
+  jerry_value_t usage = jerry_create_object();
+  jerryxx_set_property_number(usage, MSTR_HEAP_TOTAL, stats.heap_size);
+  jerryxx_set_property_number(usage, MSTR_HEAP_USED, stats.heap_used);
+  jerryxx_set_property_number(usage, MSTR_HEAP_PEAK, stats.heap_peak);
+  jerry_value_t objects = jerry_create_object();
+  jerryxx_set_property_number(objects, MSTR_TOTAL, stats.objects);
+  jerryxx_set_property_number(objects, MSTR_FUNCTIONS, stats.functions);
+  jerryxx_set_property_number(objects, MSTR_ARRAYS, stats.arrays);
+  jerryxx_set_property_number(objects, MSTR_TYPED_ARRAYS, stats.typed_arrays);
+  jerryxx_set_property_number(objects, MSTR_ARRAY_BUFFERS, stats.array_buffers);
+  jerryxx_set_property_number(objects, MSTR_ARRAY_BUFFER_BYTES, stats.array_buffer_bytes);
+  jerryxx_set_property_number(objects, MSTR_PROMISES, stats.promises);
+  jerryxx_set_property(usage, MSTR_OBJECTS, objects);
+  jerry_release_value(objects);
+  jerry_value_t native = jerry_create_object();
+  jerryxx_set_property_number(native, MSTR_ARENA, stats.native_size);
+  jerryxx_set_property_number(native, MSTR_USED, stats.native_used);
+  jerryxx_set_property_number(native, MSTR_FREE, stats.native_free);
+  jerry_value_t tags = jerry_create_object();
+  for (int i = 0; i < KM_MEM_TAGS; i++) {
+    jerry_value_t tag = jerry_create_object();
+    jerryxx_set_property_number(tag, MSTR_CURRENT, stats.tags[i].current);
+    jerryxx_set_property_number(tag, MSTR_PEAK, stats.tags[i].peak);
+    jerryxx_set_property_number(tag, MSTR_BLOCKS, stats.tags[i].blocks);
+    jerryxx_set_property_number(tag, MSTR_ALLOCS, stats.tags[i].allocs);
+    jerryxx_set_property(tags, km_mem_tag_name(i), tag);
+    jerry_release_value(tag);
+  }
+  jerryxx_set_property(native, MSTR_TAGS, tags);
+  jerry_release_value(tags);
+#ifdef KALUMA_TLSF
+  /* fragmentation is the percentage of the free bytes not in the largest
+     free block */
+  jerry_value_t tlsf = jerry_create_object();
+  jerryxx_set_property_number(tlsf, MSTR_SIZE, stats.tlsf_size);
+  jerryxx_set_property_number(tlsf, MSTR_USED, stats.tlsf_used);
+  jerryxx_set_property_number(tlsf, MSTR_FREE, stats.tlsf_free);
+  jerryxx_set_property_number(tlsf, MSTR_FREE_BLOCKS, stats.tlsf_free_blocks);
+  jerryxx_set_property_number(tlsf, MSTR_LARGEST_FREE, stats.tlsf_largest_free);
+  jerryxx_set_property_number(tlsf, MSTR_FRAGMENTATION, stats.tlsf_free > 0 ?
+    100 - (uint64_t) stats.tlsf_largest_free * 100 / stats.tlsf_free : 0);
+  jerryxx_set_property_number(tlsf, MSTR_FALLBACKS, stats.tlsf_fallbacks);
+  jerryxx_set_property(native, MSTR_TLSF, tlsf);
+  jerry_release_value(tlsf);
+#endif
+  jerryxx_set_property(usage, MSTR_NATIVE, native);
+  jerry_release_value(native);
+  return usage;
+}
+
+/**
+ * process.setMemoryPressure({ gc, moderate, critical }) function. Set the
+ * thresholds in percent of the heap (0 to disable) for the idle GC and the
+ * 'memoryPressure' event levels.
+ */
+JERRYXX_FUN(process_set_memory_pressure_fn) {
+  JERRYXX_CHECK_ARG_OBJECT(0, "options")
+  jerry_value_t options = JERRYXX_GET_ARG(0);
+  km_runtime_memory_pressure_t *current = km_runtime_get_memory_pressure();
+  double gc = jerryxx_get_property_number(options, MSTR_GC, current->gc);
+  double moderate = jerryxx_get_property_number(options, MSTR_MODERATE, current->moderate);
+  double critical = jerryxx_get_property_number(options, MSTR_CRITICAL, current->critical);
+  if (gc < 0 || gc > 100 || moderate < 0 || moderate > 100 || critical < 0 || critical > 100) {
+    return jerry_create_error(JERRY_ERROR_RANGE, (const jerry_char_t *) "Thresholds must be 0 to 100.");
+  }
+  km_runtime_memory_pressure_t pressure = { (uint8_t) gc, (uint8_t) moderate, (uint8_t) critical };
+  km_runtime_set_memory_pressure(&pressure);
+  return jerry_create_undefined();
+}
+
 static void register_global_process_object() {
   jerry_value_t process = jerry_create_object();
   jerryxx_set_property_string(process, MSTR_ARCH, (char *)km_system_arch);
@@ -644,6 +1103,36 @@ static void register_global_process_object() {
   /* Add `process.getBuiltinModule` function */
   jerryxx_set_property_function(process, MSTR_GET_BUILTIN_MODULE, process_get_builtin_module_fn);
 
+  /* Add `process.nextTick` function */
+  jerryxx_set_property_function(process, MSTR_NEXT_TICK, process_next_tick_fn);
+
+  /* Add `process.loopStats` function */
+  jerryxx_set_property_function(process, MSTR_LOOP_STATS, process_loop_stats_fn);
+
+  /* Add `process.setLoopBudget` function */
+  jerryxx_set_property_function(process, MSTR_SET_LOOP_BUDGET, process_set_loop_budget_fn);
+
+  /* Add `process.ref`, `process.unref` and `process.hasRef` functions */
+  jerryxx_set_property_function(process, MSTR_REF, process_ref_fn);
+  jerryxx_set_property_function(process, MSTR_UNREF, process_unref_fn);
+  jerryxx_set_property_function(process, MSTR_HAS_REF, process_has_ref_fn);
+
+  /* Add `process.bootTrace` function */
+  jerryxx_set_property_function(process, MSTR_BOOT_TRACE, process_boot_trace_fn);
+
+  /* Add `process.memoryUsage` function */
+  jerryxx_set_property_function(process, MSTR_MEMORY_USAGE, process_memory_usage_fn);
+
+  /* Add `process.setMemoryPressure` function */
+  jerryxx_set_property_function(process, MSTR_SET_MEMORY_PRESSURE, process_set_memory_pressure_fn);
+
+  /* Add `process.profile` object */
+  jerry_value_t profile = jerry_create_object();
+  jerryxx_set_property_function(profile, MSTR_START, process_profile_start_fn);
+  jerryxx_set_property_function(profile, MSTR_STOP, process_profile_stop_fn);
+  jerryxx_set_property(process, MSTR_PROFILE, profile);
+  jerry_release_value(profile);
+
   /* Register 'process' object to global */
   jerry_value_t global = jerry_get_global_object();
   jerryxx_set_property(global, MSTR_PROCESS, process);
@@ -806,9 +1295,118 @@ static void base64_buffer_free_cb(void *native_p) {
   free(native_p);
 }
 
+static jerry_value_t base64_encoded_value(unsigned char *encoded_data, size_t encoded_data_sz) {
+  if (encoded_data != NULL && encoded_data_sz > 0) {
+    jerry_value_t result = jerry_create_string_sz(encoded_data, encoded_data_sz - 1);
+    free(encoded_data);
+    return result;
+  } else {
+    return jerry_create_undefined();
+  }
+}
+
+static jerry_value_t base64_decoded_value(unsigned char *decoded_data, size_t decoded_data_sz) {
+  if (decoded_data != NULL) {
+    jerry_value_t buffer = jerry_create_arraybuffer_external(decoded_data_sz, decoded_data, base64_buffer_free_cb);
+    jerry_value_t array = jerry_create_typedarray_for_arraybuffer(
+      JERRY_TYPEDARRAY_UINT8, buffer);
+    jerry_release_value(buffer);
+    return array;
+  } else {
+    return jerry_create_undefined();
+  }
+}
+
+/**
+ * Data of the base64 work. The input is copied, so the work does not touch
+ * the JS values while it runs on a worker.
+ */
+typedef struct {
+  bool decode;
+  unsigned char *output;
+  size_t output_sz;
+  size_t input_sz;
+  unsigned char input[];
+} base64_work_t;
+
+static void base64_work_close_cb(km_io_handle_t *handle) {
+  km_io_work_handle_t *work = (km_io_work_handle_t *) handle;
+  km_free(work->data);
+  km_io_handle_free(handle);
+}
+
+static void base64_work_cb(km_io_work_handle_t *work) {
+  base64_work_t *data = (base64_work_t *) work->data;
+  if (data->decode) {
+    data->output = km_base64_decode(data->input, data->input_sz, &data->output_sz);
+  } else {
+    data->output = km_base64_encode(data->input, data->input_sz, &data->output_sz);
+  }
+}
+
+/**
+ * Free the output of a work which was cleaned up before its callback.
+ */
+static void base64_work_cleanup_cb(km_io_work_handle_t *work) {
+  base64_work_t *data = (base64_work_t *) work->data;
+  free(data->output);
+}
+
+static void base64_after_work_cb(km_io_work_handle_t *work) {
+  base64_work_t *data = (base64_work_t *) work->data;
+  jerry_value_t callback = work->work_js_cb;
+  jerry_value_t result = data->decode ?
+    base64_decoded_value(data->output, data->output_sz) :
+    base64_encoded_value(data->output, data->output_sz);
+  km_io_handle_close((km_io_handle_t *) work, base64_work_close_cb);
+  jerry_value_t this_val = jerry_create_undefined();
+  jerry_value_t args_p[2] = { jerry_create_null(), result };
+  jerry_value_t ret_val = jerry_call_function(callback, this_val, args_p, 2);
+  if (jerry_value_is_error(ret_val)) {
+    jerryxx_print_error(ret_val, true);
+  }
+  jerry_release_value(ret_val);
+  jerry_release_value(args_p[0]);
+  jerry_release_value(args_p[1]);
+  jerry_release_value(this_val);
+  jerry_release_value(callback);
+}
+
+/**
+ * Run the base64 encoding or decoding on a worker and call the callback
+ * with (null, result) when done.
+ */
+static jerry_value_t base64_queue_work(const uint8_t *buf, size_t len, bool decode, jerry_value_t callback) {
+  base64_work_t *data = (base64_work_t *) km_malloc(KM_MEM_CORE, sizeof(base64_work_t) + len);
+  if (data == NULL) {
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
+  km_io_work_handle_t *work = (km_io_work_handle_t *) km_io_handle_alloc(KM_IO_WORK);
+  if (work == NULL) {
+    km_free(data);
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
+  data->decode = decode;
+  data->output = NULL;
+  data->output_sz = 0;
+  data->input_sz = len;
+  memcpy(data->input, buf, len);
+  km_io_work_init(work);
+  work->work_js_cb = jerry_acquire_value(callback);
+  work->data = data;
+  work->cleanup_cb = base64_work_cleanup_cb;
+  km_io_work_queue(work, base64_work_cb, base64_after_work_cb);
+  return jerry_create_undefined();
+}
+
+/**
+ * btoa(data[, callback]). With a callback, the encoding runs on a worker.
+ */
 JERRYXX_FUN(btoa_fn) {
   JERRYXX_CHECK_ARG(0, "data")
+  JERRYXX_CHECK_ARG_FUNCTION_OPT(1, "callback")
   jerry_value_t binary_data = JERRYXX_GET_ARG(0);
+  bool async = JERRYXX_HAS_ARG(1);
   size_t encoded_data_sz;
   unsigned char *encoded_data = NULL;
   if (jerry_value_is_typedarray(binary_data) &&
@@ -818,40 +1416,43 @@ JERRYXX_FUN(btoa_fn) {
     jerry_value_t array_buffer = jerry_get_typedarray_buffer(binary_data, &byteOffset, &byteLength);
     size_t len = jerry_get_arraybuffer_byte_length(array_buffer);
     uint8_t *buf = jerry_get_arraybuffer_pointer(array_buffer);
+    if (async) {
+      jerry_value_t ret = base64_queue_work(buf, len, false, JERRYXX_GET_ARG(1));
+      jerry_release_value(array_buffer);
+      return ret;
+    }
     encoded_data = km_base64_encode(buf, len, &encoded_data_sz);
     jerry_release_value(array_buffer);
   } else if (jerry_value_is_string(binary_data)) { /* for string */
     jerry_size_t len = jerryxx_get_ascii_string_size(binary_data);
     uint8_t buf[len];
     jerryxx_string_to_ascii_char_buffer(binary_data, buf, len);
+    if (async) {
+      return base64_queue_work(buf, len, false, JERRYXX_GET_ARG(1));
+    }
     encoded_data = km_base64_encode(buf, len, &encoded_data_sz);
   } else {
     return jerry_create_error(JERRY_ERROR_TYPE, (const jerry_char_t *) "Unsupported binary data.");
   }
-  if (encoded_data != NULL && encoded_data_sz > 0) {
-    jerry_value_t result = jerry_create_string_sz(encoded_data, encoded_data_sz - 1);
-    free(encoded_data);
-    return result;
-  } else {
-    return jerry_create_undefined();
-  }
+  return base64_encoded_value(encoded_data, encoded_data_sz);
 }
 
+/**
+ * atob(encodedData[, callback]). With a callback, the decoding runs on a
+ * worker.
+ */
 JERRYXX_FUN(atob_fn) {
   JERRYXX_CHECK_ARG_STRING(0, "encodedData")
+  JERRYXX_CHECK_ARG_FUNCTION_OPT(1, "callback")
   JERRYXX_GET_ARG_STRING_AS_CHAR(0, encoded_data)
+  if (JERRYXX_HAS_ARG(1)) {
+    return base64_queue_work((const uint8_t *) encoded_data, encoded_data_sz,
+      true, JERRYXX_GET_ARG(1));
+  }
   size_t decoded_data_sz;
   unsigned char *decoded_data = km_base64_decode((unsigned char *) encoded_data,
       encoded_data_sz, &decoded_data_sz);
-  if (decoded_data != NULL) {
-    jerry_value_t buffer = jerry_create_arraybuffer_external(decoded_data_sz, decoded_data, base64_buffer_free_cb);
-    jerry_value_t array = jerry_create_typedarray_for_arraybuffer(
-      JERRY_TYPEDARRAY_UINT8, buffer);
-    jerry_release_value(buffer);
-    return array;
-  } else {
-    return jerry_create_undefined();
-  }
+  return base64_decoded_value(decoded_data, decoded_data_sz);
 }
 
 static bool is_uri_char (char ch) {
@@ -916,14 +1517,6 @@ JERRYXX_FUN(decode_uri_component_fn) {
   return jerry_create_string(decoded);
 }
 
-static void register_global_encoders() {
-  jerry_value_t global = jerry_get_global_object();
-  jerryxx_set_property_function(global, MSTR_BTOA, btoa_fn);
-  jerryxx_set_property_function(global, MSTR_ATOB, atob_fn);
-  jerryxx_set_property_function(global, MSTR_ENCODE_URI_COMPONENT, encode_uri_component_fn);
-  jerryxx_set_property_function(global, MSTR_DECODE_URI_COMPONENT, decode_uri_component_fn);
-  jerry_release_value(global);
-}
 
 /****************************************************************************/
 /*                                                                          */
@@ -947,9 +1540,92 @@ JERRYXX_FUN(print_fn) {
   return jerry_create_undefined();
 }
 
-static void register_global_etc() {
+
+/****************************************************************************/
+/*                                                                          */
+/*                             GLOBAL PROPERTIES                            */
+/*                                                                          */
+/****************************************************************************/
+
+typedef struct {
+  const char *name;
+  jerry_external_handler_t fn;
+} global_function_t;
+
+typedef struct {
+  const char *name;
+  double value;
+} global_number_t;
+
+static const global_number_t global_numbers[] = {
+  /* digital I/O */
+  { MSTR_HIGH, KM_GPIO_HIGH },
+  { MSTR_LOW, KM_GPIO_LOW },
+  { MSTR_INPUT, KM_GPIO_IO_MODE_INPUT },
+  { MSTR_OUTPUT, KM_GPIO_IO_MODE_OUTPUT },
+  { MSTR_INPUT_PULLUP, KM_GPIO_IO_MODE_INPUT_PULLUP },
+  { MSTR_INPUT_PULLDOWN, KM_GPIO_IO_MODE_INPUT_PULLDOWN },
+  { MSTR_CHANGE, KM_IO_WATCH_MODE_CHANGE },
+  { MSTR_RISING, KM_IO_WATCH_MODE_RISING },
+  { MSTR_FALLING, KM_IO_WATCH_MODE_FALLING },
+  { MSTR_PULLNO, KM_IO_PULL_NO },
+  { MSTR_PULLUP, KM_IO_PULL_UP },
+  { MSTR_PULLDOWN, KM_IO_PULL_DOWN },
+  /* timers */
+  { MSTR_PRIORITY_REALTIME, KM_IO_PRIORITY_REALTIME },
+  { MSTR_PRIORITY_NORMAL, KM_IO_PRIORITY_NORMAL },
+  { MSTR_PRIORITY_BACKGROUND, KM_IO_PRIORITY_BACKGROUND },
+  { MSTR_PERIODIC_SKIP, KM_IO_PERIODIC_SKIP },
+  { MSTR_PERIODIC_CATCHUP, KM_IO_PERIODIC_CATCHUP },
+};
+
+static const global_function_t global_functions[] = {
+  /* digital I/O */
+  { MSTR_PIN_MODE, pin_mode_fn },
+  { MSTR_DIGITAL_READ, digital_read_fn },
+  { MSTR_DIGITAL_WRITE, digital_write_fn },
+  { MSTR_DIGITAL_TOGGLE, digital_toggle_fn },
+  { MSTR_PULSE_READ, pulse_read_fn },
+  { MSTR_PULSE_WRITE, pulse_write_fn },
+  { MSTR_SET_WATCH, set_watch_fn },
+  { MSTR_CLEAR_WATCH, clear_watch_fn },
+  /* analog I/O */
+  { MSTR_ANALOG_READ, analog_read_fn },
+  { MSTR_ANALOG_WRITE, analog_write_fn },
+  { MSTR_TONE, tone_fn },
+  { MSTR_NO_TONE, no_tone_fn },
+  /* timers */
+  { MSTR_SET_TIMEOUT, set_timeout_fn },
+  { MSTR_SET_INTERVAL, set_interval_fn },
+  { MSTR_CLEAR_TIMEOUT, clear_timer_fn },
+  { MSTR_CLEAR_INTERVAL, clear_timer_fn },
+  { MSTR_SET_PERIODIC, set_periodic_fn },
+  { MSTR_CLEAR_PERIODIC, clear_periodic_fn },
+  { MSTR_GET_PERIODIC_STATS, get_periodic_stats_fn },
+  { MSTR_SET_IMMEDIATE, set_immediate_fn },
+  { MSTR_CLEAR_IMMEDIATE, clear_immediate_fn },
+  { MSTR_DELAY, delay_fn },
+  { MSTR_MILLIS, millis_fn },
+  /* encoders */
+  { MSTR_BTOA, btoa_fn },
+  { MSTR_ATOB, atob_fn },
+  { MSTR_ENCODE_URI_COMPONENT, encode_uri_component_fn },
+  { MSTR_DECODE_URI_COMPONENT, decode_uri_component_fn },
+  /* etc */
+  { MSTR_PRINT, print_fn },
+};
+
+/**
+ * Register the global numbers and functions in the tables
+ */
+static void register_global_tables() {
   jerry_value_t global = jerry_get_global_object();
-  jerryxx_set_property_function(global, MSTR_PRINT, print_fn);
+  for (int i = 0; i < sizeof(global_numbers) / sizeof(global_number_t); i++) {
+    jerryxx_set_property_number(global, global_numbers[i].name, global_numbers[i].value);
+  }
+  for (int i = 0; i < sizeof(global_functions) / sizeof(global_function_t); i++) {
+    jerryxx_set_property_function(global, global_functions[i].name, global_functions[i].fn);
+  }
   jerry_release_value(global);
 }
 
@@ -969,25 +1645,109 @@ static void run_startup_module() {
 }
 
 static void run_board_module() {
+  uint64_t begin = km_micro_gettime();
   jerry_value_t res = jerry_exec_snapshot((const uint32_t *)module_board_code, module_board_size, 0, JERRY_SNAPSHOT_EXEC_ALLOW_STATIC);
   jerry_value_t this_val = jerry_create_undefined ();
   jerry_value_t ret_val = jerry_call_function (res, this_val, NULL, 0);
   jerry_release_value (ret_val);
   jerry_release_value (this_val);
   jerry_release_value (res);
+  km_boot_trace_span("board", NULL, begin);
+}
+
+/**
+ * Define `global.board` as a data property replacing the lazy accessor
+ */
+static void define_board(jerry_value_t global, jerry_value_t value) {
+  jerry_property_descriptor_t desc;
+  jerry_init_property_descriptor_fields(&desc);
+  desc.is_value_defined = true;
+  desc.value = jerry_acquire_value(value);
+  desc.is_writable_defined = true;
+  desc.is_writable = true;
+  desc.is_enumerable_defined = true;
+  desc.is_enumerable = true;
+  desc.is_configurable_defined = true;
+  desc.is_configurable = true;
+  jerry_value_t prop_name = jerry_create_string((const jerry_char_t *) MSTR_BOARD);
+  jerry_value_t ret = jerry_define_own_property(global, prop_name, &desc);
+  jerry_release_value(ret);
+  jerry_release_value(prop_name);
+  jerry_free_property_descriptor_fields(&desc);
+}
+
+/**
+ * The getter of the lazy `global.board`. The accessor is replaced first,
+ * then the board module runs and assigns the board object.
+ */
+JERRYXX_FUN(board_getter_fn) {
+  jerry_value_t global = jerry_get_global_object();
+  jerry_value_t undefined = jerry_create_undefined();
+  define_board(global, undefined);
+  run_board_module();
+  jerry_value_t board = jerryxx_get_property(global, MSTR_BOARD);
+  jerry_release_value(global);
+  return board;
+}
+
+/**
+ * The setter of the lazy `global.board`
+ */
+JERRYXX_FUN(board_setter_fn) {
+  JERRYXX_CHECK_ARG(0, "value")
+  jerry_value_t global = jerry_get_global_object();
+  define_board(global, JERRYXX_GET_ARG(0));
+  jerry_release_value(global);
+  return jerry_create_undefined();
+}
+
+/**
+ * Define `global.board` which runs the board module when it's accessed
+ */
+static void register_lazy_board() {
+  jerry_property_descriptor_t desc;
+  jerry_init_property_descriptor_fields(&desc);
+  desc.is_get_defined = true;
+  desc.getter = jerry_create_external_function(board_getter_fn);
+  desc.is_set_defined = true;
+  desc.setter = jerry_create_external_function(board_setter_fn);
+  desc.is_enumerable_defined = true;
+  desc.is_enumerable = true;
+  desc.is_configurable_defined = true;
+  desc.is_configurable = true;
+  jerry_value_t global = jerry_get_global_object();
+  jerry_value_t prop_name = jerry_create_string((const jerry_char_t *) MSTR_BOARD);
+  jerry_value_t ret = jerry_define_own_property(global, prop_name, &desc);
+  jerry_release_value(ret);
+  jerry_release_value(prop_name);
+  jerry_release_value(global);
+  jerry_free_property_descriptor_fields(&desc);
+}
+
+/**
+ * Release the values held by the globals (called before jerry_cleanup)
+ */
+void km_global_cleanup() {
+  if (native_module_cache != NULL) {
+    for (int i = 0; i < builtin_modules_length; i++) {
+      if (native_module_cache[i] != 0) {
+        jerry_release_value(native_module_cache[i]);
+      }
+    }
+    free(native_module_cache);
+    native_module_cache = NULL;
+  }
 }
 
 void km_global_init() {
   register_global_objects();
-  register_global_digital_io();
-  register_global_analog_io();
-  register_global_timers();
+  register_global_tables();
   register_global_console_object();
   register_global_process_object();
   register_global_textencoder();
   register_global_textdecoder();
-  register_global_encoders();
-  register_global_etc();
-  run_board_module();
+  register_lazy_board();
+  km_boot_trace("globals");
   run_startup_module();
+  km_boot_trace("startup");
 }
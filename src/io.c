@@ -22,12 +22,15 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "system.h"
 #include "io.h"
 #include "tty.h"
 #include "gpio.h"
 #include "uart.h"
+#include "worker.h"
+#include "memstats.h"
 #ifdef KALUMA_MODULE_IEEE80211
 #include "ieee80211.h"
 #endif//KALUMA_MODULE_IEEE80211
@@ -37,9 +40,14 @@
 
 km_io_loop_t loop;
 
+#define KM_IO_BEFORE_CALLBACK(phase) io_before_callback(phase)
+
 /* forward declarations */
 
+static void io_before_callback(km_io_phase_t phase);
+
 static void km_io_timer_run();
+static void km_io_periodic_run();
 static void km_io_tty_run();
 static void km_io_watch_run();
 static void km_io_uart_run();
@@ -50,33 +58,333 @@ static void km_io_ieee80211_run();
 #ifdef KALUMA_MODULE_TCP
 static void km_io_tcp_run();
 #endif//KALUMA_MODULE_TCP
+#ifdef KALUMA_IO_POLL
+static void km_io_poll_run();
+#endif//KALUMA_IO_POLL
+static void km_io_work_run();
+
+static void km_io_immediate_run();
+static void km_io_immediate_run_ticks(km_io_phase_t phase);
+static void km_io_timer_run_heap(km_heap_t *heap, uint64_t now);
+static void km_io_periodic_run_heap(km_heap_t *heap, uint64_t now);
+static void km_io_watch_run_realtime();
+static void km_io_uart_run_realtime();
+static uint32_t km_io_watch_polled();
+static uint64_t km_io_watch_next_timeout();
+
+/* handle table: open addressing hash of handles by id */
+
+#define KM_IO_HANDLE_TABLE_MIN_SIZE 16
+
+static uint32_t km_io_handle_hash(uint32_t id) {
+  return (id * 2654435761U) & (loop.handles_size - 1);
+}
 
-static void km_io_idle_run();
+static void km_io_handle_table_put(km_io_handle_t *handle) {
+  uint32_t i = km_io_handle_hash(handle->id);
+  while (loop.handles[i] != NULL) {
+    i = (i + 1) & (loop.handles_size - 1);
+  }
+  loop.handles[i] = handle;
+  loop.handles_count++;
+}
+
+/**
+ * Make room for one more handle, growing the table to keep the load factor
+ * under 3/4. Returns false if the table is full and cannot grow.
+ */
+static bool km_io_handle_table_reserve() {
+  if ((loop.handles_count + 1) * 4 > loop.handles_size * 3) {
+    uint32_t size = loop.handles_size > 0 ? loop.handles_size * 2 : KM_IO_HANDLE_TABLE_MIN_SIZE;
+    km_io_handle_t **table = calloc(size, sizeof(km_io_handle_t *));
+    if (table != NULL) {
+      km_io_handle_t **old_table = loop.handles;
+      uint32_t old_size = loop.handles_size;
+      loop.handles = table;
+      loop.handles_size = size;
+      loop.handles_count = 0;
+      for (uint32_t i = 0; i < old_size; i++) {
+        if (old_table[i] != NULL) {
+          km_io_handle_table_put(old_table[i]);
+        }
+      }
+      free(old_table);
+    }
+  }
+  /* keep a free slot, since a lookup probes until an empty one */
+  return loop.handles_count + 1 < loop.handles_size;
+}
+
+static bool km_io_handle_table_add(km_io_handle_t *handle) {
+  if (!km_io_handle_table_reserve()) {
+    return false;
+  }
+  km_io_handle_table_put(handle);
+  return true;
+}
+
+static void km_io_handle_table_remove(km_io_handle_t *handle) {
+  if (loop.handles_size == 0) {
+    return;
+  }
+  uint32_t mask = loop.handles_size - 1;
+  uint32_t i = km_io_handle_hash(handle->id);
+  while (loop.handles[i] != handle) {
+    if (loop.handles[i] == NULL) {
+      return; /* not in the table */
+    }
+    i = (i + 1) & mask;
+  }
+  loop.handles[i] = NULL;
+  loop.handles_count--;
+  /* shift back the following entries of the probe sequence */
+  uint32_t j = i;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (loop.handles[j] == NULL) {
+      break;
+    }
+    uint32_t k = km_io_handle_hash(loop.handles[j]->id);
+    bool in_place = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+    if (!in_place) {
+      loop.handles[i] = loop.handles[j];
+      loop.handles[j] = NULL;
+      i = j;
+    }
+  }
+}
+
+/* readiness queue: filled by interrupt handlers, drained by the loop */
+
+#define KM_IO_READY_QUEUE_SIZE 32 /* power of two */
+#define KM_IO_READY_SOURCES 32
+
+static volatile uint16_t ready_queue[KM_IO_READY_QUEUE_SIZE];
+static volatile uint32_t ready_head = 0; /* written by the producers only */
+static volatile uint32_t ready_tail = 0; /* written by the loop only */
+static volatile bool ready_overflow = false;
+static volatile uint8_t ready_queued[KM_SYSTEM_EVENT_COUNT][KM_IO_READY_SOURCES];
+
+/* ready sources of each event (used in the loop only) */
+static uint32_t ready_sources[KM_SYSTEM_EVENT_COUNT];
+
+/* work slots done, taken from the port by km_worker_take_done() (used in
+   the loop only) */
+static uint32_t work_done = 0;
+
+void km_system_notify(km_system_event_t event, uint8_t source) {
+  if (event >= KM_SYSTEM_EVENT_COUNT || source >= KM_IO_READY_SOURCES) {
+    return;
+  }
+  if (ready_queued[event][source]) {
+    return; /* not yet drained */
+  }
+  ready_queued[event][source] = 1;
+  uint32_t head = ready_head;
+  if (head - ready_tail >= KM_IO_READY_QUEUE_SIZE) {
+    ready_overflow = true;
+    return;
+  }
+  ready_queue[head & (KM_IO_READY_QUEUE_SIZE - 1)] = (uint16_t) ((event << 8) | source);
+  __sync_synchronize(); /* publish the entry before the head */
+  ready_head = head + 1;
+}
+
+/**
+ * Move the queued entries to the ready sources. The queued flag of an entry
+ * is cleared before the source is processed, so a notification arriving
+ * meanwhile is queued again rather than lost.
+ */
+static void io_drain_ready() {
+  if (ready_overflow) {
+    ready_overflow = false;
+    for (int i = 0; i < KM_SYSTEM_EVENT_COUNT; i++) {
+      for (int j = 0; j < KM_IO_READY_SOURCES; j++) {
+        ready_queued[i][j] = 0;
+      }
+      ready_sources[i] = 0xFFFFFFFF; /* visit all sources */
+    }
+  }
+  while (ready_tail != ready_head) {
+    __sync_synchronize(); /* read the entry after the head */
+    uint16_t entry = ready_queue[ready_tail & (KM_IO_READY_QUEUE_SIZE - 1)];
+    ready_tail = ready_tail + 1;
+    uint8_t event = entry >> 8;
+    uint8_t source = entry & 0xFF;
+    ready_queued[event][source] = 0;
+    ready_sources[event] |= (1u << source);
+  }
+  /* works are completed by the worker threads, not by the queue */
+  work_done |= km_worker_take_done();
+}
+
+/**
+ * Return the ready sources of the event and clear them
+ */
+static uint32_t io_take_ready(km_system_event_t event) {
+  uint32_t sources = ready_sources[event];
+  ready_sources[event] = 0;
+  return sources;
+}
+
+static bool io_has_ready() {
+  if (ready_head != ready_tail || ready_overflow || work_done != 0) {
+    return true;
+  }
+  for (int i = 0; i < KM_SYSTEM_EVENT_COUNT; i++) {
+    if (ready_sources[i] != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* work slots in use, and the number of workers of the port */
+static uint32_t work_slots = 0;
+static int work_workers = 0;
+
+/* handle pools */
+
+#define KM_IO_HANDLE_POOL_SLAB_OBJS 8
+
+static km_pool_t timer_pool;
+static km_pool_t periodic_pool;
+static km_pool_t watch_pool;
+static km_pool_t uart_pool;
+#ifdef KALUMA_IO_POLL
+static km_pool_t poll_pool;
+#endif//KALUMA_IO_POLL
+static km_pool_t work_pool;
+static km_pool_t immediate_pool;
+static km_pool_t idle_pool;
+
+/**
+ * Return the pool of the handle type, or NULL if the handles of the type
+ * are not pooled.
+ */
+km_pool_t *km_io_handle_pool(km_io_type_t type) {
+  switch (type) {
+    case KM_IO_TIMER:
+      return &timer_pool;
+    case KM_IO_PERIODIC:
+      return &periodic_pool;
+    case KM_IO_WATCH:
+      return &watch_pool;
+    case KM_IO_UART:
+      return &uart_pool;
+#ifdef KALUMA_IO_POLL
+    case KM_IO_POLL:
+      return &poll_pool;
+#endif//KALUMA_IO_POLL
+    case KM_IO_WORK:
+      return &work_pool;
+    case KM_IO_IMMEDIATE:
+      return &immediate_pool;
+    case KM_IO_IDLE:
+      return &idle_pool;
+    default:
+      return NULL;
+  }
+}
+
+/**
+ * Allocate a handle of the pooled type. Returns NULL if out of memory,
+ * including when the handle table has no room to index the handle by id.
+ */
+km_io_handle_t *km_io_handle_alloc(km_io_type_t type) {
+  km_pool_t *pool = km_io_handle_pool(type);
+  if (pool == NULL) {
+    return NULL;
+  }
+  km_io_handle_t *handle = (km_io_handle_t *) km_pool_alloc(pool);
+  if (handle != NULL && !km_io_handle_table_reserve()) {
+    km_pool_free(pool, handle);
+    return NULL;
+  }
+  return handle;
+}
+
+/**
+ * Free a handle. Pooled handles go back to the free list of the type and
+ * the others (allocated by km_malloc) are freed to the heap.
+ */
+void km_io_handle_free(km_io_handle_t *handle) {
+  km_pool_t *pool = km_io_handle_pool(handle->type);
+  if (pool != NULL) {
+    km_pool_free(pool, handle);
+  } else {
+    km_free(handle);
+  }
+}
 
 /* general handle functions */
 
 uint32_t handle_id_count = 0;
 
-void km_io_handle_init(km_io_handle_t *handle, km_io_type_t type) {
+/**
+ * Initialize a handle and index it by id. The room in the table is
+ * reserved by km_io_handle_alloc() for the pooled handles, so it fails
+ * only for the others when the table cannot grow.
+ */
+bool km_io_handle_init(km_io_handle_t *handle, km_io_type_t type) {
   handle->id = handle_id_count++;
   handle->type = type;
   handle->flags = 0;
+  handle->priority = KM_IO_PRIORITY_NORMAL;
   handle->close_cb = NULL;
+  return km_io_handle_table_add(handle);
+}
+
+/**
+ * Referenced handles keep io_run_alive() running while they are active.
+ * Handles are referenced by default.
+ */
+void km_io_handle_ref(km_io_handle_t *handle) {
+  KM_IO_SET_FLAG_OFF(handle->flags, KM_IO_FLAG_UNREF);
+}
+
+void km_io_handle_unref(km_io_handle_t *handle) {
+  KM_IO_SET_FLAG_ON(handle->flags, KM_IO_FLAG_UNREF);
+}
+
+bool km_io_handle_has_ref(km_io_handle_t *handle) {
+  return !KM_IO_HAS_FLAG(handle->flags, KM_IO_FLAG_UNREF);
 }
 
 void km_io_handle_close(km_io_handle_t *handle, km_io_close_cb close_cb) {
   KM_IO_SET_FLAG_ON(handle->flags, KM_IO_FLAG_CLOSING);
   handle->close_cb = close_cb;
+  km_io_handle_table_remove(handle);
   km_list_append(&loop.closing_handles, (km_list_node_t *) handle);
 }
 
-km_io_handle_t *km_io_handle_get_by_id(uint32_t id, km_list_t *handle_list) {
-  km_io_handle_t *handle = (km_io_handle_t *) handle_list->head;
-  while (handle != NULL) {
-    if (handle->id == id) {
-      return handle;
+/**
+ * Find a handle of any type by id (active or not). Returns NULL for the
+ * ids of closed handles.
+ */
+km_io_handle_t *km_io_handle_find(uint32_t id) {
+  if (loop.handles_size == 0) {
+    return NULL;
+  }
+  uint32_t i = km_io_handle_hash(id);
+  while (loop.handles[i] != NULL) {
+    if (loop.handles[i]->id == id) {
+      return loop.handles[i];
     }
-    handle = (km_io_handle_t *) ((km_list_node_t *) handle)->next;
+    i = (i + 1) & (loop.handles_size - 1);
+  }
+  return NULL;
+}
+
+/**
+ * Find an active handle of the type by id. Returns NULL for stale ids
+ * (e.g. the handle is stopped, closed or the id belongs to another type).
+ */
+km_io_handle_t *km_io_handle_get_by_id(uint32_t id, km_io_type_t type) {
+  km_io_handle_t *handle = km_io_handle_find(id);
+  if (handle != NULL && handle->type == type &&
+      KM_IO_HAS_FLAG(handle->flags, KM_IO_FLAG_ACTIVE)) {
+    return handle;
   }
   return NULL;
 }
@@ -90,17 +398,235 @@ static void km_io_handle_closing() {
     km_io_handle_t *handle = (km_io_handle_t *) loop.closing_handles.head;
     km_list_remove(&loop.closing_handles, (km_list_node_t *) handle);
     if (handle->close_cb) {
+      KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_CLOSING);
       handle->close_cb(handle);
     }
   }
 }
 
+/* below this (in microseconds), io_wait() spins until the deadline of the
+   periodic handle, since waking up from a sleep takes about as long */
+#define KM_IO_PERIODIC_SPIN_MAX 50
+
+/**
+ * Block until the next timer is due or any I/O activity, unless there are
+ * handles which still need to be polled in every iteration.
+ */
+static void io_wait() {
+  if (loop.stop_flag || loop.closing_handles.head != NULL || io_has_ready()) {
+    return;
+  }
+  if (loop.immediate_handles.head != NULL || loop.tick_handles.head != NULL) {
+    return;
+  }
+  /* the loop runs the works by itself if the port has no workers */
+  if (work_workers == 0 && loop.work_handles.head != NULL) {
+    return;
+  }
+  /* GPIO watches without pin interrupt are polled */
+  if (km_io_watch_polled() > 0) {
+    return;
+  }
+#ifdef KALUMA_MODULE_IEEE80211
+  if (loop.ieee80211_handles.head != NULL) {
+    return;
+  }
+#endif//KALUMA_MODULE_IEEE80211
+#ifdef KALUMA_MODULE_TCP
+  if (loop.tcp_handles.head != NULL) {
+    return;
+  }
+#endif//KALUMA_MODULE_TCP
+  uint64_t deadline = km_io_timer_next_timeout();
+  if (deadline != KM_IO_TIMEOUT_NONE) {
+    deadline = deadline + 1; /* a timer fires after the clamped timeout passed */
+  }
+  uint64_t debounce_deadline = km_io_watch_next_timeout();
+  if (debounce_deadline < deadline) {
+    deadline = debounce_deadline;
+  }
+  uint64_t periodic_deadline = km_io_periodic_next_deadline();
+  if (periodic_deadline != KM_IO_TIMEOUT_NONE) {
+    /* sleep to the microsecond rather than oversleep to the millisecond */
+    uint64_t now = km_micro_gettime();
+    if (periodic_deadline <= now) {
+      return;
+    }
+    if (periodic_deadline - now < KM_IO_PERIODIC_SPIN_MAX) {
+      km_micro_delay((uint32_t) (periodic_deadline - now));
+      return;
+    }
+    if (km_gettime() + (periodic_deadline - now) / 1000 <= deadline) {
+      km_system_wait_until_us(periodic_deadline);
+      return;
+    }
+  }
+  km_system_wait_until(deadline);
+}
+
+/* loop statistics */
+
+static const char *phase_names[KM_IO_PHASE_COUNT] = {
+  "timer",
+  "periodic",
+  "tty",
+  "watch",
+  "uart",
+#ifdef KALUMA_MODULE_IEEE80211
+  "ieee80211",
+#endif//KALUMA_MODULE_IEEE80211
+#ifdef KALUMA_MODULE_TCP
+  "tcp",
+#endif//KALUMA_MODULE_TCP
+#ifdef KALUMA_IO_POLL
+  "poll",
+#endif//KALUMA_IO_POLL
+  "work",
+  "immediate",
+  "idle",
+  "closing"
+};
+
+const char *km_io_phase_name(km_io_phase_t phase) {
+  return phase_names[phase];
+}
+
+/**
+ * Return the number of I/O callbacks dispatched so far (except idle
+ * callbacks). It can be used to detect whether any JS code has run.
+ */
+uint32_t km_io_dispatched() {
+  return loop.dispatched;
+}
+
+km_io_loop_stats_t *km_io_stats() {
+  return &loop.stats;
+}
+
+void km_io_stats_reset() {
+  memset(&loop.stats, 0, sizeof(km_io_loop_stats_t));
+}
+
+/* realtime handles */
+
+static void io_realtime_ref(km_io_handle_t *handle) {
+  if (handle->priority == KM_IO_PRIORITY_REALTIME) {
+    loop.realtime_count++;
+  }
+}
+
+static void io_realtime_unref(km_io_handle_t *handle) {
+  if (handle->priority == KM_IO_PRIORITY_REALTIME) {
+    loop.realtime_count--;
+  }
+}
+
+/**
+ * Service the ready realtime handles. Their callbacks are accounted to the
+ * phase of the handle type and are not limited by the loop budget.
+ */
+static void io_run_realtime() {
+  loop.in_realtime = true;
+  io_drain_ready();
+  km_io_timer_run_heap(&loop.realtime_timer_heap, km_gettime());
+  km_io_periodic_run_heap(&loop.realtime_periodic_heap, km_micro_gettime());
+  km_io_watch_run_realtime();
+  km_io_uart_run_realtime();
+  loop.in_realtime = false;
+}
+
+/**
+ * Called right before a callback is invoked: services the realtime handles
+ * and runs the ticks queued by the preceding callback first, then accounts
+ * the callback to the phase.
+ */
+static void io_before_callback(km_io_phase_t phase) {
+  loop.stats.phases[phase].callbacks++;
+  loop.dispatched += (phase != KM_IO_PHASE_IDLE);
+  if (loop.in_realtime) {
+    return;
+  }
+  if (loop.realtime_count > 0) {
+    io_run_realtime();
+  }
+  if (loop.tick_handles.head != NULL) {
+    km_io_immediate_run_ticks(phase);
+  }
+  if (phase != KM_IO_PHASE_IDLE) {
+    loop.iteration_callbacks++;
+    loop.phase_callbacks++;
+  }
+}
+
+km_io_budget_t *km_io_budget() {
+  return &loop.budget;
+}
+
+/**
+ * Check whether the current phase has to stop dispatching and roll the
+ * remaining work over to the next iteration. A phase always dispatches at
+ * least one callback, so every phase makes progress.
+ */
+static bool io_budget_exhausted() {
+  if (loop.phase_callbacks == 0) {
+    return false;
+  }
+  km_io_budget_t *budget = &loop.budget;
+  if ((budget->max_callbacks > 0 && loop.iteration_callbacks >= budget->max_callbacks) ||
+      (budget->max_phase_callbacks > 0 && loop.phase_callbacks >= budget->max_phase_callbacks) ||
+      (budget->max_micros > 0 && km_micro_gettime() - loop.iteration_start >= budget->max_micros)) {
+    loop.stats.yields++;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Run a phase and account the elapsed time to it
+ */
+static void io_run_phase(km_io_phase_t phase, void (*run)()) {
+  uint64_t start = km_micro_gettime();
+  loop.phase_callbacks = 0;
+  run();
+  if (loop.tick_handles.head != NULL) {
+    km_io_immediate_run_ticks(phase);
+  }
+  uint32_t elapsed = (uint32_t) (km_micro_gettime() - start);
+  km_io_phase_stats_t *stats = &loop.stats.phases[phase];
+  stats->time += elapsed;
+  stats->count++;
+  if (elapsed > stats->max_time) {
+    stats->max_time = elapsed;
+  }
+}
+
+static void io_update_lag(uint32_t lag) {
+  uint32_t ms = lag / 1000;
+  uint8_t bucket = 0;
+  while (ms > 0 && bucket < KM_IO_LAG_BUCKETS - 1) {
+    ms >>= 1;
+    bucket++;
+  }
+  loop.stats.lag[bucket]++;
+  loop.stats.iterations++;
+  if (lag > loop.stats.max_lag) {
+    loop.stats.max_lag = lag;
+  }
+}
+
 /* loop functions */
 
 void io_init() {
   loop.stop_flag = false;
   km_list_init(&loop.tty_handles);
   km_list_init(&loop.timer_handles);
+  km_heap_init(&loop.timer_heap);
+  km_heap_init(&loop.realtime_timer_heap);
+  km_list_init(&loop.periodic_handles);
+  km_heap_init(&loop.periodic_heap);
+  km_heap_init(&loop.realtime_periodic_heap);
+  loop.realtime_count = 0;
+  loop.in_realtime = false;
   km_list_init(&loop.watch_handles);
   km_list_init(&loop.uart_handles);
 #ifdef KALUMA_MODULE_IEEE80211
@@ -109,88 +635,486 @@ void io_init() {
 #ifdef KALUMA_MODULE_TCP
     km_list_init(&loop.tcp_handles);
 #endif//KALUMA_MODULE_TCP
+#ifdef KALUMA_IO_POLL
+  km_list_init(&loop.poll_handles);
+#endif//KALUMA_IO_POLL
+  km_list_init(&loop.work_handles);
+  work_slots = 0;
+  work_workers = km_worker_init();
+  km_list_init(&loop.immediate_handles);
+  km_list_init(&loop.tick_handles);
+  loop.immediate_seq = 0;
     km_list_init(&loop.closing_handles);
+  loop.handles = NULL;
+  loop.handles_size = 0;
+  loop.handles_count = 0;
+  loop.dispatched = 0;
+  memset(&loop.budget, 0, sizeof(km_io_budget_t));
+  km_pool_init(&timer_pool, sizeof(km_io_timer_handle_t), KM_IO_HANDLE_POOL_SLAB_OBJS);
+  km_pool_init(&periodic_pool, sizeof(km_io_periodic_handle_t), KM_IO_HANDLE_POOL_SLAB_OBJS);
+  km_pool_init(&watch_pool, sizeof(km_io_watch_handle_t), KM_IO_HANDLE_POOL_SLAB_OBJS);
+  km_pool_init(&uart_pool, sizeof(km_io_uart_handle_t), KM_IO_HANDLE_POOL_SLAB_OBJS);
+#ifdef KALUMA_IO_POLL
+  km_pool_init(&poll_pool, sizeof(km_io_poll_handle_t), KM_IO_HANDLE_POOL_SLAB_OBJS);
+#endif//KALUMA_IO_POLL
+  km_pool_init(&work_pool, sizeof(km_io_work_handle_t), KM_IO_HANDLE_POOL_SLAB_OBJS);
+  km_pool_init(&immediate_pool, sizeof(km_io_immediate_handle_t), KM_IO_HANDLE_POOL_SLAB_OBJS);
+  km_pool_init(&idle_pool, sizeof(km_io_idle_handle_t), KM_IO_HANDLE_POOL_SLAB_OBJS);
+  km_io_stats_reset();
+  /* timers started before the first iteration are relative to now */
+  io_update_time();
+}
+
+/**
+ * Run an iteration of the loop except the wait
+ */
+static void io_run_phases() {
+  io_update_time();
+  uint64_t start = km_micro_gettime();
+  loop.iteration_start = start;
+  loop.iteration_callbacks = 0;
+  io_drain_ready();
+  if (loop.realtime_count > 0) {
+    io_run_realtime();
+  }
+  io_run_phase(KM_IO_PHASE_TIMER, km_io_timer_run);
+  io_run_phase(KM_IO_PHASE_PERIODIC, km_io_periodic_run);
+  io_run_phase(KM_IO_PHASE_TTY, km_io_tty_run);
+  io_run_phase(KM_IO_PHASE_WATCH, km_io_watch_run);
+  io_run_phase(KM_IO_PHASE_UART, km_io_uart_run);
+#ifdef KALUMA_MODULE_IEEE80211
+  io_run_phase(KM_IO_PHASE_IEEE80211, km_io_ieee80211_run);
+#endif//KALUMA_MODULE_IEEE80211
+#ifdef KALUMA_MODULE_TCP
+  io_run_phase(KM_IO_PHASE_TCP, km_io_tcp_run);
+#endif//KALUMA_MODULE_TCP
+#ifdef KALUMA_IO_POLL
+  io_run_phase(KM_IO_PHASE_POLL, km_io_poll_run);
+#endif//KALUMA_IO_POLL
+  io_run_phase(KM_IO_PHASE_WORK, km_io_work_run);
+  io_run_phase(KM_IO_PHASE_IMMEDIATE, km_io_immediate_run);
+  io_run_phase(KM_IO_PHASE_IDLE, km_io_idle_run);
+  io_run_phase(KM_IO_PHASE_CLOSING, km_io_handle_closing);
+  io_update_lag((uint32_t) (km_micro_gettime() - start));
 }
 
 void io_run() {
   while (loop.stop_flag == false) {
-    io_update_time();
-    km_io_timer_run();
-    km_io_tty_run();
-    km_io_watch_run();
-    km_io_uart_run();
+    io_run_phases();
+    io_wait();
+  }
+}
+
+/**
+ * Run the loop until no referenced handle is alive (or stopped). Used by
+ * the host runtime to exit when a script is done.
+ */
+void io_run_alive() {
+  while (loop.stop_flag == false) {
+    io_run_phases();
+    if (!km_io_alive()) {
+      break;
+    }
+    io_wait();
+  }
+}
+
+static bool io_list_has_ref(km_list_t *list) {
+  km_io_handle_t *handle = (km_io_handle_t *) list->head;
+  while (handle != NULL) {
+    if (KM_IO_HAS_FLAG(handle->flags, KM_IO_FLAG_ACTIVE) &&
+        !KM_IO_HAS_FLAG(handle->flags, KM_IO_FLAG_UNREF)) {
+      return true;
+    }
+    handle = (km_io_handle_t *) ((km_list_node_t *) handle)->next;
+  }
+  return false;
+}
+
+/**
+ * Whether any active and referenced handle (except idle handles) or any
+ * closing handle is left. The lists are scanned up to the first referenced
+ * handle, which is usually the head.
+ */
+bool km_io_alive() {
+  if (loop.closing_handles.head != NULL) {
+    return true;
+  }
+  return io_list_has_ref(&loop.timer_handles) ||
+    io_list_has_ref(&loop.periodic_handles) ||
+    io_list_has_ref(&loop.tty_handles) ||
+    io_list_has_ref(&loop.watch_handles) ||
+    io_list_has_ref(&loop.uart_handles) ||
 #ifdef KALUMA_MODULE_IEEE80211
-    km_io_ieee80211_run();
+    io_list_has_ref(&loop.ieee80211_handles) ||
 #endif//KALUMA_MODULE_IEEE80211
 #ifdef KALUMA_MODULE_TCP
-    km_io_tcp_run();
+    io_list_has_ref(&loop.tcp_handles) ||
 #endif//KALUMA_MODULE_TCP
-    km_io_idle_run();
-    km_io_handle_closing();
-  }
+#ifdef KALUMA_IO_POLL
+    io_list_has_ref(&loop.poll_handles) ||
+#endif//KALUMA_IO_POLL
+    io_list_has_ref(&loop.work_handles) ||
+    io_list_has_ref(&loop.immediate_handles) ||
+    io_list_has_ref(&loop.tick_handles);
 }
 
 /* timer functions */
 
 uint32_t timer_count = 0;
 
+/**
+ * Timers are kept in a min-heap ordered by clamped timeout. Timers with
+ * the same timeout are ordered by the time they were (re)started.
+ */
+static bool km_io_timer_less_than(km_heap_node_t *a, km_heap_node_t *b) {
+  km_io_timer_handle_t *ta = KM_CONTAINER_OF(a, km_io_timer_handle_t, heap_node);
+  km_io_timer_handle_t *tb = KM_CONTAINER_OF(b, km_io_timer_handle_t, heap_node);
+  if (ta->clamped_timeout != tb->clamped_timeout) {
+    return ta->clamped_timeout < tb->clamped_timeout;
+  }
+  return (int32_t) (ta->start_id - tb->start_id) < 0;
+}
+
+/**
+ * Realtime timers are kept in a separate heap, which is checked between
+ * the callbacks of the other handles.
+ */
+static km_heap_t *km_io_timer_heap(km_io_timer_handle_t *timer) {
+  if (timer->base.priority == KM_IO_PRIORITY_REALTIME) {
+    return &loop.realtime_timer_heap;
+  }
+  return &loop.timer_heap;
+}
+
+static void km_io_timer_heap_insert(km_io_timer_handle_t *timer) {
+  timer->start_id = timer_count++;
+  km_heap_insert(km_io_timer_heap(timer), &timer->heap_node, km_io_timer_less_than);
+}
+
 void km_io_timer_init(km_io_timer_handle_t *timer) {
   km_io_handle_init((km_io_handle_t *) timer, KM_IO_TIMER);
   timer->timer_cb = NULL;
+  timer->expired_next = NULL;
 }
 
 void km_io_timer_start(km_io_timer_handle_t *timer, km_io_timer_cb timer_cb, uint64_t interval, bool repeat) {
+  if (!KM_IO_HAS_FLAG(timer->base.flags, KM_IO_FLAG_ACTIVE)) {
+    io_realtime_ref((km_io_handle_t *) timer);
+  }
   KM_IO_SET_FLAG_ON(timer->base.flags, KM_IO_FLAG_ACTIVE);
+  KM_IO_SET_FLAG_OFF(timer->base.flags, KM_IO_FLAG_PENDING);
   timer->timer_cb = timer_cb;
   timer->clamped_timeout = loop.time + interval;
   timer->interval = interval;
   timer->repeat = repeat;
+  km_io_timer_heap_insert(timer);
   km_list_append(&loop.timer_handles, (km_list_node_t *) timer);
 }
 
 void km_io_timer_stop(km_io_timer_handle_t *timer) {
+  if (KM_IO_HAS_FLAG(timer->base.flags, KM_IO_FLAG_ACTIVE)) {
+    io_realtime_unref((km_io_handle_t *) timer);
+    if (!KM_IO_HAS_FLAG(timer->base.flags, KM_IO_FLAG_PENDING)) {
+      km_heap_remove(km_io_timer_heap(timer), &timer->heap_node, km_io_timer_less_than);
+    }
+  }
   KM_IO_SET_FLAG_OFF(timer->base.flags, KM_IO_FLAG_ACTIVE);
+  KM_IO_SET_FLAG_OFF(timer->base.flags, KM_IO_FLAG_PENDING);
   km_list_remove(&loop.timer_handles, (km_list_node_t *) timer);
 }
 
 km_io_timer_handle_t *km_io_timer_get_by_id(uint32_t id) {
-  return (km_io_timer_handle_t *) km_io_handle_get_by_id(id, &loop.timer_handles);
+  return (km_io_timer_handle_t *) km_io_handle_get_by_id(id, KM_IO_TIMER);
+}
+
+/**
+ * Return the clamped timeout of the earliest timer, or KM_IO_TIMEOUT_NONE
+ * if no timer is armed.
+ */
+uint64_t km_io_timer_next_timeout() {
+  uint64_t timeout = KM_IO_TIMEOUT_NONE;
+  km_heap_node_t *min = km_heap_min(&loop.timer_heap);
+  if (min != NULL) {
+    timeout = KM_CONTAINER_OF(min, km_io_timer_handle_t, heap_node)->clamped_timeout;
+  }
+  min = km_heap_min(&loop.realtime_timer_heap);
+  if (min != NULL) {
+    uint64_t realtime = KM_CONTAINER_OF(min, km_io_timer_handle_t, heap_node)->clamped_timeout;
+    if (realtime < timeout) {
+      timeout = realtime;
+    }
+  }
+  return timeout;
 }
 
 void km_io_timer_cleanup() {
   km_io_timer_handle_t *handle = (km_io_timer_handle_t *) loop.timer_handles.head;
   while (handle != NULL) {
     km_io_timer_handle_t *next = (km_io_timer_handle_t *) ((km_list_node_t *) handle)->next;
-    free(handle);
+    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE)) {
+      io_realtime_unref((km_io_handle_t *) handle);
+    }
+    km_io_handle_table_remove((km_io_handle_t *) handle);
+    km_io_handle_free((km_io_handle_t *) handle);
     handle = next;
   }
   km_list_init(&loop.timer_handles);
+  km_heap_init(&loop.timer_heap);
+  km_heap_init(&loop.realtime_timer_heap);
+}
+
+/**
+ * Dispatch the timers of the heap expired before `now`. Background timers
+ * are dispatched after the others.
+ */
+static void km_io_timer_run_heap(km_heap_t *heap, uint64_t now) {
+  /* Detach all expired timers first, so a repeating timer which is still
+     overdue after re-arming fires only once per iteration (as before) and
+     cannot starve the other expired timers. */
+  km_io_timer_handle_t *expired = NULL;
+  km_io_timer_handle_t **tail = &expired;
+  km_io_timer_handle_t *background = NULL;
+  km_io_timer_handle_t **background_tail = &background;
+  km_heap_node_t *min = km_heap_min(heap);
+  while (min != NULL) {
+    km_io_timer_handle_t *handle = KM_CONTAINER_OF(min, km_io_timer_handle_t, heap_node);
+    if (handle->clamped_timeout >= now) {
+      break;
+    }
+    km_heap_remove(heap, min, km_io_timer_less_than);
+    KM_IO_SET_FLAG_ON(handle->base.flags, KM_IO_FLAG_PENDING);
+    handle->expired_next = NULL;
+    if (handle->base.priority == KM_IO_PRIORITY_BACKGROUND) {
+      *background_tail = handle;
+      background_tail = &handle->expired_next;
+    } else {
+      *tail = handle;
+      tail = &handle->expired_next;
+    }
+    min = km_heap_min(heap);
+  }
+  *tail = background;
+  while (expired != NULL) {
+    km_io_timer_handle_t *handle = expired;
+    if (!loop.in_realtime && io_budget_exhausted()) {
+      break;
+    }
+    expired = handle->expired_next;
+    /* skip timers stopped or restarted by a preceding callback */
+    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE) &&
+        KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_PENDING)) {
+      KM_IO_SET_FLAG_OFF(handle->base.flags, KM_IO_FLAG_PENDING);
+      if (handle->repeat) {
+        handle->clamped_timeout = handle->clamped_timeout + handle->interval;
+        km_io_timer_heap_insert(handle);
+      } else {
+        KM_IO_SET_FLAG_OFF(handle->base.flags, KM_IO_FLAG_ACTIVE);
+        io_realtime_unref((km_io_handle_t *) handle);
+      }
+      if (handle->timer_cb) {
+        KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_TIMER);
+        handle->timer_cb(handle);
+      }
+    }
+  }
+  /* put the timers left by the budget back, they are still expired */
+  while (expired != NULL) {
+    km_io_timer_handle_t *handle = expired;
+    expired = handle->expired_next;
+    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE) &&
+        KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_PENDING)) {
+      KM_IO_SET_FLAG_OFF(handle->base.flags, KM_IO_FLAG_PENDING);
+      km_io_timer_heap_insert(handle);
+    }
+  }
 }
 
 static void km_io_timer_run() {
-  km_io_timer_handle_t *handle = (km_io_timer_handle_t *) loop.timer_handles.head;
+  km_io_timer_run_heap(&loop.timer_heap, loop.time);
+}
+
+/* periodic functions */
+
+static bool km_io_periodic_less_than(km_heap_node_t *a, km_heap_node_t *b) {
+  km_io_periodic_handle_t *pa = KM_CONTAINER_OF(a, km_io_periodic_handle_t, heap_node);
+  km_io_periodic_handle_t *pb = KM_CONTAINER_OF(b, km_io_periodic_handle_t, heap_node);
+  if (pa->deadline != pb->deadline) {
+    return pa->deadline < pb->deadline;
+  }
+  return (int32_t) (pa->start_id - pb->start_id) < 0;
+}
+
+static km_heap_t *km_io_periodic_heap(km_io_periodic_handle_t *periodic) {
+  if (periodic->base.priority == KM_IO_PRIORITY_REALTIME) {
+    return &loop.realtime_periodic_heap;
+  }
+  return &loop.periodic_heap;
+}
+
+static void km_io_periodic_heap_insert(km_io_periodic_handle_t *periodic) {
+  periodic->start_id = timer_count++;
+  km_heap_insert(km_io_periodic_heap(periodic), &periodic->heap_node, km_io_periodic_less_than);
+}
+
+void km_io_periodic_init(km_io_periodic_handle_t *periodic) {
+  km_io_handle_init((km_io_handle_t *) periodic, KM_IO_PERIODIC);
+  periodic->periodic_cb = NULL;
+  periodic->expired_next = NULL;
+  periodic->policy = KM_IO_PERIODIC_SKIP;
+  memset(&periodic->stats, 0, sizeof(km_io_periodic_stats_t));
+}
+
+/**
+ * Start to call back every period (in microseconds) from now. The schedule
+ * is fixed at the start, so a late callback does not delay the next ones.
+ */
+void km_io_periodic_start(km_io_periodic_handle_t *periodic, km_io_periodic_cb periodic_cb, uint32_t period, km_io_periodic_policy_t policy) {
+  km_io_periodic_stop(periodic);
+  io_realtime_ref((km_io_handle_t *) periodic);
+  KM_IO_SET_FLAG_ON(periodic->base.flags, KM_IO_FLAG_ACTIVE);
+  periodic->periodic_cb = periodic_cb;
+  periodic->period = (period > 0) ? period : 1;
+  periodic->policy = policy;
+  periodic->deadline = km_micro_gettime() + periodic->period;
+  km_io_periodic_heap_insert(periodic);
+  km_list_append(&loop.periodic_handles, (km_list_node_t *) periodic);
+}
+
+void km_io_periodic_stop(km_io_periodic_handle_t *periodic) {
+  if (KM_IO_HAS_FLAG(periodic->base.flags, KM_IO_FLAG_ACTIVE)) {
+    io_realtime_unref((km_io_handle_t *) periodic);
+    if (!KM_IO_HAS_FLAG(periodic->base.flags, KM_IO_FLAG_PENDING)) {
+      km_heap_remove(km_io_periodic_heap(periodic), &periodic->heap_node, km_io_periodic_less_than);
+    }
+    km_list_remove(&loop.periodic_handles, (km_list_node_t *) periodic);
+  }
+  KM_IO_SET_FLAG_OFF(periodic->base.flags, KM_IO_FLAG_ACTIVE);
+  KM_IO_SET_FLAG_OFF(periodic->base.flags, KM_IO_FLAG_PENDING);
+}
+
+km_io_periodic_handle_t *km_io_periodic_get_by_id(uint32_t id) {
+  return (km_io_periodic_handle_t *) km_io_handle_get_by_id(id, KM_IO_PERIODIC);
+}
+
+/**
+ * Return the earliest deadline in microseconds, or KM_IO_TIMEOUT_NONE if
+ * no periodic handle is active.
+ */
+uint64_t km_io_periodic_next_deadline() {
+  uint64_t deadline = KM_IO_TIMEOUT_NONE;
+  km_heap_node_t *min = km_heap_min(&loop.periodic_heap);
+  if (min != NULL) {
+    deadline = KM_CONTAINER_OF(min, km_io_periodic_handle_t, heap_node)->deadline;
+  }
+  min = km_heap_min(&loop.realtime_periodic_heap);
+  if (min != NULL) {
+    uint64_t realtime = KM_CONTAINER_OF(min, km_io_periodic_handle_t, heap_node)->deadline;
+    if (realtime < deadline) {
+      deadline = realtime;
+    }
+  }
+  return deadline;
+}
+
+void km_io_periodic_cleanup() {
+  km_io_periodic_handle_t *handle = (km_io_periodic_handle_t *) loop.periodic_handles.head;
   while (handle != NULL) {
-    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE)) {
-      if (handle->clamped_timeout < loop.time) {
-        if (handle->repeat) {
-          handle->clamped_timeout = handle->clamped_timeout + handle->interval;
-        } else {
-          KM_IO_SET_FLAG_OFF(handle->base.flags, KM_IO_FLAG_ACTIVE);
-        }
-        if (handle->timer_cb) {
-          handle->timer_cb(handle);
-        }
+    km_io_periodic_handle_t *next = (km_io_periodic_handle_t *) ((km_list_node_t *) handle)->next;
+    io_realtime_unref((km_io_handle_t *) handle);
+    km_io_handle_table_remove((km_io_handle_t *) handle);
+    km_io_handle_free((km_io_handle_t *) handle);
+    handle = next;
+  }
+  km_list_init(&loop.periodic_handles);
+  km_heap_init(&loop.periodic_heap);
+  km_heap_init(&loop.realtime_periodic_heap);
+}
+
+/**
+ * Account the latency of a callback and move the deadline to the next
+ * period, skipping the missed periods by the policy.
+ */
+static void km_io_periodic_advance(km_io_periodic_handle_t *handle, uint64_t now) {
+  km_io_periodic_stats_t *stats = &handle->stats;
+  uint32_t latency = (uint32_t) (now - handle->deadline);
+  stats->fired++;
+  stats->latency_sum += latency;
+  stats->latency_sq_sum += (uint64_t) latency * latency;
+  if (latency > stats->max_latency) {
+    stats->max_latency = latency;
+  }
+  if (latency >= handle->period) {
+    stats->late++;
+  }
+  handle->deadline += handle->period;
+  if (handle->policy == KM_IO_PERIODIC_SKIP && handle->deadline <= now) {
+    uint32_t missed = (uint32_t) ((now - handle->deadline) / handle->period) + 1;
+    handle->deadline += (uint64_t) missed * handle->period;
+    stats->skipped += missed;
+  }
+}
+
+/**
+ * Dispatch the periodic handles of the heap due by `now`. Like timers, the
+ * due handles are detached first, so a handle catching up is called once
+ * per iteration.
+ */
+static void km_io_periodic_run_heap(km_heap_t *heap, uint64_t now) {
+  km_io_periodic_handle_t *expired = NULL;
+  km_io_periodic_handle_t **tail = &expired;
+  km_heap_node_t *min = km_heap_min(heap);
+  while (min != NULL) {
+    km_io_periodic_handle_t *handle = KM_CONTAINER_OF(min, km_io_periodic_handle_t, heap_node);
+    if (handle->deadline > now) {
+      break;
+    }
+    km_heap_remove(heap, min, km_io_periodic_less_than);
+    KM_IO_SET_FLAG_ON(handle->base.flags, KM_IO_FLAG_PENDING);
+    handle->expired_next = NULL;
+    *tail = handle;
+    tail = &handle->expired_next;
+    min = km_heap_min(heap);
+  }
+  while (expired != NULL) {
+    km_io_periodic_handle_t *handle = expired;
+    if (!loop.in_realtime && io_budget_exhausted()) {
+      break;
+    }
+    expired = handle->expired_next;
+    /* skip handles stopped or restarted by a preceding callback */
+    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE) &&
+        KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_PENDING)) {
+      KM_IO_SET_FLAG_OFF(handle->base.flags, KM_IO_FLAG_PENDING);
+      km_io_periodic_advance(handle, km_micro_gettime());
+      km_io_periodic_heap_insert(handle);
+      if (handle->periodic_cb) {
+        KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_PERIODIC);
+        handle->periodic_cb(handle);
       }
     }
-    handle = (km_io_timer_handle_t *) ((km_list_node_t *) handle)->next;
   }
+  /* put the handles left by the budget back, they are still due */
+  while (expired != NULL) {
+    km_io_periodic_handle_t *handle = expired;
+    expired = handle->expired_next;
+    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE) &&
+        KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_PENDING)) {
+      KM_IO_SET_FLAG_OFF(handle->base.flags, KM_IO_FLAG_PENDING);
+      km_io_periodic_heap_insert(handle);
+    }
+  }
+}
+
+static void km_io_periodic_run() {
+  km_io_periodic_run_heap(&loop.periodic_heap, km_micro_gettime());
 }
 
 /* TTY functions */
 
-void km_io_tty_init(km_io_tty_handle_t *tty) {
-  km_io_handle_init((km_io_handle_t *) tty, KM_IO_TTY);
+bool km_io_tty_init(km_io_tty_handle_t *tty) {
   tty->read_cb = NULL;
+  return km_io_handle_init((km_io_handle_t *) tty, KM_IO_TTY);
 }
 
 void km_io_tty_read_start(km_io_tty_handle_t *tty, km_io_tty_read_cb read_cb) {
@@ -208,7 +1132,8 @@ void km_io_tty_cleanup() {
   km_io_tty_handle_t *handle = (km_io_tty_handle_t *) loop.tty_handles.head;
   while (handle != NULL) {
     km_io_tty_handle_t *next = (km_io_tty_handle_t *) ((km_list_node_t *) handle)->next;
-    free(handle);
+    km_io_handle_table_remove((km_io_handle_t *) handle);
+    km_io_handle_free((km_io_handle_t *) handle);
     handle = next;
   }
   km_list_init(&loop.tty_handles);
@@ -225,6 +1150,7 @@ static void km_io_tty_run() {
         //}
         uint8_t buf[len];
         km_tty_read(buf, len);
+        KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_TTY);
         handle->read_cb(buf, len);
       }
     }
@@ -234,12 +1160,110 @@ static void km_io_tty_run() {
 
 /* GPIO watch functions */
 
+/**
+ * Edges recorded by the pin interrupt. One ring per watched pin, shared by
+ * the watches of the pin. The interrupt is the producer and the loop is the
+ * consumer.
+ */
+#define KM_IO_EDGE_RING_SIZE 16 /* power of two */
+
+typedef struct {
+  uint32_t time; /* in microseconds (lower 32 bits) */
+  uint8_t value;
+} km_io_edge_t;
+
+typedef struct {
+  km_io_edge_t edges[KM_IO_EDGE_RING_SIZE];
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint32_t missed; /* edges dropped while the ring was full */
+  uint32_t batch_end; /* head at the start of the current watch phase */
+  uint32_t release; /* oldest edge not consumed by all watches */
+  uint8_t watchers;
+} km_io_edge_ring_t;
+
+static km_io_edge_ring_t *edge_rings[KM_IO_READY_SOURCES];
+static uint32_t watch_polled = 0; /* active watches without interrupt */
+static uint32_t watch_pending = 0; /* watches waiting for debounce */
+static uint32_t watch_deadline = 0; /* earliest debounce deadline (us) */
+static bool watch_deadline_set = false;
+
+static void km_io_watch_irq_cb(uint8_t pin, uint8_t value, uint64_t time) {
+  km_io_edge_ring_t *ring = edge_rings[pin];
+  if (ring == NULL) {
+    return;
+  }
+  uint32_t head = ring->head;
+  if (head - ring->tail >= KM_IO_EDGE_RING_SIZE) {
+    ring->missed++;
+  } else {
+    km_io_edge_t *edge = &ring->edges[head & (KM_IO_EDGE_RING_SIZE - 1)];
+    edge->time = (uint32_t) time;
+    edge->value = value;
+    __sync_synchronize(); /* publish the edge before the head */
+    ring->head = head + 1;
+  }
+  km_system_notify(KM_SYSTEM_EVENT_GPIO, pin);
+}
+
+/**
+ * Attach the watch to the edge ring of the pin, enabling the pin interrupt
+ * for the first watch. Returns false if the pin has no interrupt.
+ */
+static bool km_io_watch_attach(km_io_watch_handle_t *watch) {
+  if (watch->pin >= KM_IO_READY_SOURCES) {
+    return false;
+  }
+  km_io_edge_ring_t *ring = edge_rings[watch->pin];
+  if (ring == NULL) {
+    ring = malloc(sizeof(km_io_edge_ring_t));
+    if (ring == NULL) {
+      return false;
+    }
+    ring->head = 0;
+    ring->tail = 0;
+    ring->missed = 0;
+    ring->batch_end = 0;
+    ring->release = 0;
+    ring->watchers = 0;
+    edge_rings[watch->pin] = ring;
+    if (km_gpio_irq_enable(watch->pin, KM_GPIO_IRQ_EDGE_BOTH, km_io_watch_irq_cb) < 0) {
+      edge_rings[watch->pin] = NULL;
+      free(ring);
+      return false;
+    }
+  }
+  ring->watchers++;
+  return true;
+}
+
+static void km_io_watch_detach(km_io_watch_handle_t *watch) {
+  km_io_edge_ring_t *ring = edge_rings[watch->pin];
+  if (ring != NULL && --ring->watchers == 0) {
+    km_gpio_irq_disable(watch->pin);
+    edge_rings[watch->pin] = NULL;
+    free(ring);
+  }
+}
+
+/**
+ * Return the number of edges of the pin dropped because the loop did not
+ * catch up with the interrupts
+ */
+uint32_t km_io_watch_missed_edges(uint8_t pin) {
+  if (pin < KM_IO_READY_SOURCES && edge_rings[pin] != NULL) {
+    return edge_rings[pin]->missed;
+  }
+  return 0;
+}
+
 void km_io_watch_init(km_io_watch_handle_t *watch) {
   km_io_handle_init((km_io_handle_t *) watch, KM_IO_WATCH);
   watch->watch_cb = NULL;
 }
 
 void km_io_watch_start(km_io_watch_handle_t *watch, km_io_watch_cb watch_cb, uint8_t pin, km_io_watch_mode_t mode, uint32_t debounce) {
+  io_realtime_ref((km_io_handle_t *) watch);
   KM_IO_SET_FLAG_ON(watch->base.flags, KM_IO_FLAG_ACTIVE);
   watch->watch_cb = watch_cb;
   watch->pin = pin;
@@ -248,67 +1272,279 @@ void km_io_watch_start(km_io_watch_handle_t *watch, km_io_watch_cb watch_cb, uin
   watch->debounce_delay = debounce;
   watch->last_val = (uint8_t)km_gpio_read(watch->pin);
   watch->val = (uint8_t)km_gpio_read(watch->pin);
+  watch->pending = false;
+  watch->edge_time = 0;
+  watch->irq = km_io_watch_attach(watch);
+  if (watch->irq) {
+    /* skip the edges recorded before this watch */
+    watch->edge_index = edge_rings[pin]->head;
+  } else {
+    watch_polled++;
+  }
   km_list_append(&loop.watch_handles, (km_list_node_t *) watch);
 }
 
 void km_io_watch_stop(km_io_watch_handle_t *watch) {
+  if (KM_IO_HAS_FLAG(watch->base.flags, KM_IO_FLAG_ACTIVE)) {
+    io_realtime_unref((km_io_handle_t *) watch);
+    if (watch->irq) {
+      km_io_watch_detach(watch);
+    } else {
+      watch_polled--;
+    }
+    if (watch->pending) {
+      watch->pending = false;
+      watch_pending--;
+    }
+  }
   KM_IO_SET_FLAG_OFF(watch->base.flags, KM_IO_FLAG_ACTIVE);
   km_list_remove(&loop.watch_handles, (km_list_node_t *) watch);
 }
 
 km_io_watch_handle_t *km_io_watch_get_by_id(uint32_t id) {
-  return (km_io_watch_handle_t *) km_io_handle_get_by_id(id, &loop.watch_handles);
+  return (km_io_watch_handle_t *) km_io_handle_get_by_id(id, KM_IO_WATCH);
 }
 
 void km_io_watch_cleanup() {
   km_io_watch_handle_t *handle = (km_io_watch_handle_t *) loop.watch_handles.head;
   while (handle != NULL) {
     km_io_watch_handle_t *next = (km_io_watch_handle_t *) ((km_list_node_t *) handle)->next;
-    free(handle);
+    if (handle->irq) {
+      km_io_watch_detach(handle);
+    }
+    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE)) {
+      io_realtime_unref((km_io_handle_t *) handle);
+    }
+    km_io_handle_table_remove((km_io_handle_t *) handle);
+    km_io_handle_free((km_io_handle_t *) handle);
     handle = next;
   }
   km_list_init(&loop.watch_handles);
+  watch_polled = 0;
+  watch_pending = 0;
 }
 
-static void km_io_watch_run() {
+/**
+ * Update the debounced value and call the callback if the mode matches
+ */
+static void km_io_watch_fire(km_io_watch_handle_t *handle, uint8_t value) {
+  if (value == handle->val) {
+    return;
+  }
+  handle->val = value;
+  switch (handle->mode) {
+    case KM_IO_WATCH_MODE_CHANGE:
+      if (handle->watch_cb) {
+        KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_WATCH);
+        handle->watch_cb(handle);
+      }
+      break;
+    case KM_IO_WATCH_MODE_RISING:
+      if (handle->val == 1 && handle->watch_cb) {
+        KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_WATCH);
+        handle->watch_cb(handle);
+      }
+      break;
+    case KM_IO_WATCH_MODE_FALLING:
+      if (handle->val == 0 && handle->watch_cb) {
+        KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_WATCH);
+        handle->watch_cb(handle);
+      }
+      break;
+  }
+}
+
+/**
+ * Move the debounce deadline up to the pending edge of the watch
+ */
+static void km_io_watch_set_deadline(km_io_watch_handle_t *handle) {
+  uint32_t deadline = handle->pending_time + handle->debounce_delay * 1000;
+  if (!watch_deadline_set || (int32_t) (deadline - watch_deadline) < 0) {
+    watch_deadline = deadline;
+    watch_deadline_set = true;
+  }
+}
+
+/**
+ * Debounce the recorded edges of the watch up to the edge index `end`. A
+ * level is accepted when it lasted for the debounce delay, measured by the
+ * edge timestamps.
+ */
+static void km_io_watch_run_edges(km_io_watch_handle_t *handle, uint32_t end, uint32_t now) {
+  uint32_t debounce = handle->debounce_delay * 1000;
+  km_io_edge_ring_t *ring = edge_rings[handle->pin];
+  if (ring != NULL) {
+    while (handle->edge_index != end) {
+      km_io_edge_t edge = ring->edges[handle->edge_index & (KM_IO_EDGE_RING_SIZE - 1)];
+      handle->edge_index++;
+      if (handle->pending && edge.time - handle->pending_time >= debounce) {
+        handle->pending = false;
+        watch_pending--;
+        handle->edge_time = handle->pending_time;
+        km_io_watch_fire(handle, handle->pending_val);
+        if (!KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE)) {
+          return; /* stopped by the callback */
+        }
+        ring = edge_rings[handle->pin];
+        if (ring == NULL) {
+          break;
+        }
+      }
+      if (!handle->pending) {
+        watch_pending++;
+      }
+      handle->pending = true;
+      handle->pending_val = edge.value;
+      handle->pending_time = edge.time;
+    }
+  }
+  if (handle->pending) {
+    if (now - handle->pending_time >= debounce) {
+      handle->pending = false;
+      watch_pending--;
+      handle->edge_time = handle->pending_time;
+      km_io_watch_fire(handle, handle->pending_val);
+    } else {
+      km_io_watch_set_deadline(handle);
+    }
+  }
+}
+
+/**
+ * Poll the pin of the watch (for the pins without interrupt)
+ */
+static void km_io_watch_run_poll(km_io_watch_handle_t *handle) {
+  uint8_t reading = (uint8_t)km_gpio_read(handle->pin);
+  if (handle->last_val != reading) { /* changed by noise or pressing */
+    handle->debounce_time = km_gettime();
+  }
+  /* debounce delay elapsed */
+  uint32_t elapsed_time = km_gettime() - handle->debounce_time;
+  if (handle->debounce_time > 0 && elapsed_time >= handle->debounce_delay) {
+    handle->edge_time = (uint32_t) km_micro_gettime();
+    km_io_watch_fire(handle, reading);
+    handle->debounce_time = 0;
+  }
+  handle->last_val = reading;
+}
+
+/**
+ * Release the edges consumed by all watches of each pin
+ */
+static void km_io_watch_release_edges() {
+  for (int pin = 0; pin < KM_IO_READY_SOURCES; pin++) {
+    if (edge_rings[pin] != NULL) {
+      edge_rings[pin]->release = edge_rings[pin]->head;
+    }
+  }
   km_io_watch_handle_t *handle = (km_io_watch_handle_t *) loop.watch_handles.head;
   while (handle != NULL) {
-    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE)) {
-      uint8_t reading = (uint8_t)km_gpio_read(handle->pin);
-      if (handle->last_val != reading) { /* changed by noise or pressing */
-        handle->debounce_time = km_gettime();
+    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE) && handle->irq) {
+      km_io_edge_ring_t *ring = edge_rings[handle->pin];
+      if ((int32_t) (handle->edge_index - ring->release) < 0) {
+        ring->release = handle->edge_index;
       }
-      /* debounce delay elapsed */
-      uint32_t elapsed_time = km_gettime() - handle->debounce_time;
-      if (handle->debounce_time > 0 && elapsed_time >= handle->debounce_delay) {
-        if (reading != handle->val) {
-          handle->val = reading;
-          switch (handle->mode) {
-            case KM_IO_WATCH_MODE_CHANGE:
-              if (handle->watch_cb) {
-                handle->watch_cb(handle);
-              }
-              break;
-            case KM_IO_WATCH_MODE_RISING:
-              if (handle->val == 1 && handle->watch_cb) {
-                handle->watch_cb(handle);
-              }
-              break;
-            case KM_IO_WATCH_MODE_FALLING:
-              if (handle->val == 0 && handle->watch_cb) {
-                handle->watch_cb(handle);
-              }
-              break;
+    }
+    handle = (km_io_watch_handle_t *) ((km_list_node_t *) handle)->next;
+  }
+  for (int pin = 0; pin < KM_IO_READY_SOURCES; pin++) {
+    if (edge_rings[pin] != NULL) {
+      edge_rings[pin]->tail = edge_rings[pin]->release;
+    }
+  }
+}
+
+static void km_io_watch_run() {
+  uint32_t ready = io_take_ready(KM_SYSTEM_EVENT_GPIO);
+  if (ready == 0 && watch_polled == 0 && watch_pending == 0) {
+    return;
+  }
+  /* snapshot the recorded edges of the ready pins */
+  for (int pin = 0; pin < KM_IO_READY_SOURCES; pin++) {
+    if ((ready & (1u << pin)) && edge_rings[pin] != NULL) {
+      edge_rings[pin]->batch_end = edge_rings[pin]->head;
+      __sync_synchronize(); /* read the edges after the head */
+    }
+  }
+  uint32_t now = (uint32_t) km_micro_gettime();
+  watch_deadline_set = false;
+  /* realtime watches are serviced by io_run_realtime() */
+  for (uint8_t priority = KM_IO_PRIORITY_NORMAL; priority <= KM_IO_PRIORITY_BACKGROUND; priority++) {
+    km_io_watch_handle_t *handle = (km_io_watch_handle_t *) loop.watch_handles.head;
+    while (handle != NULL) {
+      km_io_watch_handle_t *next = (km_io_watch_handle_t *) ((km_list_node_t *) handle)->next;
+      if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE)) {
+        if (handle->base.priority == KM_IO_PRIORITY_REALTIME) {
+          if (handle->pending && priority == KM_IO_PRIORITY_NORMAL) {
+            km_io_watch_set_deadline(handle);
+          }
+        } else if (handle->base.priority == priority) {
+          if (handle->irq) {
+            if ((ready & (1u << handle->pin)) || handle->pending) {
+              uint32_t end = (ready & (1u << handle->pin)) ? edge_rings[handle->pin]->batch_end : handle->edge_index;
+              km_io_watch_run_edges(handle, end, now);
+            }
+          } else {
+            km_io_watch_run_poll(handle);
           }
         }
-        handle->debounce_time = 0;
       }
-      handle->last_val = reading;
+      handle = next;
     }
-    handle = (km_io_watch_handle_t *) ((km_list_node_t *) handle)->next;
+  }
+  if (ready != 0) {
+    km_io_watch_release_edges();
+  }
+}
+
+/**
+ * Service the realtime watches up to the latest recorded edges
+ */
+static void km_io_watch_run_realtime() {
+  uint32_t now = (uint32_t) km_micro_gettime();
+  bool consumed = false;
+  km_io_watch_handle_t *handle = (km_io_watch_handle_t *) loop.watch_handles.head;
+  while (handle != NULL) {
+    km_io_watch_handle_t *next = (km_io_watch_handle_t *) ((km_list_node_t *) handle)->next;
+    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE) &&
+        handle->base.priority == KM_IO_PRIORITY_REALTIME) {
+      if (handle->irq) {
+        uint32_t end = edge_rings[handle->pin]->head;
+        __sync_synchronize(); /* read the edges after the head */
+        if (end != handle->edge_index || handle->pending) {
+          consumed = consumed || (end != handle->edge_index);
+          km_io_watch_run_edges(handle, end, now);
+        }
+      } else {
+        km_io_watch_run_poll(handle);
+      }
+    }
+    handle = next;
+  }
+  if (consumed) {
+    km_io_watch_release_edges();
   }
 }
 
+static uint32_t km_io_watch_polled() {
+  return watch_polled;
+}
+
+/**
+ * Return the earliest debounce deadline in milliseconds (same base with
+ * km_gettime), or KM_IO_TIMEOUT_NONE if no watch waits for debounce.
+ */
+static uint64_t km_io_watch_next_timeout() {
+  if (watch_pending == 0 || !watch_deadline_set) {
+    return KM_IO_TIMEOUT_NONE;
+  }
+  int32_t remain = (int32_t) (watch_deadline - (uint32_t) km_micro_gettime());
+  if (remain <= 0) {
+    return 0;
+  }
+  return km_gettime() + (remain + 999) / 1000;
+}
+
 /* UART functions */
 
 void km_io_uart_init(km_io_uart_handle_t *uart) {
@@ -316,44 +1552,102 @@ void km_io_uart_init(km_io_uart_handle_t *uart) {
 }
 
 void km_io_uart_read_start(km_io_uart_handle_t *uart, uint8_t port, km_io_uart_available_cb available_cb, km_io_uart_read_cb read_cb) {
+  io_realtime_ref((km_io_handle_t *) uart);
   KM_IO_SET_FLAG_ON(uart->base.flags, KM_IO_FLAG_ACTIVE);
   uart->port = port;
   uart->available_cb = available_cb;
   uart->read_cb = read_cb;
   km_list_append(&loop.uart_handles, (km_list_node_t *) uart);
+  ready_sources[KM_SYSTEM_EVENT_UART] |= (1u << port); /* may have buffered data */
 }
 
 void km_io_uart_read_stop(km_io_uart_handle_t *uart) {
+  if (KM_IO_HAS_FLAG(uart->base.flags, KM_IO_FLAG_ACTIVE)) {
+    io_realtime_unref((km_io_handle_t *) uart);
+  }
   KM_IO_SET_FLAG_OFF(uart->base.flags, KM_IO_FLAG_ACTIVE);
   km_list_remove(&loop.uart_handles, (km_list_node_t *) uart);
 }
 
 km_io_uart_handle_t *km_io_uart_get_by_id(uint32_t id) {
-  return (km_io_uart_handle_t *) km_io_handle_get_by_id(id, &loop.uart_handles);
+  return (km_io_uart_handle_t *) km_io_handle_get_by_id(id, KM_IO_UART);
 }
 
 void km_io_uart_cleanup() {
   km_io_uart_handle_t *handle = (km_io_uart_handle_t *) loop.uart_handles.head;
   while (handle != NULL) {
     km_io_uart_handle_t *next = (km_io_uart_handle_t *) ((km_list_node_t *) handle)->next;
-    free(handle);
+    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE)) {
+      io_realtime_unref((km_io_handle_t *) handle);
+    }
+    km_io_handle_table_remove((km_io_handle_t *) handle);
+    km_io_handle_free((km_io_handle_t *) handle);
     handle = next;
   }
   km_list_init(&loop.uart_handles);
 }
 
+/**
+ * Read the received data of the port and call the handle
+ */
+static void km_io_uart_read(km_io_uart_handle_t *handle) {
+  if (handle->available_cb != NULL && handle->read_cb != NULL) {
+    int len = handle->available_cb(handle);
+    if (len > 0) {
+      uint8_t buf[len];
+      km_uart_read(handle->port, buf, len);
+      ready_sources[KM_SYSTEM_EVENT_UART] |= (1u << handle->port);
+      KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_UART);
+      handle->read_cb(handle, buf, len);
+    }
+  }
+}
+
+/**
+ * Visit only the handles of the UART ports which received data. A port is
+ * visited again in the next iteration after a read, since the handle may
+ * have consumed only a part of the received data. Background ports are
+ * visited after the others.
+ */
 static void km_io_uart_run() {
-  km_io_uart_handle_t *handle = (km_io_uart_handle_t *) loop.uart_handles.head;
-  while (handle != NULL) {
-    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE)) {
-      if (handle->available_cb != NULL && handle->read_cb != NULL) {
-        int len = handle->available_cb(handle);
-        if (len > 0) {
-          uint8_t buf[len];
-          km_uart_read(handle->port, buf, len);
-          handle->read_cb(handle, buf, len);
+  uint32_t ready = io_take_ready(KM_SYSTEM_EVENT_UART);
+  if (ready == 0) {
+    return;
+  }
+  for (uint8_t priority = KM_IO_PRIORITY_NORMAL; priority <= KM_IO_PRIORITY_BACKGROUND; priority++) {
+    km_io_uart_handle_t *handle = (km_io_uart_handle_t *) loop.uart_handles.head;
+    while (handle != NULL) {
+      if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE) &&
+          (ready & (1u << handle->port))) {
+        if (handle->base.priority == KM_IO_PRIORITY_REALTIME) {
+          /* leave the port to io_run_realtime() */
+          ready_sources[KM_SYSTEM_EVENT_UART] |= (1u << handle->port);
+        } else if (handle->base.priority == priority) {
+          if (io_budget_exhausted()) {
+            /* read the remaining ports in the next iteration */
+            ready_sources[KM_SYSTEM_EVENT_UART] |= ready;
+            return;
+          }
+          km_io_uart_read(handle);
         }
       }
+      handle = (km_io_uart_handle_t *) ((km_list_node_t *) handle)->next;
+    }
+  }
+}
+
+/**
+ * Service the realtime UART ports which received data
+ */
+static void km_io_uart_run_realtime() {
+  km_io_uart_handle_t *handle = (km_io_uart_handle_t *) loop.uart_handles.head;
+  while (handle != NULL) {
+    uint32_t bit = 1u << handle->port;
+    if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE) &&
+        handle->base.priority == KM_IO_PRIORITY_REALTIME &&
+        (ready_sources[KM_SYSTEM_EVENT_UART] & bit)) {
+      ready_sources[KM_SYSTEM_EVENT_UART] &= ~bit;
+      km_io_uart_read(handle);
     }
     handle = (km_io_uart_handle_t *) ((km_list_node_t *) handle)->next;
   }
@@ -361,19 +1655,20 @@ static void km_io_uart_run() {
 
 /* IEEE80211 functions */
 #ifdef KALUMA_MODULE_IEEE80211
-void km_io_ieee80211_init(km_io_ieee80211_handle_t *ieee80211) {
-  km_io_handle_init((km_io_handle_t *) ieee80211, KM_IO_IEEE80211);
+bool km_io_ieee80211_init(km_io_ieee80211_handle_t *ieee80211) {
+  return km_io_handle_init((km_io_handle_t *) ieee80211, KM_IO_IEEE80211);
 }
 
 km_io_ieee80211_handle_t *km_io_ieee80211_get_by_id(uint32_t id) {
-  return (km_io_ieee80211_handle_t *) km_io_handle_get_by_id(id, &loop.ieee80211_handles);
+  return (km_io_ieee80211_handle_t *) km_io_handle_get_by_id(id, KM_IO_IEEE80211);
 }
 
 void km_io_ieee80211_cleanup() {
   km_io_ieee80211_handle_t *handle = (km_io_ieee80211_handle_t *) loop.ieee80211_handles.head;
   while (handle != NULL) {
     km_io_ieee80211_handle_t *next = (km_io_ieee80211_handle_t *) ((km_list_node_t *) handle)->next;
-    free(handle);
+    km_io_handle_table_remove((km_io_handle_t *) handle);
+    km_io_handle_free((km_io_handle_t *) handle);
     handle = next;
   }
   km_list_init(&loop.ieee80211_handles);
@@ -411,6 +1706,7 @@ static void km_io_ieee80211_run() {
           case KM_IEEE80211_EVENT_SCAN:
             if ( handle->scan_cb != NULL )
             {
+              KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_IEEE80211);
               handle->scan_cb(handle, message.scan.count, message.scan.records);
             }
             free(message.scan.records);
@@ -418,18 +1714,21 @@ static void km_io_ieee80211_run() {
           case KM_IEEE80211_EVENT_ASSOC:
             if ( handle->assoc_cb != NULL )
             {
+              KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_IEEE80211);
               handle->assoc_cb(handle);
             }
             break;
           case KM_IEEE80211_EVENT_CONNECT:
             if ( handle->connect_cb != NULL )
             {
+              KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_IEEE80211);
               handle->connect_cb(handle);
             }
             break;
           case KM_IEEE80211_EVENT_DISCONNECT:
             if ( handle->disconnect_cb != NULL )
             {
+              KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_IEEE80211);
               handle->disconnect_cb(handle);
             }
             break;
@@ -445,9 +1744,9 @@ static void km_io_ieee80211_run() {
 #ifdef KALUMA_MODULE_TCP
 #include <esp_log.h>
 
-void km_io_tcp_init(km_io_tcp_handle_t *tcp) {
+bool km_io_tcp_init(km_io_tcp_handle_t *tcp) {
     ESP_LOGI("io", "km_io_tcp_init");
-    km_io_handle_init((km_io_handle_t *) tcp, KM_IO_TCP);
+    return km_io_handle_init((km_io_handle_t *) tcp, KM_IO_TCP);
 }
 
 km_io_tcp_handle_t *km_io_tcp_get_by_fd(int fd) {
@@ -467,7 +1766,8 @@ void km_io_tcp_cleanup() {
     km_io_tcp_handle_t *handle = (km_io_tcp_handle_t *) loop.tcp_handles.head;
     while (handle != NULL) {
         km_io_tcp_handle_t *next = (km_io_tcp_handle_t *) ((km_list_node_t *) handle)->next;
-        free(handle);
+        km_io_handle_table_remove((km_io_handle_t *) handle);
+        km_io_handle_free((km_io_handle_t *) handle);
         handle = next;
     }
     km_list_init(&loop.tcp_handles);
@@ -521,18 +1821,21 @@ static void km_io_tcp_run() {
                     case KM_TCP_EVENT_CONNECT:
                         ESP_LOGI("io", "km_io_tcp_run KM_TCP_EVENT_CONNECT");
                         if (handle->connect_cb != NULL) {
+                            KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_TCP);
                             handle->connect_cb(handle);
                         }
                         break;
                     case KM_TCP_EVENT_DISCONNECT:
                         ESP_LOGI("io", "km_io_tcp_run KM_TCP_EVENT_DISCONNECT");
                         if (handle->disconnect_cb != NULL) {
+                            KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_TCP);
                             handle->disconnect_cb(handle);
                         }
                         break;
                     case KM_TCP_EVENT_READ:
                         ESP_LOGI("io", "km_io_tcp_run KM_TCP_EVENT_READ");
                         if (handle->read_cb != NULL) {
+                            KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_TCP);
                             handle->read_cb(handle, message.read.message, message.read.len);
                             free(message.read.message);
                         }
@@ -547,6 +1850,344 @@ static void km_io_tcp_run() {
 
 #endif//KALUMA_MODULE_TCP
 
+/* poll functions */
+#ifdef KALUMA_IO_POLL
+
+#define KM_IO_POLL_EVENTS_MAX 16
+
+void km_io_poll_init(km_io_poll_handle_t *poll) {
+  km_io_handle_init((km_io_handle_t *) poll, KM_IO_POLL);
+  poll->poll_cb = NULL;
+  poll->poll_js_cb = 0;
+  poll->fd = -1;
+  poll->events = 0;
+}
+
+/**
+ * Start to watch the events of the file descriptor. Returns -1 if the
+ * descriptor can not be watched.
+ */
+int km_io_poll_start(km_io_poll_handle_t *poll, int fd, uint8_t events, km_io_poll_cb poll_cb) {
+  if (km_poll_add(fd, events, poll->base.id) < 0) {
+    return -1;
+  }
+  KM_IO_SET_FLAG_ON(poll->base.flags, KM_IO_FLAG_ACTIVE);
+  poll->poll_cb = poll_cb;
+  poll->fd = fd;
+  poll->events = events;
+  km_list_append(&loop.poll_handles, (km_list_node_t *) poll);
+  return 0;
+}
+
+int km_io_poll_update(km_io_poll_handle_t *poll, uint8_t events) {
+  if (km_poll_modify(poll->fd, events, poll->base.id) < 0) {
+    return -1;
+  }
+  poll->events = events;
+  return 0;
+}
+
+void km_io_poll_stop(km_io_poll_handle_t *poll) {
+  if (KM_IO_HAS_FLAG(poll->base.flags, KM_IO_FLAG_ACTIVE)) {
+    km_poll_remove(poll->fd);
+    KM_IO_SET_FLAG_OFF(poll->base.flags, KM_IO_FLAG_ACTIVE);
+    km_list_remove(&loop.poll_handles, (km_list_node_t *) poll);
+  }
+}
+
+km_io_poll_handle_t *km_io_poll_get_by_id(uint32_t id) {
+  return (km_io_poll_handle_t *) km_io_handle_get_by_id(id, KM_IO_POLL);
+}
+
+void km_io_poll_cleanup() {
+  km_io_poll_handle_t *handle = (km_io_poll_handle_t *) loop.poll_handles.head;
+  while (handle != NULL) {
+    km_io_poll_handle_t *next = (km_io_poll_handle_t *) ((km_list_node_t *) handle)->next;
+    km_poll_remove(handle->fd);
+    km_io_handle_table_remove((km_io_handle_t *) handle);
+    km_io_handle_free((km_io_handle_t *) handle);
+    handle = next;
+  }
+  km_list_init(&loop.poll_handles);
+}
+
+/**
+ * Dispatch the events collected by the wait. The handles are looked up by
+ * id, so the events of the handles stopped in the meantime are dropped.
+ */
+static void km_io_poll_run() {
+  if (loop.poll_handles.head == NULL) {
+    return;
+  }
+  km_poll_event_t events[KM_IO_POLL_EVENTS_MAX];
+  int n;
+  do {
+    n = km_poll_events(events, KM_IO_POLL_EVENTS_MAX);
+    for (int i = 0; i < n; i++) {
+      km_io_poll_handle_t *handle = km_io_poll_get_by_id(events[i].id);
+      if (handle != NULL && handle->poll_cb != NULL) {
+        if (io_budget_exhausted()) {
+          /* the wait is level-triggered, so the dropped events come again */
+          return;
+        }
+        KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_POLL);
+        handle->poll_cb(handle, events[i].events & (handle->events | KM_POLL_ERROR));
+      }
+    }
+  } while (n == KM_IO_POLL_EVENTS_MAX);
+}
+
+#endif//KALUMA_IO_POLL
+
+/* work functions */
+
+void km_io_work_init(km_io_work_handle_t *work) {
+  km_io_handle_init((km_io_handle_t *) work, KM_IO_WORK);
+  work->work_cb = NULL;
+  work->after_work_cb = NULL;
+  work->cleanup_cb = NULL;
+  work->work_js_cb = 0;
+  work->data = NULL;
+  work->slot = KM_IO_WORK_NO_SLOT;
+}
+
+static void km_io_work_call(void *arg) {
+  km_io_work_handle_t *work = (km_io_work_handle_t *) arg;
+  work->work_cb(work);
+}
+
+/**
+ * Pass the queued works to the workers while there are free slots. The
+ * works are passed in the order of queueing.
+ */
+static void km_io_work_dispatch() {
+  km_io_work_handle_t *handle = (km_io_work_handle_t *) loop.work_handles.head;
+  while (handle != NULL && work_slots != 0xFFFFFFFF) {
+    if (handle->slot == KM_IO_WORK_NO_SLOT) {
+      uint8_t slot = 0;
+      while (work_slots & (1u << slot)) {
+        slot++;
+      }
+      if (km_worker_queue(slot, km_io_work_call, handle) < 0) {
+        return; /* try again in the next work phase */
+      }
+      work_slots |= (1u << slot);
+      handle->slot = slot;
+    }
+    handle = (km_io_work_handle_t *) ((km_list_node_t *) handle)->next;
+  }
+}
+
+/**
+ * Queue a work. The work_cb is called on a worker (or in the work phase if
+ * the port has no workers), and then the after_work_cb is called in the
+ * work phase. The handle is inactive in the after_work_cb, so it may be
+ * closed or queued again.
+ */
+void km_io_work_queue(km_io_work_handle_t *work, km_io_work_cb work_cb, km_io_after_work_cb after_work_cb) {
+  KM_IO_SET_FLAG_ON(work->base.flags, KM_IO_FLAG_ACTIVE);
+  work->work_cb = work_cb;
+  work->after_work_cb = after_work_cb;
+  work->slot = KM_IO_WORK_NO_SLOT;
+  km_list_append(&loop.work_handles, (km_list_node_t *) work);
+  if (work_workers > 0) {
+    km_io_work_dispatch();
+  }
+}
+
+km_io_work_handle_t *km_io_work_get_by_id(uint32_t id) {
+  return (km_io_work_handle_t *) km_io_handle_get_by_id(id, KM_IO_WORK);
+}
+
+/**
+ * Wait for the running works and free all the work handles with their data
+ * without calling after_work_cb. cleanup_cb frees what the works left in
+ * their data.
+ */
+void km_io_work_cleanup() {
+  km_worker_cleanup();
+  /* drop the completions made after the last drain, which would
+     otherwise mark the slots of the next works as done */
+  km_worker_take_done();
+  work_done = 0;
+  km_io_work_handle_t *handle = (km_io_work_handle_t *) loop.work_handles.head;
+  while (handle != NULL) {
+    km_io_work_handle_t *next = (km_io_work_handle_t *) ((km_list_node_t *) handle)->next;
+    if (handle->cleanup_cb) {
+      handle->cleanup_cb(handle);
+    }
+    if (handle->data != NULL) {
+      km_free(handle->data);
+    }
+    km_io_handle_table_remove((km_io_handle_t *) handle);
+    km_io_handle_free((km_io_handle_t *) handle);
+    handle = next;
+  }
+  km_list_init(&loop.work_handles);
+  work_slots = 0;
+}
+
+static void km_io_work_done(km_io_work_handle_t *handle) {
+  if (handle->slot != KM_IO_WORK_NO_SLOT) {
+    work_slots &= ~(1u << handle->slot);
+    handle->slot = KM_IO_WORK_NO_SLOT;
+  }
+  km_list_remove(&loop.work_handles, (km_list_node_t *) handle);
+  KM_IO_SET_FLAG_OFF(handle->base.flags, KM_IO_FLAG_ACTIVE);
+  if (handle->after_work_cb) {
+    KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_WORK);
+    handle->after_work_cb(handle);
+  }
+}
+
+static void km_io_work_run() {
+  if (work_workers == 0) {
+    /* run the works queued before this phase on the loop */
+    km_io_work_handle_t *last = (km_io_work_handle_t *) loop.work_handles.tail;
+    while (loop.work_handles.head != NULL) {
+      if (io_budget_exhausted()) {
+        return;
+      }
+      km_io_work_handle_t *handle = (km_io_work_handle_t *) loop.work_handles.head;
+      handle->work_cb(handle);
+      km_io_work_done(handle);
+      if (handle == last) {
+        break;
+      }
+    }
+    return;
+  }
+  uint32_t done = work_done;
+  work_done = 0;
+  km_io_work_handle_t *handle = (km_io_work_handle_t *) loop.work_handles.head;
+  while (handle != NULL && done != 0) {
+    km_io_work_handle_t *next = (km_io_work_handle_t *) ((km_list_node_t *) handle)->next;
+    if (handle->slot != KM_IO_WORK_NO_SLOT && (done & (1u << handle->slot))) {
+      if (io_budget_exhausted()) {
+        /* complete the remaining works in the next iteration */
+        work_done |= done;
+        break;
+      }
+      done &= ~(1u << handle->slot);
+      km_io_work_done(handle);
+    }
+    handle = next;
+  }
+  km_io_work_dispatch();
+}
+
+/* immediate functions */
+
+void km_io_immediate_init(km_io_immediate_handle_t *immediate) {
+  km_io_handle_init((km_io_handle_t *) immediate, KM_IO_IMMEDIATE);
+  immediate->immediate_cb = NULL;
+  immediate->immediate_js_cb = 0;
+  immediate->seq = 0;
+  immediate->tick = false;
+}
+
+/**
+ * Queue the handle to be called once in the immediate phase. Handles queued
+ * while the phase is running are called in the next iteration.
+ */
+void km_io_immediate_start(km_io_immediate_handle_t *immediate, km_io_immediate_cb immediate_cb) {
+  KM_IO_SET_FLAG_ON(immediate->base.flags, KM_IO_FLAG_ACTIVE);
+  immediate->immediate_cb = immediate_cb;
+  immediate->seq = loop.immediate_seq++;
+  immediate->tick = false;
+  km_list_append(&loop.immediate_handles, (km_list_node_t *) immediate);
+}
+
+/**
+ * Queue the handle to be called right after the current callback (or at the
+ * end of the current phase), before any other I/O callback.
+ */
+void km_io_immediate_tick(km_io_immediate_handle_t *immediate, km_io_immediate_cb immediate_cb) {
+  KM_IO_SET_FLAG_ON(immediate->base.flags, KM_IO_FLAG_ACTIVE);
+  immediate->immediate_cb = immediate_cb;
+  immediate->tick = true;
+  km_list_append(&loop.tick_handles, (km_list_node_t *) immediate);
+}
+
+void km_io_immediate_stop(km_io_immediate_handle_t *immediate) {
+  if (KM_IO_HAS_FLAG(immediate->base.flags, KM_IO_FLAG_ACTIVE)) {
+    KM_IO_SET_FLAG_OFF(immediate->base.flags, KM_IO_FLAG_ACTIVE);
+    km_list_remove(immediate->tick ? &loop.tick_handles : &loop.immediate_handles, (km_list_node_t *) immediate);
+  }
+}
+
+km_io_immediate_handle_t *km_io_immediate_get_by_id(uint32_t id) {
+  return (km_io_immediate_handle_t *) km_io_handle_get_by_id(id, KM_IO_IMMEDIATE);
+}
+
+static void km_io_immediate_free_list(km_list_t *list) {
+  km_io_immediate_handle_t *handle = (km_io_immediate_handle_t *) list->head;
+  while (handle != NULL) {
+    km_io_immediate_handle_t *next = (km_io_immediate_handle_t *) ((km_list_node_t *) handle)->next;
+    km_io_handle_table_remove((km_io_handle_t *) handle);
+    km_io_handle_free((km_io_handle_t *) handle);
+    handle = next;
+  }
+  km_list_init(list);
+}
+
+void km_io_immediate_cleanup() {
+  km_io_immediate_free_list(&loop.immediate_handles);
+  km_io_immediate_free_list(&loop.tick_handles);
+}
+
+/**
+ * Dequeue the head of the list and call it. The handle is inactive in the
+ * callback, so it may be closed or queued again.
+ */
+static void km_io_immediate_call(km_list_t *list, km_io_phase_t phase) {
+  km_io_immediate_handle_t *handle = (km_io_immediate_handle_t *) list->head;
+  if (loop.realtime_count > 0 && !loop.in_realtime) {
+    io_run_realtime();
+    if (list->head != (km_list_node_t *) handle) {
+      return; /* changed by a realtime callback, let the caller recheck */
+    }
+  }
+  km_list_remove(list, (km_list_node_t *) handle);
+  KM_IO_SET_FLAG_OFF(handle->base.flags, KM_IO_FLAG_ACTIVE);
+  if (handle->immediate_cb) {
+    loop.stats.phases[phase].callbacks++;
+    loop.dispatched++;
+    if (!loop.in_realtime) {
+      loop.iteration_callbacks++;
+      loop.phase_callbacks++;
+    }
+    handle->immediate_cb(handle);
+  }
+}
+
+/**
+ * Run all queued ticks including the ones queued by the ticks themselves
+ */
+static void km_io_immediate_run_ticks(km_io_phase_t phase) {
+  while (loop.tick_handles.head != NULL) {
+    km_io_immediate_call(&loop.tick_handles, phase);
+  }
+}
+
+static void km_io_immediate_run() {
+  uint32_t end = loop.immediate_seq;
+  while (loop.immediate_handles.head != NULL) {
+    km_io_immediate_handle_t *handle = (km_io_immediate_handle_t *) loop.immediate_handles.head;
+    if ((int32_t) (handle->seq - end) >= 0) {
+      break; /* queued in this phase */
+    }
+    if (io_budget_exhausted()) {
+      break;
+    }
+    if (loop.tick_handles.head != NULL) {
+      km_io_immediate_run_ticks(KM_IO_PHASE_IMMEDIATE);
+      continue; /* a tick may have cleared the head */
+    }
+    km_io_immediate_call(&loop.immediate_handles, KM_IO_PHASE_IMMEDIATE);
+  }
+}
+
 /* idle functions */
 
 void km_io_idle_init(km_io_idle_handle_t *idle) {
@@ -566,14 +2207,15 @@ void km_io_idle_stop(km_io_idle_handle_t *idle) {
 }
 
 km_io_idle_handle_t *km_io_idle_get_by_id(uint32_t id) {
-  return (km_io_idle_handle_t *) km_io_handle_get_by_id(id, &loop.idle_handles);
+  return (km_io_idle_handle_t *) km_io_handle_get_by_id(id, KM_IO_IDLE);
 }
 
 void km_io_idle_cleanup() {
   km_io_idle_handle_t *handle = (km_io_idle_handle_t *) loop.idle_handles.head;
   while (handle != NULL) {
     km_io_idle_handle_t *next = (km_io_idle_handle_t *) ((km_list_node_t *) handle)->next;
-    free(handle);
+    km_io_handle_table_remove((km_io_handle_t *) handle);
+    km_io_handle_free((km_io_handle_t *) handle);
     handle = next;
   }
   km_list_init(&loop.idle_handles);
@@ -584,6 +2226,7 @@ static void km_io_idle_run() {
   while (handle != NULL) {
     if (KM_IO_HAS_FLAG(handle->base.flags, KM_IO_FLAG_ACTIVE)) {
       if (handle->idle_cb) {
+        KM_IO_BEFORE_CALLBACK(KM_IO_PHASE_IDLE);
         handle->idle_cb(handle);
       }
     }
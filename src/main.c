@@ -28,11 +28,16 @@
 
 int main(void) {
   bool load = false;
+  km_boot_trace_reset(); /* the clock may start in km_system_init() */
   km_system_init();
+  km_boot_trace("system");
   load = km_running_script_check();
   km_tty_init();
+  km_boot_trace("tty");
   io_init();
+  km_boot_trace("io");
   km_repl_init();
+  km_boot_trace("repl");
   km_runtime_init(load, true);
   io_run();
 }
@@ -0,0 +1,67 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <malloc.h>
+#include <string.h>
+#include "jerryscript.h"
+#include "memstats.h"
+
+static bool count_object_cb(const jerry_value_t object, void *user_data_p) {
+  km_memstats_t *stats = (km_memstats_t *) user_data_p;
+  stats->objects++;
+  if (jerry_value_is_function(object)) {
+    stats->functions++;
+  } else if (jerry_value_is_array(object)) {
+    stats->arrays++;
+  } else if (jerry_value_is_typedarray(object)) {
+    stats->typed_arrays++;
+  } else if (jerry_value_is_arraybuffer(object)) {
+    stats->array_buffers++;
+    stats->array_buffer_bytes += jerry_get_arraybuffer_byte_length(object);
+  } else if (jerry_value_is_promise(object)) {
+    stats->promises++;
+  }
+  return true;
+}
+
+/**
+ * Get the memory usage. The live objects are counted by walking the JS
+ * heap, which takes time in proportion to the number of the objects.
+ */
+void km_memstats_get(km_memstats_t *stats) {
+  memset(stats, 0, sizeof(km_memstats_t));
+  jerry_heap_stats_t heap = {0};
+  if (jerry_get_memory_stats(&heap)) {
+    stats->heap_size = heap.size;
+    stats->heap_used = heap.allocated_bytes;
+    stats->heap_peak = heap.peak_allocated_bytes;
+  }
+  jerry_objects_foreach(count_object_cb, stats);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 mi = mallinfo2();
+#else
+  struct mallinfo mi = mallinfo();
+#endif
+  stats->native_size = mi.arena;
+  stats->native_used = mi.uordblks;
+  stats->native_free = mi.fordblks;
+  km_memtags_get(stats);
+}
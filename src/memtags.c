@@ -0,0 +1,159 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memstats.h"
+#include "tlsf.h"
+
+/**
+ * Header of the tagged allocation, padded to keep the pointer aligned as
+ * the allocator does (max_align_t for malloc, 8 bytes for the TLSF arena)
+ */
+typedef union {
+  struct {
+    uint32_t size;
+    uint32_t tag;
+  };
+#ifdef KALUMA_TLSF
+  uint8_t align[KM_TLSF_ALIGN];
+#else
+  max_align_t align;
+#endif
+} km_mem_header_t;
+
+static km_mem_tag_stats_t tag_stats[KM_MEM_TAGS];
+
+#ifdef KALUMA_TLSF
+
+/**
+ * Native allocations are made in constant time from the arena, and from
+ * the system heap only when the arena is full.
+ */
+static uint8_t tlsf_arena[KALUMA_TLSF_ARENA_SIZE] __attribute__((aligned(KM_TLSF_ALIGN)));
+static km_tlsf_t tlsf;
+static bool tlsf_ready = false;
+static uint32_t tlsf_fallbacks = 0;
+
+static void *mem_alloc(size_t size) {
+  if (!tlsf_ready) {
+    tlsf_ready = km_tlsf_init(&tlsf, tlsf_arena, sizeof(tlsf_arena));
+  }
+  void *ptr = tlsf_ready ? km_tlsf_malloc(&tlsf, size) : NULL;
+  if (ptr == NULL) {
+    ptr = malloc(size);
+    if (ptr != NULL) {
+      tlsf_fallbacks++;
+    }
+  }
+  return ptr;
+}
+
+static void mem_free(void *ptr) {
+  if (tlsf_ready && km_tlsf_owns(&tlsf, ptr)) {
+    km_tlsf_free(&tlsf, ptr);
+  } else {
+    free(ptr);
+  }
+}
+
+#else
+
+#define mem_alloc malloc
+#define mem_free free
+
+#endif /* KALUMA_TLSF */
+
+static const char *tag_names[KM_MEM_TAGS] = {
+  "core", "uart", "i2c", "spi", "storage", "flash", "graphics", "net", "wifi"
+};
+
+const char *km_mem_tag_name(km_mem_tag_t tag) {
+  return tag_names[tag];
+}
+
+/**
+ * Allocate memory of the tag. Returns NULL if out of memory.
+ */
+void *km_malloc(km_mem_tag_t tag, size_t size) {
+  km_mem_header_t *header = (km_mem_header_t *) mem_alloc(sizeof(km_mem_header_t) + size);
+  if (header == NULL) {
+    return NULL;
+  }
+  header->size = size;
+  header->tag = tag;
+  km_mem_tag_stats_t *stats = &tag_stats[tag];
+  stats->current += size;
+  if (stats->current > stats->peak) {
+    stats->peak = stats->current;
+  }
+  stats->blocks++;
+  stats->allocs++;
+  return header + 1;
+}
+
+/**
+ * Allocate zero-filled memory of the tag. Returns NULL if out of memory.
+ */
+void *km_calloc(km_mem_tag_t tag, size_t count, size_t size) {
+  if (size != 0 && count > SIZE_MAX / size) {
+    return NULL;
+  }
+  void *ptr = km_malloc(tag, count * size);
+  if (ptr != NULL) {
+    memset(ptr, 0, count * size);
+  }
+  return ptr;
+}
+
+/**
+ * Free memory allocated by km_malloc() or km_calloc()
+ */
+void km_free(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  km_mem_header_t *header = (km_mem_header_t *) ptr - 1;
+  km_mem_tag_stats_t *stats = &tag_stats[header->tag];
+  stats->current -= header->size;
+  stats->blocks--;
+  mem_free(header);
+}
+
+/**
+ * Get the stats of the tagged allocations (and of the TLSF arena)
+ */
+void km_memtags_get(km_memstats_t *stats) {
+  memcpy(stats->tags, tag_stats, sizeof(tag_stats));
+#ifdef KALUMA_TLSF
+  if (tlsf_ready) {
+    km_tlsf_stats_t tlsf_stats;
+    km_tlsf_stats(&tlsf, &tlsf_stats);
+    stats->tlsf_size = tlsf_stats.size;
+    stats->tlsf_used = tlsf_stats.used;
+    stats->tlsf_free = tlsf_stats.free;
+    stats->tlsf_free_blocks = tlsf_stats.free_blocks;
+    stats->tlsf_largest_free = tlsf_stats.largest_free;
+    stats->tlsf_fallbacks = tlsf_fallbacks;
+  }
+#endif
+}
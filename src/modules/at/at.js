@@ -287,9 +287,9 @@ class ATCommand extends EventEmitter {
    */
   next() {
     this.job = null;
-    setTimeout(() => {
+    setImmediate(() => {
       this.processJobs()
-    }, 10)
+    })
   }  
 }
 
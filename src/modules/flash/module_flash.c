@@ -0,0 +1,212 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "jerryscript.h"
+#include "jerryxx.h"
+#include "flash_magic_strings.h"
+#include "flash.h"
+#include "memstats.h"
+#include "io.h"
+#include "runtime.h"
+
+/**
+ * Data of the flash work. The data to program follows the struct.
+ */
+typedef struct {
+  bool clear; // clear only
+  km_flash_status_t status;
+  uint32_t size;
+  uint8_t buf[];
+} flash_work_t;
+
+static void flash_work_close_cb(km_io_handle_t *handle) {
+  km_io_work_handle_t *work = (km_io_work_handle_t *) handle;
+  km_free(work->data);
+  km_io_handle_free(handle);
+}
+
+/**
+ * Replace the user code in the flash with the data (same as .flash -w)
+ */
+static km_flash_status_t flash_program(uint8_t *buf, uint32_t size) {
+  km_flash_program_begin();
+  km_flash_status_t status = km_flash_program(buf, size);
+  km_flash_program_end();
+  return status;
+}
+
+static void flash_work_cb(km_io_work_handle_t *work) {
+  flash_work_t *data = (flash_work_t *) work->data;
+  if (data->clear) {
+    km_flash_clear();
+    data->status = KM_FLASH_SUCCESS;
+  } else {
+    data->status = flash_program(data->buf, data->size);
+  }
+}
+
+static void flash_after_work_cb(km_io_work_handle_t *work) {
+  flash_work_t *data = (flash_work_t *) work->data;
+  jerry_value_t callback = work->work_js_cb;
+  jerry_value_t err = jerry_create_null();
+  if (data->status != KM_FLASH_SUCCESS) {
+    /* pass the error object as an argument */
+    jerry_value_t error = JERRYXX_CREATE_ERROR("Failed to program flash.");
+    err = jerry_get_value_from_error(error, true);
+  }
+  km_io_handle_close((km_io_handle_t *) work, flash_work_close_cb);
+  jerry_value_t this_val = jerry_create_undefined();
+  jerry_value_t ret_val = jerry_call_function(callback, this_val, &err, 1);
+  if (jerry_value_is_error(ret_val)) {
+    jerryxx_print_error(ret_val, true);
+  }
+  jerry_release_value(ret_val);
+  jerry_release_value(this_val);
+  jerry_release_value(err);
+  jerry_release_value(callback);
+}
+
+/**
+ * Queue the flash work running on a worker
+ */
+static jerry_value_t flash_queue_work(bool clear, uint8_t *buf, uint32_t size, jerry_value_t callback) {
+  flash_work_t *data = (flash_work_t *) km_malloc(KM_MEM_FLASH, sizeof(flash_work_t) + size);
+  if (data == NULL) {
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
+  km_io_work_handle_t *work = (km_io_work_handle_t *) km_io_handle_alloc(KM_IO_WORK);
+  if (work == NULL) {
+    km_free(data);
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
+  data->clear = clear;
+  data->status = KM_FLASH_FAIL;
+  data->size = size;
+  if (size > 0) {
+    memcpy(data->buf, buf, size);
+  }
+  km_io_work_init(work);
+  work->work_js_cb = jerry_acquire_value(callback);
+  work->data = data;
+  km_io_work_queue(work, flash_work_cb, flash_after_work_cb);
+  return jerry_create_undefined();
+}
+
+/**
+ * exports.size function
+ */
+JERRYXX_FUN(flash_size_fn) {
+  return jerry_create_number(km_flash_size());
+}
+
+/**
+ * exports.getDataSize function
+ */
+JERRYXX_FUN(flash_get_data_size_fn) {
+  return jerry_create_number(km_flash_get_data_size());
+}
+
+/**
+ * exports.getChecksum function
+ */
+JERRYXX_FUN(flash_get_checksum_fn) {
+  return jerry_create_number(km_flash_get_checksum());
+}
+
+/**
+ * exports.clear([callback]) function. With a callback, the flash is
+ * erased on a worker.
+ */
+JERRYXX_FUN(flash_clear_fn) {
+  JERRYXX_CHECK_ARG_FUNCTION_OPT(0, "callback")
+  if (km_runtime_in_place()) {
+    return JERRYXX_CREATE_ERROR("The user code is running in place.");
+  }
+  if (JERRYXX_HAS_ARG(0)) {
+    return flash_queue_work(true, NULL, 0, JERRYXX_GET_ARG(0));
+  }
+  km_flash_clear();
+  return jerry_create_undefined();
+}
+
+/**
+ * exports.program(data[, callback]) function. Replace the user code with
+ * the data (Uint8Array or string). With a callback, the flash is programmed
+ * on a worker and the callback is called with an error or null.
+ */
+JERRYXX_FUN(flash_program_fn) {
+  JERRYXX_CHECK_ARG(0, "data")
+  JERRYXX_CHECK_ARG_FUNCTION_OPT(1, "callback")
+  if (km_runtime_in_place()) {
+    return JERRYXX_CREATE_ERROR("The user code is running in place.");
+  }
+  jerry_value_t data = JERRYXX_GET_ARG(0);
+  jerry_value_t ret;
+  if (jerry_value_is_typedarray(data) &&
+      jerry_get_typedarray_type(data) == JERRY_TYPEDARRAY_UINT8) { /* Uint8Array */
+    jerry_length_t byteLength = 0;
+    jerry_length_t byteOffset = 0;
+    jerry_value_t array_buffer = jerry_get_typedarray_buffer(data, &byteOffset, &byteLength);
+    uint8_t *buf = jerry_get_arraybuffer_pointer(array_buffer) + byteOffset;
+    if (JERRYXX_HAS_ARG(1)) {
+      ret = flash_queue_work(false, buf, byteLength, JERRYXX_GET_ARG(1));
+    } else if (flash_program(buf, byteLength) == KM_FLASH_SUCCESS) {
+      ret = jerry_create_undefined();
+    } else {
+      ret = JERRYXX_CREATE_ERROR("Failed to program flash.");
+    }
+    jerry_release_value(array_buffer);
+  } else if (jerry_value_is_string(data)) { /* for string */
+    jerry_size_t len = jerry_get_string_size(data);
+    uint8_t *buf = (uint8_t *) km_malloc(KM_MEM_FLASH, len);
+    if (buf == NULL && len > 0) {
+      return JERRYXX_CREATE_ERROR("Out of memory.");
+    }
+    jerry_string_to_char_buffer(data, buf, len);
+    if (JERRYXX_HAS_ARG(1)) {
+      ret = flash_queue_work(false, buf, len, JERRYXX_GET_ARG(1));
+    } else if (flash_program(buf, len) == KM_FLASH_SUCCESS) {
+      ret = jerry_create_undefined();
+    } else {
+      ret = JERRYXX_CREATE_ERROR("Failed to program flash.");
+    }
+    km_free(buf);
+  } else {
+    return jerry_create_error(JERRY_ERROR_TYPE, (const jerry_char_t *) "The data argument must be Uint8Array or string.");
+  }
+  return ret;
+}
+
+/**
+ * Initialize 'flash' module and return exports
+ */
+jerry_value_t module_flash_init() {
+  /* flash module exports */
+  jerry_value_t exports = jerry_create_object();
+  jerryxx_set_property_function(exports, MSTR_FLASH_SIZE, flash_size_fn);
+  jerryxx_set_property_function(exports, MSTR_FLASH_GET_DATA_SIZE, flash_get_data_size_fn);
+  jerryxx_set_property_function(exports, MSTR_FLASH_GET_CHECKSUM, flash_get_checksum_fn);
+  jerryxx_set_property_function(exports, MSTR_FLASH_CLEAR, flash_clear_fn);
+  jerryxx_set_property_function(exports, MSTR_FLASH_PROGRAM, flash_program_fn);
+  return exports;
+}
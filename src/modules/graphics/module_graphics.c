@@ -30,11 +30,12 @@
 #include "gc_1bit_prims.h"
 #include "gc_16bit_prims.h"
 #include "font.h"
+#include "memstats.h"
 
 gc_font_t custom_font;
 
 static void gc_handle_freecb (void *handle) {
-  free (handle);
+  km_free (handle);
 }
 
 static const jerry_object_native_info_t gc_handle_info = {
@@ -62,7 +63,7 @@ JERRYXX_FUN(gc_ctor_fn) {
   JERRYXX_CHECK_ARG_OBJECT_OPT(2, "options");
 
   // set native handle
-  gc_handle_t *gc_handle = (gc_handle_t *) malloc(sizeof (gc_handle_t));
+  gc_handle_t *gc_handle = (gc_handle_t *) km_malloc(KM_MEM_GRAPHICS, sizeof (gc_handle_t));
   gc_handle->color = 1;
   gc_handle->fill_color = 1;
   gc_handle->font = NULL;
@@ -603,7 +604,7 @@ JERRYXX_FUN(buffered_gc_ctor_fn) {
   JERRYXX_CHECK_ARG_OBJECT_OPT(2, "options");
 
   // set native handle
-  gc_handle_t *gc_handle = (gc_handle_t *) malloc(sizeof (gc_handle_t));
+  gc_handle_t *gc_handle = (gc_handle_t *) km_malloc(KM_MEM_GRAPHICS, sizeof (gc_handle_t));
   gc_handle->color = 1;
   gc_handle->fill_color = 1;
   gc_handle->font = NULL;
@@ -24,12 +24,13 @@
 #include "jerryxx.h"
 #include "i2c_magic_strings.h"
 #include "i2c.h"
+#include "memstats.h"
 
 #define I2C_DEFAULT_MODE KM_I2C_MASTER
 #define I2C_DEFAULT_BAUDRATE 100000 // 100kbps
 
 static void buffer_free_cb(void *native_p) {
-  free(native_p);
+  km_free(native_p);
 }
 
 /**
@@ -179,7 +180,7 @@ JERRYXX_FUN(i2c_read_fn) {
   // read data with optional parameters (address, timeout)
   uint8_t address = 0;
   uint32_t timeout = 5000;
-  uint8_t *buf = malloc(length);
+  uint8_t *buf = km_malloc(KM_MEM_I2C, length);
   int ret = KM_I2CPORT_ERROR;
   if (i2cmode == KM_I2C_SLAVE) {
     JERRYXX_CHECK_ARG_NUMBER_OPT(1, "timeout");
@@ -195,7 +196,7 @@ JERRYXX_FUN(i2c_read_fn) {
 
   // return an Uint8Array
   if (ret == KM_I2CPORT_ERROR) {
-    free(buf);
+    km_free(buf);
     return jerry_create_error(JERRY_ERROR_REFERENCE, (const jerry_char_t *) "Failed to read data via I2C bus.");
   } else {
     jerry_value_t array_buffer = jerry_create_arraybuffer_external(length, buf,
@@ -278,7 +279,7 @@ JERRYXX_FUN(i2c_memread_fn) {
   uint16_t memAddress = (uint16_t) JERRYXX_GET_ARG_NUMBER(0);
   JERRYXX_CHECK_ARG_NUMBER(1, "length");
   jerry_length_t length = (jerry_length_t) JERRYXX_GET_ARG_NUMBER(1);
-  uint8_t *buf = malloc(length);
+  uint8_t *buf = km_malloc(KM_MEM_I2C, length);
 
   // check this.bus number
   jerry_value_t bus_value = jerryxx_get_property(JERRYXX_GET_THIS, MSTR_I2C_BUS);
@@ -303,7 +304,7 @@ JERRYXX_FUN(i2c_memread_fn) {
 
   // return an Uint8Array
   if (ret == KM_I2CPORT_ERROR) {
-    free(buf);
+    km_free(buf);
     return jerry_create_error(JERRY_ERROR_REFERENCE, (const jerry_char_t *) "Failed to read data via I2C bus.");
   } else {
     jerry_value_t array_buffer = jerry_create_arraybuffer_external(length, buf,
@@ -23,6 +23,7 @@
 #include "jerryxx.h"
 #include "net_magic_strings.h"
 #include "io.h"
+#include "memstats.h"
 #include <esp_log.h>
 #include <string.h>
 
@@ -215,8 +216,13 @@ JERRYXX_FUN(net_socket_fn) {
     jerryxx_set_property(obj, "raddr", undefined);
     jerryxx_set_property(obj, "rport", undefined);
 
-    km_io_tcp_handle_t *handle = malloc(sizeof(km_io_tcp_handle_t));
-    km_io_tcp_init(handle);
+    km_io_tcp_handle_t *handle = km_malloc(KM_MEM_NET, sizeof(km_io_tcp_handle_t));
+    if (handle == NULL || !km_io_tcp_init(handle)) {
+        km_free(handle);
+        jerry_release_value(obj);
+        km_tcp_close(fd);
+        return JERRYXX_CREATE_ERROR("Out of memory.");
+    }
     handle->this_val = jerry_acquire_value(obj);
     handle->fd = fd;
     km_io_tcp_start(handle, net_on_connect, net_on_disconnect, net_on_read);
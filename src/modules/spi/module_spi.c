@@ -24,13 +24,14 @@
 #include "jerryxx.h"
 #include "spi_magic_strings.h"
 #include "spi.h"
+#include "memstats.h"
 
 #define SPI_DEFAULT_MODE KM_SPI_MODE_0
 #define SPI_DEFAULT_BAUDRATE 3000000
 #define SPI_DEFAULT_BITORDER KM_SPI_BITORDER_MSB
 
 static void buffer_free_cb(void *native_p) {
-  free(native_p);
+  km_free(native_p);
 }
 
 /**
@@ -97,10 +98,10 @@ JERRYXX_FUN(spi_transfer_fn) {
     jerry_value_t array_buffer = jerry_get_typedarray_buffer(data, &byteOffset, &byteLength);
     size_t len = jerry_get_arraybuffer_byte_length(array_buffer);
     uint8_t *tx_buf = jerry_get_arraybuffer_pointer(array_buffer);
-    uint8_t *rx_buf = malloc(len);
+    uint8_t *rx_buf = km_malloc(KM_MEM_SPI, len);
     int ret = km_spi_sendrecv(bus, tx_buf, rx_buf, len, timeout);
     if (ret == KM_SPIPORT_ERROR) {
-      free(rx_buf);
+      km_free(rx_buf);
       return jerry_create_error(JERRY_ERROR_REFERENCE, (const jerry_char_t *) "Failed to transfer data via SPI bus.");
     } else {
       jerry_value_t buffer = jerry_create_arraybuffer_external(len, rx_buf,
@@ -114,11 +115,11 @@ JERRYXX_FUN(spi_transfer_fn) {
   } else if (jerry_value_is_string(data)) { /* for string */
     jerry_size_t len = jerryxx_get_ascii_string_size(data);
     uint8_t tx_buf[len];
-    uint8_t *rx_buf = malloc(len);
+    uint8_t *rx_buf = km_malloc(KM_MEM_SPI, len);
     jerryxx_string_to_ascii_char_buffer(data, tx_buf, len);
     int ret = km_spi_sendrecv(bus, tx_buf, rx_buf, len, timeout);
     if (ret == KM_SPIPORT_ERROR) {
-      free(rx_buf);
+      km_free(rx_buf);
       return jerry_create_error(JERRY_ERROR_REFERENCE, (const jerry_char_t *) "Failed to transfer data via SPI bus.");
     } else {
       jerry_value_t buffer = jerry_create_arraybuffer_external(len, rx_buf,
@@ -201,12 +202,12 @@ JERRYXX_FUN(spi_recv_fn) {
   jerry_release_value(bus_value);
 
   // recv data
-  uint8_t *buf = malloc(length);
+  uint8_t *buf = km_malloc(KM_MEM_SPI, length);
   int ret = km_spi_recv(bus, buf, length, timeout);
 
   // return an Uin8Array
   if (ret == KM_SPIPORT_ERROR) {
-    free(buf);
+    km_free(buf);
     return jerry_create_error(JERRY_ERROR_REFERENCE, (const jerry_char_t *) "Failed to receive data via SPI bus.");
   } else {
     jerry_value_t array_buffer = jerry_create_arraybuffer_external(length, buf,
@@ -13,17 +13,18 @@ Module.require = function (id) {
   if (Module.cache[id]) {
     return Module.cache[id].exports;
   }
-  if (process.builtin_modules.indexOf(id) >= 0) {
+  var fn = process.getBuiltinModule(id);
+  if (fn) {
     var mod = new Module(id);
-    mod.loadBuiltin();
+    mod.loadBuiltin(fn);
     Module.cache[id] = mod;
     return mod.exports;
   }
   throw new Error('Failed to load module: ' + id);
 }
 
-Module.prototype.loadBuiltin = function () {
-  var fn = process.getBuiltinModule(this.id);
+Module.prototype.loadBuiltin = function (fn) {
+  fn = fn || process.getBuiltinModule(this.id);
   fn(this.exports, Module.require, this);
 }
 
@@ -41,28 +42,51 @@ global.require = Module.require;
 global.SystemError = SystemError;
 
 /**
- * Storage object
+ * Process events (the methods of EventEmitter, loaded on the first use)
  */
 
-if (process.builtin_modules.indexOf('storage') > -1) {
-  var Storage = Module.require('storage').Storage;
-  global.storage = new Storage();
+if (process.builtin_modules.indexOf('events') > -1) {
+  ['on', 'off', 'once', 'addListener', 'removeListener', 'removeAllListeners',
+    'listeners', 'listenerCount', 'emit'].forEach(function (name) {
+    process[name] = function () {
+      if (!process._events) {
+        if (name === 'emit') {
+          return false;
+        }
+        process._events = {};
+      }
+      var proto = Module.require('events').EventEmitter.prototype;
+      return proto[name].apply(process, arguments);
+    };
+  });
 }
 
 /**
- * Board object
+ * Storage object (created on the first access)
  */
 
-if (process.builtin_modules.indexOf('gpio') > -1) {
-  board.gpio = function (pin, mode) {
-    var GPIO = Module.require('gpio');
-    return new GPIO(pin, mode);
-  }
-}
-
-if (process.builtin_modules.indexOf('led') > -1) {
-  board.led = function (pin) {
-    var LED = Module.require('led');
-    return new LED(pin);
-  }
+if (process.builtin_modules.indexOf('storage') > -1) {
+  Object.defineProperty(global, 'storage', {
+    configurable: true,
+    enumerable: true,
+    get: function () {
+      var Storage = Module.require('storage').Storage;
+      var storage = new Storage();
+      Object.defineProperty(global, 'storage', {
+        configurable: true,
+        enumerable: true,
+        writable: true,
+        value: storage
+      });
+      return storage;
+    },
+    set: function (value) {
+      Object.defineProperty(global, 'storage', {
+        configurable: true,
+        enumerable: true,
+        writable: true,
+        value: value
+      });
+    }
+  });
 }
@@ -20,10 +20,15 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "jerryscript.h"
 #include "jerryxx.h"
 #include "storage_magic_strings.h"
 #include "storage.h"
+#include "memstats.h"
+#include "io.h"
+
+#define STORAGE_BUFFER_SIZE 256
 
 /**
  * exports.setItem function
@@ -37,20 +42,120 @@ JERRYXX_FUN(storage_set_item_fn) {
   return jerry_create_number(res);
 }
 
+/**
+ * Set the item, and if a sweep is required, rewrite all the items to the
+ * cleared storage and set the item again (same as Storage.setItem() in
+ * storage.js).
+ */
+static int storage_set_item_with_sweep(const char *key, char *value) {
+  int res = km_storage_set_item(key, value);
+  if (res != KM_STORAGE_SWEEPREQ) {
+    return res;
+  }
+  int len = km_storage_length();
+  if (len < 0) {
+    return KM_STORAGE_ERROR;
+  }
+  /* plain malloc since this runs on a worker (km_malloc is for the loop) */
+  char *items = (char *) malloc(len * STORAGE_BUFFER_SIZE * 2);
+  if (items == NULL && len > 0) {
+    return KM_STORAGE_ERROR;
+  }
+  for (int i = 0; i < len; i++) {
+    char *k = items + (i * 2) * STORAGE_BUFFER_SIZE;
+    char *v = k + STORAGE_BUFFER_SIZE;
+    km_storage_key(i, k);
+    km_storage_get_item(k, v);
+  }
+  km_storage_clear();
+  for (int i = 0; i < len; i++) {
+    char *k = items + (i * 2) * STORAGE_BUFFER_SIZE;
+    km_storage_set_item(k, k + STORAGE_BUFFER_SIZE);
+  }
+  free(items);
+  return km_storage_set_item(key, value);
+}
+
+/**
+ * Data of the setItem work. The key and value strings follow the struct.
+ */
+typedef struct {
+  int res;
+  char *value;
+  char key[];
+} storage_work_t;
+
+static void storage_work_close_cb(km_io_handle_t *handle) {
+  km_io_work_handle_t *work = (km_io_work_handle_t *) handle;
+  km_free(work->data);
+  km_io_handle_free(handle);
+}
+
+static void storage_set_item_work_cb(km_io_work_handle_t *work) {
+  storage_work_t *data = (storage_work_t *) work->data;
+  data->res = storage_set_item_with_sweep(data->key, data->value);
+}
+
+static void storage_set_item_after_work_cb(km_io_work_handle_t *work) {
+  storage_work_t *data = (storage_work_t *) work->data;
+  jerry_value_t callback = work->work_js_cb;
+  jerry_value_t res = jerry_create_number(data->res);
+  km_io_handle_close((km_io_handle_t *) work, storage_work_close_cb);
+  jerry_value_t this_val = jerry_create_undefined();
+  jerry_value_t ret_val = jerry_call_function(callback, this_val, &res, 1);
+  if (jerry_value_is_error(ret_val)) {
+    jerryxx_print_error(ret_val, true);
+  }
+  jerry_release_value(ret_val);
+  jerry_release_value(this_val);
+  jerry_release_value(res);
+  jerry_release_value(callback);
+}
+
+/**
+ * exports.setItemAsync function. Writes the item on a worker and calls the
+ * callback with the result code of setItem.
+ */
+JERRYXX_FUN(storage_set_item_async_fn) {
+  JERRYXX_CHECK_ARG_STRING(0, "key")
+  JERRYXX_CHECK_ARG_STRING(1, "value")
+  JERRYXX_CHECK_ARG_FUNCTION(2, "callback")
+  JERRYXX_GET_ARG_STRING_AS_CHAR(0, key)
+  JERRYXX_GET_ARG_STRING_AS_CHAR(1, value)
+  storage_work_t *data = (storage_work_t *) km_malloc(KM_MEM_STORAGE, sizeof(storage_work_t) + key_sz + value_sz + 2);
+  if (data == NULL) {
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
+  km_io_work_handle_t *work = (km_io_work_handle_t *) km_io_handle_alloc(KM_IO_WORK);
+  if (work == NULL) {
+    km_free(data);
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
+  data->res = KM_STORAGE_ERROR;
+  memcpy(data->key, key, key_sz + 1);
+  data->value = data->key + key_sz + 1;
+  memcpy(data->value, value, value_sz + 1);
+  km_io_work_init(work);
+  work->work_js_cb = jerry_acquire_value(JERRYXX_GET_ARG(2));
+  work->data = data;
+  km_io_work_queue(work, storage_set_item_work_cb, storage_set_item_after_work_cb);
+  return jerry_create_undefined();
+}
+
 /**
  * exports.getItem function
  */
 JERRYXX_FUN(storage_get_item_fn) {
   JERRYXX_CHECK_ARG_STRING(0, "key")
   JERRYXX_GET_ARG_STRING_AS_CHAR(0, key)
-  char *buf = (char *)malloc(256);
+  char *buf = (char *)km_malloc(KM_MEM_STORAGE, STORAGE_BUFFER_SIZE);
   int res = km_storage_get_item(key, buf);
   if (res >= KM_STORAGE_OK) {
     jerry_value_t ret = jerry_create_string((const jerry_char_t *) buf);
-    free(buf);
+    km_free(buf);
     return ret;
   } else { // key not found
-    free(buf);
+    km_free(buf);
     return jerry_create_null();
   }
 }
@@ -99,14 +204,14 @@ JERRYXX_FUN(storage_length_fn) {
 JERRYXX_FUN(storage_key_fn) {
   JERRYXX_CHECK_ARG_NUMBER(0, "index")
   int index = (int) JERRYXX_GET_ARG_NUMBER(0);
-  char *buf = (char *)malloc(256);
+  char *buf = (char *)km_malloc(KM_MEM_STORAGE, STORAGE_BUFFER_SIZE);
   int res = km_storage_key(index, buf);
   if (res >= KM_STORAGE_OK) {
     jerry_value_t ret = jerry_create_string((const jerry_char_t *) buf);
-    free(buf);
+    km_free(buf);
     return ret;
   } else { // key not found
-    free(buf);
+    km_free(buf);
     return jerry_create_null();
   }
 }
@@ -118,6 +223,7 @@ jerry_value_t module_storage_init() {
   /* storage module exports */
   jerry_value_t exports = jerry_create_object();
   jerryxx_set_property_function(exports, MSTR_STORAGE_SET_ITEM, storage_set_item_fn);
+  jerryxx_set_property_function(exports, MSTR_STORAGE_SET_ITEM_ASYNC, storage_set_item_async_fn);
   jerryxx_set_property_function(exports, MSTR_STORAGE_GET_ITEM, storage_get_item_fn);
   jerryxx_set_property_function(exports, MSTR_STORAGE_REMOVE_ITEM, storage_remove_item_fn);
   jerryxx_set_property_function(exports, MSTR_STORAGE_CLEAR, storage_clear_fn);
@@ -1,7 +1,55 @@
 var storage_native = process.binding(process.binding.storage);
 
+/**
+ * Asynchronous writes run on a worker one by one. The other storage
+ * functions must not be called while a write is running.
+ */
+var writes = [];
+
+function runWrites () {
+  var w = writes[0];
+  try {
+    storage_native.setItemAsync(w.key, w.value, function (res) {
+      writes.shift();
+      if (writes.length > 0) {
+        runWrites();
+      }
+      if (res === -3) { // storage full
+        w.callback(new Error("Storage full"));
+      } else if (res === -4) { // over length
+        w.callback(new Error("The length of key and value is too long"));
+      } else if (res < 0) {
+        w.callback(new Error("Failed to write storage"));
+      } else {
+        w.callback(null);
+      }
+    });
+  } catch (err) {
+    // not started, so move on to the next write
+    writes.shift();
+    if (writes.length > 0) {
+      runWrites();
+    }
+    w.callback(err);
+  }
+}
+
+function checkBusy () {
+  if (writes.length > 0) {
+    throw new Error("Storage is busy");
+  }
+}
+
 class Storage {
-  setItem (key, value) {
+  setItem (key, value, callback) {
+    if (typeof callback === 'function') {
+      writes.push({ key: String(key), value: String(value), callback: callback });
+      if (writes.length === 1) {
+        runWrites();
+      }
+      return undefined;
+    }
+    checkBusy();
     var res = storage_native.setItem(key, value.toString());
     if (res === -2) { // sweep required
       var cache = {}
@@ -26,22 +74,27 @@ class Storage {
   }
 
   getItem (key) {
+    checkBusy();
     return storage_native.getItem(key);
   }
 
   removeItem (key) {
+    checkBusy();
     return storage_native.removeItem(key);
   }
 
   clear () {
+    checkBusy();
     storage_native.clear();
   }
 
   get length () {
+    checkBusy();
     return storage_native.length();
   }
 
   key (index) {
+    checkBusy();
     return storage_native.key(index);
   }
 }
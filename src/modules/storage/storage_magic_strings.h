@@ -25,6 +25,7 @@
 #define MSTR_STORAGE_STORAGE "Storage"
 #define MSTR_STORAGE_STORAGE_ "storage"
 #define MSTR_STORAGE_SET_ITEM "setItem"
+#define MSTR_STORAGE_SET_ITEM_ASYNC "setItemAsync"
 #define MSTR_STORAGE_GET_ITEM "getItem"
 #define MSTR_STORAGE_REMOVE_ITEM "removeItem"
 #define MSTR_STORAGE_CLEAR "clear"
@@ -131,7 +131,7 @@ class Writable extends Stream {
           this._wbuf += chunk;
         }
       }
-      setTimeout(() => this.flush(), 0);
+      setImmediate(() => this.flush());
       if (cb) cb();
     }
     return this._wbuf.length === 0;
@@ -180,7 +180,7 @@ class Writable extends Stream {
             this.emit('error', err);
           } else {
             if (this._wbuf.length > 0) {
-              setTimeout(() => this.flush(), 0);
+              setImmediate(() => this.flush());
             } else {
               this.emit('drain');
               this.finish();
@@ -25,6 +25,7 @@
 #include "uart_magic_strings.h"
 #include "uart.h"
 #include "io.h"
+#include "ringbuffer.h"
 
 #define UART_DEFAULT_BAUDRATE 9600
 #define UART_DEFAULT_BITS 8
@@ -75,7 +76,7 @@ static void uart_read_cb(km_io_uart_handle_t *handle, uint8_t *buf, size_t len)
 }
 
 static void uart_close_cb(km_io_handle_t *handle) {
-  free(handle);
+  km_io_handle_free(handle);
 }
 
 /**
@@ -107,6 +108,15 @@ JERRYXX_FUN(uart_ctor_fn) {
   pins.pin_rx = (int8_t) jerryxx_get_property_number(options, MSTR_UART_PIN_RX, def_pins.pin_rx);
   pins.pin_cts = (int8_t) jerryxx_get_property_number(options, MSTR_UART_PIN_CTS, def_pins.pin_cts);
   pins.pin_rts = (int8_t) jerryxx_get_property_number(options, MSTR_UART_PIN_RTS, def_pins.pin_rts);
+  double priority = jerryxx_get_property_number(options, MSTR_UART_PRIORITY, KM_IO_PRIORITY_NORMAL);
+  if (priority != KM_IO_PRIORITY_REALTIME && priority != KM_IO_PRIORITY_NORMAL &&
+      priority != KM_IO_PRIORITY_BACKGROUND) {
+    jerry_release_value(data_event);
+    return jerry_create_error(JERRY_ERROR_RANGE, (const jerry_char_t *) "Invalid priority.");
+  }
+
+  // the read buffer is a ring buffer of power of two size
+  buffer_size = ringbuffer_round_size(buffer_size);
 
   // initialize the port
   int ret = km_uart_setup(port, baudrate, bits, parity, stop, flow, buffer_size, pins);
@@ -126,11 +136,17 @@ JERRYXX_FUN(uart_ctor_fn) {
   jerryxx_set_property_number(JERRYXX_GET_THIS, MSTR_UART_PIN_RX, pins.pin_rx);
   jerryxx_set_property_number(JERRYXX_GET_THIS, MSTR_UART_PIN_CTS, pins.pin_cts);
   jerryxx_set_property_number(JERRYXX_GET_THIS, MSTR_UART_PIN_RTS, pins.pin_rts);
+  jerryxx_set_property_number(JERRYXX_GET_THIS, MSTR_UART_PRIORITY, priority);
   jerryxx_set_property(JERRYXX_GET_THIS, "callback", callback);
 
   // setup io handle
-  km_io_uart_handle_t *handle = malloc(sizeof(km_io_uart_handle_t));
+  km_io_uart_handle_t *handle = (km_io_uart_handle_t *) km_io_handle_alloc(KM_IO_UART);
+  if (handle == NULL) {
+    km_uart_close(port);
+    return JERRYXX_CREATE_ERROR("Out of memory.");
+  }
   km_io_uart_init(handle);
+  handle->base.priority = (uint8_t) priority;
   handle->read_js_cb = jerry_acquire_value(callback);
   int condition = 0;
   if (jerry_value_is_number(data_event)) {
@@ -35,6 +35,7 @@
 #define MSTR_UART_PIN_RX "pinRx"
 #define MSTR_UART_PIN_CTS "pinCts"
 #define MSTR_UART_PIN_RTS "pinRts"
+#define MSTR_UART_PRIORITY "priority"
 #define MSTR_UART_WRITE "write"
 #define MSTR_UART_CLOSE "close"
 #define MSTR_UART_PARITY_NONE "PARITY_NONE"
@@ -25,6 +25,7 @@
 #include "wifi_magic_strings.h"
 #include "ieee80211.h"
 #include "io.h"
+#include "memstats.h"
 
 static void scan_cb(km_io_ieee80211_handle_t *, int count, km_ieee80211_scan_info_t* records);
 static void assoc_cb(km_io_ieee80211_handle_t *);
@@ -32,8 +33,11 @@ static void connect_cb(km_io_ieee80211_handle_t *);
 static void disconnect_cb(km_io_ieee80211_handle_t *);
 
 JERRYXX_FUN(wifi_ctor_fn) {
-    km_io_ieee80211_handle_t *handle = malloc(sizeof(km_io_ieee80211_handle_t));
-    km_io_ieee80211_init(handle);
+    km_io_ieee80211_handle_t *handle = km_malloc(KM_MEM_WIFI, sizeof(km_io_ieee80211_handle_t));
+    if (handle == NULL || !km_io_ieee80211_init(handle)) {
+        km_free(handle);
+        return JERRYXX_CREATE_ERROR("Out of memory.");
+    }
     handle->scan_js_cb = jerry_create_null();
     handle->this_val = jerry_acquire_value(JERRYXX_GET_THIS);
 
@@ -0,0 +1,183 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "jerryscript.h"
+#include "system.h"
+#include "profiler.h"
+
+/**
+ * A record of a collapsed stack in the buffer. The stack string (null
+ * terminated) follows the record, and the records are aligned to 4 bytes.
+ */
+typedef struct {
+  uint32_t count;
+  uint16_t length;
+  char stack[];
+} profiler_record_t;
+
+static km_profiler_stats_t stats = { false, KM_PROFILER_DEFAULT_INTERVAL, 0, 0, 0 };
+static uint8_t *buffer = NULL;
+static uint32_t buffer_used = 0;
+static uint64_t next_sample = 0;
+
+static uint32_t record_size(uint16_t length) {
+  return (sizeof(profiler_record_t) + length + 1 + 3) & ~3;
+}
+
+/**
+ * Count the stack in the record of the same stack, or in a new record
+ */
+static void profiler_record(const char *stack, uint16_t length) {
+  uint32_t offset = 0;
+  while (offset < buffer_used) {
+    profiler_record_t *record = (profiler_record_t *) (buffer + offset);
+    if (record->length == length && memcmp(record->stack, stack, length) == 0) {
+      record->count++;
+      return;
+    }
+    offset += record_size(record->length);
+  }
+  uint32_t size = record_size(length);
+  if (buffer_used + size > KM_PROFILER_BUFFER_SIZE) {
+    stats.dropped++;
+    return;
+  }
+  profiler_record_t *record = (profiler_record_t *) (buffer + buffer_used);
+  record->count = 1;
+  record->length = length;
+  memcpy(record->stack, stack, length);
+  record->stack[length] = '\0';
+  buffer_used += size;
+  stats.stacks++;
+}
+
+/**
+ * Append a frame ("resource:line:column") without the column
+ */
+static uint16_t append_frame(char *stack, uint16_t length, jerry_value_t frame) {
+  char buf[KM_PROFILER_FRAME_MAX];
+  jerry_length_t frame_length = jerry_get_string_length(frame);
+  if (frame_length > KM_PROFILER_FRAME_MAX - 1) {
+    frame_length = KM_PROFILER_FRAME_MAX - 1;
+  }
+  jerry_size_t size = jerry_substring_to_char_buffer(frame, 0, frame_length,
+    (jerry_char_t *) buf, KM_PROFILER_FRAME_MAX - 1);
+  buf[size] = '\0';
+  char *column = strrchr(buf, ':');
+  if (column != NULL && column != strchr(buf, ':')) {
+    *column = '\0';
+    size = column - buf;
+  }
+  /* ';' separates the frames and ' ' the count */
+  for (jerry_size_t i = 0; i < size; i++) {
+    if (buf[i] == ';' || buf[i] == ' ') {
+      buf[i] = '_';
+    }
+  }
+  if (length > 0 && length < KM_PROFILER_STACK_MAX) {
+    stack[length++] = ';';
+  }
+  if (length + size > KM_PROFILER_STACK_MAX) {
+    size = KM_PROFILER_STACK_MAX - length;
+  }
+  memcpy(stack + length, buf, size);
+  return length + size;
+}
+
+/**
+ * Start profiling with the sampling interval in microseconds. The samples
+ * of the previous profiling are discarded. Returns 0 or -1 (no memory).
+ */
+int km_profiler_start(uint32_t interval) {
+  if (buffer == NULL) {
+    buffer = (uint8_t *) malloc(KM_PROFILER_BUFFER_SIZE);
+    if (buffer == NULL) {
+      return -1;
+    }
+  }
+  buffer_used = 0;
+  stats.interval = (interval > 0) ? interval : KM_PROFILER_DEFAULT_INTERVAL;
+  stats.samples = 0;
+  stats.dropped = 0;
+  stats.stacks = 0;
+  next_sample = km_micro_gettime() + stats.interval;
+  stats.running = true;
+  return 0;
+}
+
+/**
+ * Stop profiling. The samples are kept until the next start.
+ */
+void km_profiler_stop() {
+  stats.running = false;
+}
+
+/**
+ * Take a sample if the interval has passed (called by the VM exec stop
+ * callback)
+ */
+void km_profiler_sample() {
+  if (!stats.running) {
+    return;
+  }
+  uint64_t now = km_micro_gettime();
+  if (now < next_sample) {
+    return;
+  }
+  next_sample = now + stats.interval;
+  stats.samples++;
+  char stack[KM_PROFILER_STACK_MAX];
+  uint16_t length = 0;
+  jerry_value_t backtrace = jerry_get_backtrace(KM_PROFILER_MAX_DEPTH);
+  uint32_t depth = jerry_get_array_length(backtrace);
+  /* the backtrace starts from the leaf */
+  for (uint32_t i = depth; i > 0 && length < KM_PROFILER_STACK_MAX; i--) {
+    jerry_value_t frame = jerry_get_property_by_index(backtrace, i - 1);
+    if (jerry_value_is_string(frame)) {
+      length = append_frame(stack, length, frame);
+    }
+    jerry_release_value(frame);
+  }
+  jerry_release_value(backtrace);
+  if (length == 0) {
+    strcpy(stack, "(unknown)");
+    length = strlen(stack);
+  }
+  profiler_record(stack, length);
+}
+
+/**
+ * Call the callback for each collapsed stack with its sample count
+ */
+void km_profiler_foreach(km_profiler_stack_cb stack_cb, void *arg) {
+  uint32_t offset = 0;
+  while (offset < buffer_used) {
+    profiler_record_t *record = (profiler_record_t *) (buffer + offset);
+    stack_cb(record->stack, record->count, arg);
+    offset += record_size(record->length);
+  }
+}
+
+km_profiler_stats_t *km_profiler_stats() {
+  return &stats;
+}
@@ -19,6 +19,7 @@
  * SOFTWARE.
  */
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -27,6 +28,8 @@
 #include "flash.h"
 #include "repl.h"
 #include "runtime.h"
+#include "profiler.h"
+#include "memstats.h"
 #include "system.h"
 #include "jerryscript.h"
 #include "utils.h"
@@ -41,8 +44,11 @@ static void cmd_echo(km_repl_state_t *state, char *arg);
 static void cmd_reset(km_repl_state_t *state);
 static void cmd_flash(km_repl_state_t *state, char *arg);
 static void cmd_load(km_repl_state_t *state);
-static void cmd_mem(km_repl_state_t *state);
+static void cmd_mem(km_repl_state_t *state, char *arg);
 static void cmd_gc(km_repl_state_t *state);
+static void cmd_loop(km_repl_state_t *state, char *arg);
+static void cmd_boot(km_repl_state_t *state);
+static void cmd_prof(km_repl_state_t *state, char *arg, char *interval);
 static void cmd_hi(km_repl_state_t *state);
 static void cmd_help(km_repl_state_t *state);
 
@@ -134,9 +140,27 @@ static void run_command() {
     } else if (strcmp(tokenv[0], ".load") == 0) {
       cmd_load(&state);
     } else if (strcmp(tokenv[0], ".mem") == 0) {
-      cmd_mem(&state);
+      if (tokenv[1] == NULL)
+      {
+        tokenv[1] = "";
+      }
+      cmd_mem(&state, tokenv[1]);
     } else if (strcmp(tokenv[0], ".gc") == 0) {
       cmd_gc(&state);
+    } else if (strcmp(tokenv[0], ".loop") == 0) {
+      if (tokenv[1] == NULL)
+      {
+        tokenv[1] = "";
+      }
+      cmd_loop(&state, tokenv[1]);
+    } else if (strcmp(tokenv[0], ".prof") == 0) {
+      if (tokenv[1] == NULL)
+      {
+        tokenv[1] = "";
+      }
+      cmd_prof(&state, tokenv[1], tokenv[2]);
+    } else if (strcmp(tokenv[0], ".boot") == 0) {
+      cmd_boot(&state);
     } else if (strcmp(tokenv[0], ".hi") == 0) {
       cmd_hi(&state);
     } else if (strcmp(tokenv[0], ".help") == 0) {
@@ -453,10 +477,51 @@ static void footer_cb() {
   bytes_remained = 0;
 }
 
+/**
+ * Compile the user code in flash to a snapshot and replace it
+ */
+static void flash_compile() {
+  uint32_t size = km_flash_get_data_size();
+  uint8_t *data = km_flash_get_data();
+  if (size == 0) {
+    km_repl_printf("No user code in flash.\r\n");
+  } else if (km_runtime_is_snapshot(data, size)) {
+    km_repl_printf("The user code is already compiled.\r\n");
+  } else {
+    /* a snapshot is usually smaller than the source */
+    size_t buffer_size = ((size * 2 + 1024) + 3) & ~3;
+    if (buffer_size > km_flash_size()) {
+      buffer_size = km_flash_size() & ~3;
+    }
+    uint32_t *buffer = (uint32_t *) malloc(buffer_size);
+    if (buffer == NULL) {
+      km_repl_printf("Not enough memory.\r\n");
+    } else {
+      size_t snapshot_size = km_runtime_compile(data, size, buffer, buffer_size);
+      if (snapshot_size > 0) {
+        km_flash_program_begin();
+        km_flash_status_t status = km_flash_program((uint8_t *) buffer, snapshot_size);
+        km_flash_program_end();
+        if (status == KM_FLASH_SUCCESS) {
+          km_repl_printf("Compiled %u bytes to %u bytes.\r\n", size, (uint32_t) snapshot_size);
+        } else {
+          km_repl_printf("Failed to program flash.\r\n");
+        }
+      }
+      free(buffer);
+    }
+  }
+  km_flash_free_data(data);
+}
+
 /**
  * .flash command
  */
 static void cmd_flash(km_repl_state_t *state, char *arg) {
+  /* the user code running in place can't be changed under the runtime */
+  if (km_runtime_in_place() && (strcmp(arg, "-e") == 0 || strcmp(arg, "-w") == 0)) {
+    cmd_reset(state);
+  }
   /* erase flash */
   if (strcmp(arg, "-e") == 0) {
     km_flash_clear();
@@ -476,6 +541,11 @@ static void cmd_flash(km_repl_state_t *state, char *arg) {
   } else if (strcmp(arg, "-r") == 0) {
     uint32_t sz = km_flash_get_data_size();
     uint8_t *ptr = km_flash_get_data();
+    if (km_runtime_is_snapshot(ptr, sz)) {
+      km_snapshot_header_t *header = (km_snapshot_header_t *) ptr;
+      km_repl_printf("(snapshot of %u bytes compiled from %u bytes)", header->size, header->source_size);
+      sz = 0;
+    }
     for (int i = 0; i < sz; i++) {
       if (ptr[i] == '\n') { /* convert "\n" to "\r\n" */
         km_repl_putc('\r');
@@ -510,10 +580,15 @@ static void cmd_flash(km_repl_state_t *state, char *arg) {
         break;
     }
     state->ymodem_state = 0; // stopped
+  /* compile the user code to a snapshot */
+  } else if (strcmp(arg, "-c") == 0) {
+    cmd_reset(state); /* for the heap to compile */
+    flash_compile();
   /* no option is given */
   } else {
     km_repl_printf(".flash command options:\r\n");
     km_repl_printf("-w\tWrite user code (file) to flash via Ymodem.\r\n");
+    km_repl_printf("-c\tCompile the user code in flash to a snapshot.\r\n");
     km_repl_printf("-e\tErase the user code in flash.\r\n");
     km_repl_printf("-t\tPrint total size of flash for user code.\r\n");
     km_repl_printf("-s\tPrint the size of the user code.\r\n");
@@ -529,10 +604,96 @@ static void cmd_load(km_repl_state_t *state) {
   km_runtime_init(true, false);
 }
 
+typedef struct {
+  const char *label;
+  size_t offset;
+} mem_field_t;
+
+static const mem_field_t mem_fields[] = {
+  { "heap total", offsetof(km_memstats_t, heap_size) },
+  { "heap used", offsetof(km_memstats_t, heap_used) },
+  { "heap peak", offsetof(km_memstats_t, heap_peak) },
+  { "objects", offsetof(km_memstats_t, objects) },
+  { "functions", offsetof(km_memstats_t, functions) },
+  { "arrays", offsetof(km_memstats_t, arrays) },
+  { "typed arrays", offsetof(km_memstats_t, typed_arrays) },
+  { "array buffers", offsetof(km_memstats_t, array_buffers) },
+  { "array buffer bytes", offsetof(km_memstats_t, array_buffer_bytes) },
+  { "promises", offsetof(km_memstats_t, promises) },
+  { "native arena", offsetof(km_memstats_t, native_size) },
+  { "native used", offsetof(km_memstats_t, native_used) },
+  { "native free", offsetof(km_memstats_t, native_free) },
+#ifdef KALUMA_TLSF
+  { "tlsf size", offsetof(km_memstats_t, tlsf_size) },
+  { "tlsf used", offsetof(km_memstats_t, tlsf_used) },
+  { "tlsf free", offsetof(km_memstats_t, tlsf_free) },
+  { "tlsf free blocks", offsetof(km_memstats_t, tlsf_free_blocks) },
+  { "tlsf largest free", offsetof(km_memstats_t, tlsf_largest_free) },
+  { "tlsf fallbacks", offsetof(km_memstats_t, tlsf_fallbacks) },
+#endif
+};
+
+/**
+ * Memory usage saved by .mem -s to diff with
+ */
+static km_memstats_t mem_saved;
+static bool mem_saved_valid = false;
+
+static uint32_t mem_field_value(km_memstats_t *stats, int i) {
+  return *(uint32_t *) ((uint8_t *) stats + mem_fields[i].offset);
+}
+
+/**
+ * Print the memory usage, with the difference from the base if given
+ */
+static void print_memstats(km_memstats_t *stats, km_memstats_t *base) {
+  for (int i = 0; i < sizeof(mem_fields) / sizeof(mem_field_t); i++) {
+    uint32_t value = mem_field_value(stats, i);
+    if (base != NULL) {
+      int32_t diff = (int32_t) (value - mem_field_value(base, i));
+      km_repl_printf("%s: %u (%s%d)\r\n", mem_fields[i].label, value, diff >= 0 ? "+" : "", diff);
+    } else {
+      km_repl_printf("%s: %u\r\n", mem_fields[i].label, value);
+    }
+  }
+  /* native allocations by tag, only the tags ever used */
+  for (int i = 0; i < KM_MEM_TAGS; i++) {
+    km_mem_tag_stats_t *tag = &stats->tags[i];
+    if (tag->allocs == 0) {
+      continue;
+    }
+    km_repl_printf("native %s: %u", km_mem_tag_name(i), tag->current);
+    if (base != NULL) {
+      int32_t diff = (int32_t) (tag->current - base->tags[i].current);
+      km_repl_printf(" (%s%d)", diff >= 0 ? "+" : "", diff);
+    }
+    km_repl_printf(", peak: %u, blocks: %u, allocs: %u\r\n", tag->peak, tag->blocks, tag->allocs);
+  }
+}
+
 /**
  * .mem command
  */
-static void cmd_mem(km_repl_state_t *state) {
+static void cmd_mem(km_repl_state_t *state, char *arg) {
+  /* verbose, save (to diff later), or diff with the saved */
+  if (strcmp(arg, "-v") == 0 || strcmp(arg, "-s") == 0 || strcmp(arg, "-d") == 0) {
+    km_memstats_t stats;
+    km_memstats_get(&stats);
+    if (strcmp(arg, "-d") == 0) {
+      if (!mem_saved_valid) {
+        km_repl_printf("No memory usage saved (.mem -s).\r\n");
+        return;
+      }
+      print_memstats(&stats, &mem_saved);
+    } else {
+      print_memstats(&stats, NULL);
+    }
+    if (strcmp(arg, "-s") == 0) {
+      mem_saved = stats;
+      mem_saved_valid = true;
+    }
+    return;
+  }
   jerry_heap_stats_t stats = {0};
   bool stats_ret = jerry_get_memory_stats (&stats);
   if (stats_ret) {
@@ -549,6 +710,73 @@ static void cmd_gc(km_repl_state_t *state) {
   jerry_gc(JERRY_GC_PRESSURE_HIGH);
 }
 
+/**
+ * .loop command
+ */
+static void cmd_loop(km_repl_state_t *state, char *arg) {
+  if (strcmp(arg, "-r") == 0) {
+    km_io_stats_reset();
+    return;
+  }
+  km_io_loop_stats_t *stats = km_io_stats();
+  km_repl_printf("phase\tcount\tcallbacks\ttotal(ms)\tmax(us)\r\n");
+  for (int i = 0; i < KM_IO_PHASE_COUNT; i++) {
+    km_io_phase_stats_t *phase = &stats->phases[i];
+    km_repl_printf("%s\t%u\t%u\t%u\t%u\r\n", km_io_phase_name(i), phase->count,
+      phase->callbacks, (uint32_t) (phase->time / 1000), phase->max_time);
+  }
+  km_repl_printf("iterations: %u, max lag: %u us, yields: %u\r\n", stats->iterations, stats->max_lag, stats->yields);
+  km_repl_printf("lag(ms):");
+  for (int i = 0; i < KM_IO_LAG_BUCKETS; i++) {
+    if (i == 0) {
+      km_repl_printf(" <1: %u", stats->lag[i]);
+    } else if (i < KM_IO_LAG_BUCKETS - 1) {
+      km_repl_printf(", <%u: %u", 1 << i, stats->lag[i]);
+    } else {
+      km_repl_printf(", >=%u: %u", 1 << (i - 1), stats->lag[i]);
+    }
+  }
+  km_repl_printf("\r\n");
+}
+
+/**
+ * .boot command
+ */
+static void cmd_boot(km_repl_state_t *state) {
+  const km_boot_trace_t *trace;
+  uint8_t count = km_boot_trace_get(&trace);
+  km_repl_printf("stage\tname\ttime(us)\tduration(us)\r\n");
+  for (int i = 0; i < count; i++) {
+    km_repl_printf("%s\t%s\t%u\t%u\r\n", trace[i].stage,
+      trace[i].name != NULL ? trace[i].name : "-", trace[i].time, trace[i].duration);
+  }
+}
+
+static void prof_print_cb(const char *stack, uint32_t count, void *arg) {
+  km_repl_printf("%s %u\r\n", stack, count);
+}
+
+/**
+ * .prof command
+ */
+static void cmd_prof(km_repl_state_t *state, char *arg, char *interval) {
+  km_profiler_stats_t *stats = km_profiler_stats();
+  if (strcmp(arg, "start") == 0) {
+    uint32_t us = (interval != NULL) ? (uint32_t) atoi(interval) : 0;
+    if (km_profiler_start(us) < 0) {
+      km_repl_printf("Not enough memory.\r\n");
+    } else {
+      km_repl_printf("Profiling every %u us.\r\n", stats->interval);
+    }
+  } else if (strcmp(arg, "stop") == 0) {
+    km_profiler_stop();
+    km_repl_printf("%u samples, %u stacks, %u dropped.\r\n", stats->samples, stats->stacks, stats->dropped);
+  } else {
+    /* collapsed stacks, e.g. for flamegraph.pl */
+    km_profiler_foreach(prof_print_cb, NULL);
+  }
+}
+
 /**
  * .hi command
  */
@@ -580,8 +808,11 @@ static void cmd_help(km_repl_state_t *state) {
   km_repl_printf(".reset\tReset JavaScript runtime context.\r\n");
   km_repl_printf(".flash\tCommands for the internal flash.\r\n");
   km_repl_printf(".load\tLoad user code from the internal flash.\r\n");
-  km_repl_printf(".mem\tHeap memory status.\r\n");
+  km_repl_printf(".mem\tHeap memory status (-v verbose, -s save, -d diff with saved).\r\n");
   km_repl_printf(".gc\tPerform garbage collection.\r\n");
+  km_repl_printf(".loop\tEvent loop statistics (-r to reset).\r\n");
+  km_repl_printf(".prof\tJS profiler (start [us], stop, or print collapsed stacks).\r\n");
+  km_repl_printf(".boot\tTimes of the boot (or the last reset) stages.\r\n");
   km_repl_printf(".hi\tPrint welcome message.\r\n");
   km_repl_printf(".help\tPrint this help message.\r\n");
 }
@@ -594,8 +825,9 @@ static void cmd_help(km_repl_state_t *state) {
  * Initialize the REPL
  */
 void km_repl_init() {
-  km_io_tty_init(&tty);
-  km_io_tty_read_start(&tty, tty_read_cb);
+  if (km_io_tty_init(&tty)) {
+    km_io_tty_read_start(&tty, tty_read_cb);
+  }
   state.mode = KM_REPL_MODE_NORMAL;
   state.echo = true;
   state.buffer_length = 0;
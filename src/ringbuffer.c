@@ -0,0 +1,154 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include "ringbuffer.h"
+
+/* The pointer owned by the other side is loaded with acquire and the own
+   pointer is stored with release ordering, so the data is accessed only
+   after it was published (write) or released (read). */
+#define RINGBUFFER_LOAD(ptr) __atomic_load_n(&(ptr), __ATOMIC_ACQUIRE)
+#define RINGBUFFER_STORE(ptr, val) __atomic_store_n(&(ptr), (val), __ATOMIC_RELEASE)
+
+/**
+ * Copy from the ring buffer at the (unmasked) position in at most two
+ * segments
+ */
+static void ringbuffer_copy_out(ringbuffer_t *ringbuffer, uint32_t pos, uint8_t *buf, uint32_t len) {
+  uint32_t start = pos & ringbuffer->mask;
+  uint32_t first = ringbuffer->length - start;
+  if (first >= len) {
+    memcpy(buf, ringbuffer->buf + start, len);
+  } else {
+    memcpy(buf, ringbuffer->buf + start, first);
+    memcpy(buf + first, ringbuffer->buf, len - first);
+  }
+}
+
+void ringbuffer_init(ringbuffer_t *ringbuffer, uint8_t *buf, uint32_t len) {
+  uint32_t size = 1;
+  while (size <= len / 2) {
+    size <<= 1;
+  }
+  ringbuffer->r_ptr = 0;
+  ringbuffer->w_ptr = 0;
+  ringbuffer->buf = buf;
+  ringbuffer->length = (len > 0) ? size : 0;
+  ringbuffer->mask = (len > 0) ? size - 1 : 0;
+}
+
+uint32_t ringbuffer_round_size(uint32_t len) {
+  if (len == 0) {
+    return 0;
+  }
+  uint32_t size = 1;
+  while (size < len && size < 0x80000000) {
+    size <<= 1;
+  }
+  return size;
+}
+
+uint32_t ringbuffer_size(ringbuffer_t *ringbuffer) {
+  return ringbuffer->length;
+}
+
+uint32_t ringbuffer_length(ringbuffer_t *ringbuffer) {
+  return RINGBUFFER_LOAD(ringbuffer->w_ptr) - RINGBUFFER_LOAD(ringbuffer->r_ptr);
+}
+
+uint32_t ringbuffer_freespace(ringbuffer_t *ringbuffer) {
+  return (ringbuffer->length - ringbuffer_length(ringbuffer));
+}
+
+void ringbuffer_read(ringbuffer_t *ringbuffer, uint8_t *buf, uint32_t len) {
+  uint32_t r_ptr = ringbuffer->r_ptr;
+  uint32_t available = RINGBUFFER_LOAD(ringbuffer->w_ptr) - r_ptr;
+  if (len > available) {
+    len = available;
+  }
+  if (len == 1) {
+    buf[0] = ringbuffer->buf[r_ptr & ringbuffer->mask];
+  } else {
+    ringbuffer_copy_out(ringbuffer, r_ptr, buf, len);
+  }
+  RINGBUFFER_STORE(ringbuffer->r_ptr, r_ptr + len);
+}
+
+void ringbuffer_write(ringbuffer_t *ringbuffer, uint8_t *buf, uint32_t len) {
+  uint32_t w_ptr = ringbuffer->w_ptr;
+  uint32_t space = ringbuffer->length - (w_ptr - RINGBUFFER_LOAD(ringbuffer->r_ptr));
+  if (len > space) {
+    len = space;
+  }
+  uint32_t start = w_ptr & ringbuffer->mask;
+  uint32_t first = ringbuffer->length - start;
+  if (len == 1) {
+    ringbuffer->buf[start] = buf[0];
+  } else if (first >= len) {
+    memcpy(ringbuffer->buf + start, buf, len);
+  } else {
+    memcpy(ringbuffer->buf + start, buf, first);
+    memcpy(ringbuffer->buf, buf + first, len - first);
+  }
+  RINGBUFFER_STORE(ringbuffer->w_ptr, w_ptr + len);
+}
+
+uint8_t ringbuffer_look_at(ringbuffer_t *ringbuffer, uint32_t offset) {
+  uint32_t r_ptr = ringbuffer->r_ptr;
+  RINGBUFFER_LOAD(ringbuffer->w_ptr);
+  return ringbuffer->buf[(r_ptr + offset) & ringbuffer->mask];
+}
+
+void ringbuffer_look(ringbuffer_t *ringbuffer, uint8_t *buf, uint32_t len, uint32_t offset) {
+  uint32_t r_ptr = ringbuffer->r_ptr;
+  RINGBUFFER_LOAD(ringbuffer->w_ptr);
+  ringbuffer_copy_out(ringbuffer, r_ptr + offset, buf, len);
+}
+
+void ringbuffer_flush(ringbuffer_t *ringbuffer, uint32_t len) {
+  uint32_t r_ptr = ringbuffer->r_ptr;
+  uint32_t available = RINGBUFFER_LOAD(ringbuffer->w_ptr) - r_ptr;
+  if (len > available) {
+    len = available;
+  }
+  RINGBUFFER_STORE(ringbuffer->r_ptr, r_ptr + len);
+}
+
+int ringbuffer_find(ringbuffer_t *ringbuffer, uint8_t ch) {
+  uint32_t r_ptr = ringbuffer->r_ptr;
+  uint32_t len = RINGBUFFER_LOAD(ringbuffer->w_ptr) - r_ptr;
+  uint32_t start = r_ptr & ringbuffer->mask;
+  uint32_t first = ringbuffer->length - start;
+  if (first > len) {
+    first = len;
+  }
+  uint8_t *p = memchr(ringbuffer->buf + start, ch, first);
+  if (p != NULL) {
+    return p - (ringbuffer->buf + start);
+  }
+  p = memchr(ringbuffer->buf, ch, len - first);
+  if (p != NULL) {
+    return first + (p - ringbuffer->buf);
+  }
+  return -1;
+}
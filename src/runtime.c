@@ -37,7 +37,9 @@
 #include "repl.h"
 #include "system.h"
 #include "runtime.h"
+#include "profiler.h"
 #include "kaluma_magic_strings.h"
+#include "magic_strings.h"
 #include "jerryxx.h"
 
 
@@ -57,6 +59,38 @@ static uint8_t km_runtime_vm_stop = 0;
  */
 static km_io_idle_handle_t idler;
 
+/**
+ * I/O callbacks dispatched when the idler ran the jobs last time
+ */
+static uint32_t idler_dispatched = 0;
+
+/**
+ * Memory pressure thresholds (in percent of the heap, 0 to disable)
+ */
+static km_runtime_memory_pressure_t memory_pressure = {
+  KM_RUNTIME_GC_WATERMARK, KM_RUNTIME_MODERATE_PRESSURE, KM_RUNTIME_CRITICAL_PRESSURE
+};
+
+/**
+ * Heap used after the last idle GC, and the last memory pressure level
+ */
+static uint32_t idle_gc_used = 0;
+static uint8_t memory_pressure_level = KM_RUNTIME_PRESSURE_NONE;
+
+/**
+ * User code (snapshot) executed in place. The bytecode is not copied to the
+ * heap, so the data must be kept until the runtime is cleaned up.
+ */
+static uint8_t *in_place_data = NULL;
+
+/**
+ * Stages of the last boot or runtime re-initialization
+ */
+static km_boot_trace_t boot_trace[KM_BOOT_TRACE_MAX];
+static uint8_t boot_trace_count = 0;
+static uint64_t boot_trace_start = 0;
+static uint64_t boot_trace_last = 0;
+
 // --------------------------------------------------------------------------
 // PRIVATE FUNCTIONS
 // --------------------------------------------------------------------------
@@ -66,15 +100,91 @@ static jerry_value_t vm_exec_stop_callback (void *user_p) {
     km_runtime_vm_stop = 0;
     return jerry_create_string ((const jerry_char_t *) "Abort script"); 
   }
+  km_profiler_sample();
   return jerry_create_undefined ();
 }
 
+static const char *pressure_level_names[] = { "none", "moderate", "critical" };
+
+/**
+ * Emit `process.emit('memoryPressure', { level, heapUsed, heapTotal })`
+ */
+static void emit_memory_pressure(uint8_t level, uint32_t used, uint32_t total) {
+  jerry_value_t global = jerry_get_global_object();
+  jerry_value_t process = jerryxx_get_property(global, MSTR_PROCESS);
+  jerry_value_t emit = jerryxx_get_property(process, MSTR_EMIT);
+  if (jerry_value_is_function(emit)) {
+    jerry_value_t args[2];
+    args[0] = jerry_create_string((const jerry_char_t *) MSTR_MEMORY_PRESSURE);
+    args[1] = jerry_create_object();
+    jerryxx_set_property_string(args[1], MSTR_LEVEL, (char *) pressure_level_names[level]);
+    jerryxx_set_property_number(args[1], MSTR_HEAP_USED, used);
+    jerryxx_set_property_number(args[1], MSTR_HEAP_TOTAL, total);
+    jerry_value_t ret_val = jerry_call_function(emit, process, args, 2);
+    if (jerry_value_is_error(ret_val)) {
+      jerryxx_print_error(ret_val, true);
+    }
+    jerry_release_value(ret_val);
+    jerry_release_value(args[0]);
+    jerry_release_value(args[1]);
+  }
+  jerry_release_value(emit);
+  jerry_release_value(process);
+  jerry_release_value(global);
+}
+
+/**
+ * Run a low pressure GC in idle time when the heap use crosses the
+ * watermark (and has grown since the last idle GC), rather than letting the
+ * heap run out in the middle of a callback. Then emit the memory pressure
+ * event when the level goes up.
+ */
+static void check_memory() {
+  jerry_heap_stats_t stats = {0};
+  if (!jerry_get_memory_stats(&stats) || stats.size == 0) {
+    return;
+  }
+  uint32_t used = stats.allocated_bytes;
+  uint32_t percent = (uint32_t) ((uint64_t) used * 100 / stats.size);
+  if (used < idle_gc_used) {
+    idle_gc_used = used; /* collected by the engine itself */
+  }
+  if (memory_pressure.gc > 0 && percent >= memory_pressure.gc &&
+      used >= idle_gc_used + stats.size / 16) {
+    jerry_gc(JERRY_GC_PRESSURE_LOW);
+    jerry_get_memory_stats(&stats);
+    used = stats.allocated_bytes;
+    percent = (uint32_t) ((uint64_t) used * 100 / stats.size);
+    idle_gc_used = used;
+  }
+  uint8_t level = KM_RUNTIME_PRESSURE_NONE;
+  if (memory_pressure.critical > 0 && percent >= memory_pressure.critical) {
+    level = KM_RUNTIME_PRESSURE_CRITICAL;
+  } else if (memory_pressure.moderate > 0 && percent >= memory_pressure.moderate) {
+    level = KM_RUNTIME_PRESSURE_MODERATE;
+  }
+  uint8_t last_level = memory_pressure_level;
+  memory_pressure_level = level; /* set first as listeners may allocate */
+  if (level > last_level) {
+    emit_memory_pressure(level, used, stats.size);
+  }
+}
+
 static void idler_cb() {
-  jerry_value_t ret_val = jerry_run_all_enqueued_jobs();
-  if (jerry_value_is_error(ret_val)) {
-    jerryxx_print_error(ret_val, true);
+  /* Jobs are enqueued only by JS code, which runs only in I/O callbacks
+     (or while loading), so skip when no callback dispatched since the last
+     run. The jobs enqueued by jobs are run together. */
+  uint32_t dispatched = km_io_dispatched();
+  if (dispatched != idler_dispatched) {
+    idler_dispatched = dispatched;
+    jerry_value_t ret_val = jerry_run_all_enqueued_jobs();
+    if (jerry_value_is_error(ret_val)) {
+      jerryxx_print_error(ret_val, true);
+    }
+    jerry_release_value(ret_val);
+    /* the heap grows only by JS code as well */
+    check_memory();
   }
-  jerry_release_value(ret_val);
 #ifdef _TARGET_FREERTOS_  
   // ESP32 Kick the dog
   vTaskDelay(10);
@@ -86,13 +196,23 @@ static void idler_cb() {
 // --------------------------------------------------------------------------
 
 void km_runtime_init(bool load, bool first) {
+  if (!first) {
+    km_boot_trace_reset(); /* trace the re-initialization */
+  }
   jerry_init (JERRY_INIT_EMPTY);
   jerry_set_vm_exec_stop_callback (vm_exec_stop_callback, &km_runtime_vm_stop, 16);
+  km_boot_trace("engine");
   jerry_register_magic_strings (magic_string_items, num_magic_string_items, magic_string_lengths);
+  km_boot_trace("magic strings");
   km_global_init();
   jerry_gc(JERRY_GC_PRESSURE_HIGH);
+  km_boot_trace("gc");
+  idle_gc_used = 0;
+  memory_pressure_level = KM_RUNTIME_PRESSURE_NONE;
+  idler_dispatched = km_io_dispatched() - 1; /* run the jobs of the startup */
   if (load) {
     km_runtime_load();
+    km_boot_trace("load");
   }
   if (first) {
     // Initialize idler handle for queued jobs in jerryscript
@@ -102,37 +222,194 @@ void km_runtime_init(bool load, bool first) {
 }
 
 void km_runtime_cleanup() {
+  km_global_cleanup();
   jerry_cleanup();
+  if (in_place_data != NULL) {
+    km_flash_free_data(in_place_data);
+    in_place_data = NULL;
+  }
   km_system_cleanup();
   km_io_timer_cleanup();
+  km_io_periodic_cleanup();
   km_io_watch_cleanup();
   km_io_uart_cleanup();
+#ifdef KALUMA_IO_POLL
+  km_io_poll_cleanup();
+#endif//KALUMA_IO_POLL
+  km_io_work_cleanup();
+  km_io_immediate_cleanup();
   // km_io_idle_cleanup();
   // Do not cleanup tty I/O to keep terminal communication
 }
 
+/**
+ * Parse and run the script. Returns false if it fails (the error is
+ * printed).
+ */
+bool km_runtime_run_script(const uint8_t *script, size_t size) {
+  bool success = false;
+  jerry_value_t parsed_code = jerry_parse (NULL, 0, script, size, JERRY_PARSE_STRICT_MODE);
+  if (!jerry_value_is_error (parsed_code)) {
+    jerry_value_t ret_value = jerry_run (parsed_code);
+    if (jerry_value_is_error (ret_value)) {
+      jerryxx_print_error(ret_value, true);
+    } else {
+      success = true;
+    }
+    jerry_release_value (ret_value);
+  } else {
+    jerryxx_print_error(parsed_code, true);
+  }
+  jerry_release_value (parsed_code);
+  return success;
+}
+
+/**
+ * Whether the data is a snapshot with the header
+ */
+bool km_runtime_is_snapshot(const uint8_t *data, size_t size) {
+  const km_snapshot_header_t *header = (const km_snapshot_header_t *) data;
+  return (data != NULL && size >= sizeof(km_snapshot_header_t) &&
+      header->magic == KM_SNAPSHOT_MAGIC &&
+      header->version == KM_SNAPSHOT_VERSION &&
+      header->size <= size - sizeof(km_snapshot_header_t));
+}
+
+/**
+ * Execute the snapshot with the header. The bytecode is executed in place,
+ * so the data must not be freed or changed while the runtime is alive.
+ * Returns false if it fails (the error is printed).
+ */
+bool km_runtime_run_snapshot(const uint8_t *data, size_t size) {
+  const km_snapshot_header_t *header = (const km_snapshot_header_t *) data;
+  const uint32_t *snapshot = (const uint32_t *) (data + sizeof(km_snapshot_header_t));
+  if (!km_runtime_is_snapshot(data, size) || ((uintptr_t) snapshot & 0x3) != 0) {
+    km_tty_printf("Invalid snapshot\r\n");
+    return false;
+  }
+  bool success = true;
+  jerry_value_t ret_value = jerry_exec_snapshot (snapshot, header->size, 0, 0);
+  if (jerry_value_is_error (ret_value)) {
+    jerryxx_print_error(ret_value, true);
+    success = false;
+  }
+  jerry_release_value (ret_value);
+  return success;
+}
+
+/**
+ * Compile the script to a snapshot with the header in the buffer. Returns
+ * the total size or 0 if it fails (the error is printed).
+ */
+size_t km_runtime_compile(const uint8_t *script, size_t size, uint32_t *buffer, size_t buffer_size) {
+  size_t header_size = sizeof(km_snapshot_header_t);
+  if (buffer_size <= header_size) {
+    return 0;
+  }
+  jerry_value_t ret_value = jerry_generate_snapshot (NULL, 0, script, size,
+    JERRY_SNAPSHOT_SAVE_STRICT, buffer + (header_size / 4), buffer_size - header_size);
+  size_t snapshot_size = 0;
+  if (jerry_value_is_error (ret_value)) {
+    jerryxx_print_error(ret_value, true);
+  } else {
+    km_snapshot_header_t *header = (km_snapshot_header_t *) buffer;
+    header->magic = KM_SNAPSHOT_MAGIC;
+    header->version = KM_SNAPSHOT_VERSION;
+    header->size = (uint32_t) jerry_get_number_value (ret_value);
+    header->source_size = size;
+    snapshot_size = header_size + header->size;
+  }
+  jerry_release_value (ret_value);
+  return snapshot_size;
+}
+
+/**
+ * Whether the runtime is executing the user code in the flash in place
+ */
+bool km_runtime_in_place() {
+  return in_place_data != NULL;
+}
+
+/**
+ * Load the user code in the flash. A snapshot is executed in place without
+ * parsing, otherwise the source is parsed and run.
+ */
 void km_runtime_load() {
   uint32_t size = km_flash_get_data_size();
   if (size > 0) {
-    uint8_t *script = km_flash_get_data();
-    jerry_value_t parsed_code = jerry_parse (NULL, 0, script, size, JERRY_PARSE_STRICT_MODE);
-    km_flash_free_data(script);
-    if (!jerry_value_is_error (parsed_code)) {
-      jerry_value_t ret_value = jerry_run (parsed_code);
-      if (jerry_value_is_error (ret_value)) {
-        jerryxx_print_error(ret_value, true);
-        km_runtime_cleanup();
-        km_runtime_init(false, false);
-        return;
-      }
-      jerry_release_value (ret_value);
+    uint8_t *data = km_flash_get_data();
+    bool success;
+    if (km_runtime_is_snapshot(data, size)) {
+      in_place_data = data; /* freed at cleanup */
+      success = km_runtime_run_snapshot(data, size);
     } else {
-      jerryxx_print_error(parsed_code, true);
+      success = km_runtime_run_script(data, size);
+      km_flash_free_data(data);
+    }
+    if (!success) {
+      km_runtime_cleanup();
+      km_runtime_init(false, false);
     }
-    jerry_release_value (parsed_code);
   }
 }
 
+/**
+ * Start a new boot trace
+ */
+void km_boot_trace_reset() {
+  boot_trace_count = 0;
+  boot_trace_start = km_micro_gettime();
+  boot_trace_last = boot_trace_start;
+}
+
+static void boot_trace_add(const char *stage, const char *name, uint64_t begin, uint64_t end) {
+  if (boot_trace_count < KM_BOOT_TRACE_MAX) {
+    km_boot_trace_t *entry = &boot_trace[boot_trace_count];
+    entry->stage = stage;
+    entry->name = name;
+    entry->time = (uint32_t) (end - boot_trace_start);
+    entry->duration = (uint32_t) (end - begin);
+    boot_trace_count++;
+  }
+}
+
+/**
+ * Record that the stage is done (started when the previous stage is done).
+ * The stage string must be static.
+ */
+void km_boot_trace(const char *stage) {
+  uint64_t now = km_micro_gettime();
+  boot_trace_add(stage, NULL, boot_trace_last, now);
+  boot_trace_last = now;
+}
+
+/**
+ * Record a span from the begin time (by km_micro_gettime()) to now. The
+ * strings must be static.
+ */
+void km_boot_trace_span(const char *stage, const char *name, uint64_t begin) {
+  boot_trace_add(stage, name, begin, km_micro_gettime());
+}
+
+/**
+ * Get the boot trace entries. Returns the number of the entries.
+ */
+uint8_t km_boot_trace_get(const km_boot_trace_t **trace) {
+  *trace = boot_trace;
+  return boot_trace_count;
+}
+
+/**
+ * Set the memory pressure thresholds
+ */
+void km_runtime_set_memory_pressure(km_runtime_memory_pressure_t *pressure) {
+  memory_pressure = *pressure;
+}
+
+km_runtime_memory_pressure_t *km_runtime_get_memory_pressure() {
+  return &memory_pressure;
+}
+
 void km_runtime_set_vm_stop(uint8_t stop) {
   km_runtime_vm_stop = stop;
 }
@@ -0,0 +1,259 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "tlsf.h"
+
+#define KM_TLSF_FREE 0x01
+#define KM_TLSF_HEADER_SIZE offsetof(km_tlsf_block_t, next_free)
+#define KM_TLSF_MIN_SIZE ALIGN_UP(sizeof(km_tlsf_block_t) - KM_TLSF_HEADER_SIZE)
+#define KM_TLSF_MAX_SIZE ((size_t) 1 << KM_TLSF_FL_MAX)
+#define KM_TLSF_SMALL_SIZE (1 << KM_TLSF_FL_SHIFT)
+
+#define ALIGN_UP(x) (((x) + (KM_TLSF_ALIGN - 1)) & ~(size_t) (KM_TLSF_ALIGN - 1))
+
+static inline int fls32(uint32_t x) {
+  return 31 - __builtin_clz(x);
+}
+
+static inline int ffs32(uint32_t x) {
+  return __builtin_ctz(x);
+}
+
+static inline size_t block_size(km_tlsf_block_t *block) {
+  return block->size & ~(size_t) KM_TLSF_FREE;
+}
+
+static inline bool block_is_free(km_tlsf_block_t *block) {
+  return (block->size & KM_TLSF_FREE) != 0;
+}
+
+static inline void *block_to_ptr(km_tlsf_block_t *block) {
+  return (uint8_t *) block + KM_TLSF_HEADER_SIZE;
+}
+
+static inline km_tlsf_block_t *block_from_ptr(void *ptr) {
+  return (km_tlsf_block_t *) ((uint8_t *) ptr - KM_TLSF_HEADER_SIZE);
+}
+
+static inline km_tlsf_block_t *block_next_phys(km_tlsf_block_t *block) {
+  return (km_tlsf_block_t *) ((uint8_t *) block_to_ptr(block) + block_size(block));
+}
+
+/**
+ * Get the list of the size class which the size belongs to
+ */
+static void mapping(size_t size, int *fl, int *sl) {
+  if (size < KM_TLSF_SMALL_SIZE) {
+    *fl = 0;
+    *sl = (int) size / KM_TLSF_ALIGN;
+  } else {
+    int f = fls32((uint32_t) size);
+    *sl = (int) (size >> (f - KM_TLSF_SL_LOG2)) ^ KM_TLSF_SL_COUNT;
+    *fl = f - KM_TLSF_FL_SHIFT + 1;
+  }
+}
+
+/**
+ * Get the list of the smallest size class whose blocks are all large
+ * enough for the size
+ */
+static void mapping_search(size_t size, int *fl, int *sl) {
+  if (size >= KM_TLSF_SMALL_SIZE) {
+    size += ((size_t) 1 << (fls32((uint32_t) size) - KM_TLSF_SL_LOG2)) - 1;
+  }
+  mapping(size, fl, sl);
+}
+
+static void insert_free_block(km_tlsf_t *tlsf, km_tlsf_block_t *block) {
+  int fl, sl;
+  mapping(block_size(block), &fl, &sl);
+  km_tlsf_block_t *head = tlsf->blocks[fl][sl];
+  block->next_free = head;
+  block->prev_free = NULL;
+  if (head != NULL) {
+    head->prev_free = block;
+  }
+  tlsf->blocks[fl][sl] = block;
+  tlsf->fl_bitmap |= (1U << fl);
+  tlsf->sl_bitmap[fl] |= (1U << sl);
+  tlsf->free_bytes += block_size(block);
+  tlsf->free_blocks++;
+}
+
+static void remove_free_block(km_tlsf_t *tlsf, km_tlsf_block_t *block) {
+  int fl, sl;
+  mapping(block_size(block), &fl, &sl);
+  if (block->prev_free != NULL) {
+    block->prev_free->next_free = block->next_free;
+  } else {
+    tlsf->blocks[fl][sl] = block->next_free;
+    if (block->next_free == NULL) {
+      tlsf->sl_bitmap[fl] &= ~(1U << sl);
+      if (tlsf->sl_bitmap[fl] == 0) {
+        tlsf->fl_bitmap &= ~(1U << fl);
+      }
+    }
+  }
+  if (block->next_free != NULL) {
+    block->next_free->prev_free = block->prev_free;
+  }
+  tlsf->free_bytes -= block_size(block);
+  tlsf->free_blocks--;
+}
+
+/**
+ * Initialize the allocator on the memory. Returns false if the memory is
+ * too small or too large for the size classes.
+ */
+bool km_tlsf_init(km_tlsf_t *tlsf, void *mem, size_t size) {
+  uint8_t *start = (uint8_t *) ALIGN_UP((uintptr_t) mem);
+  if (size < (size_t) (start - (uint8_t *) mem) + 2 * KM_TLSF_HEADER_SIZE + KM_TLSF_MIN_SIZE) {
+    return false;
+  }
+  size = (size - (start - (uint8_t *) mem)) & ~(size_t) (KM_TLSF_ALIGN - 1);
+  /* one free block and the sentinel (used, zero size) at the end */
+  size_t payload = size - 2 * KM_TLSF_HEADER_SIZE;
+  if (payload >= KM_TLSF_MAX_SIZE) {
+    return false;
+  }
+  tlsf->fl_bitmap = 0;
+  for (int i = 0; i < KM_TLSF_FL_COUNT; i++) {
+    tlsf->sl_bitmap[i] = 0;
+    for (int j = 0; j < KM_TLSF_SL_COUNT; j++) {
+      tlsf->blocks[i][j] = NULL;
+    }
+  }
+  tlsf->start = start;
+  tlsf->end = start + size;
+  tlsf->free_bytes = 0;
+  tlsf->free_blocks = 0;
+  km_tlsf_block_t *block = (km_tlsf_block_t *) start;
+  block->prev_phys = NULL;
+  block->size = payload | KM_TLSF_FREE;
+  km_tlsf_block_t *sentinel = block_next_phys(block);
+  sentinel->prev_phys = block;
+  sentinel->size = 0;
+  insert_free_block(tlsf, block);
+  return true;
+}
+
+/**
+ * Allocate memory from the arena. Returns NULL if no free block is large
+ * enough.
+ */
+void *km_tlsf_malloc(km_tlsf_t *tlsf, size_t size) {
+  if (size > KM_TLSF_MAX_SIZE) {
+    return NULL;
+  }
+  size = ALIGN_UP(size);
+  if (size < KM_TLSF_MIN_SIZE) {
+    size = KM_TLSF_MIN_SIZE;
+  }
+  int fl, sl;
+  mapping_search(size, &fl, &sl);
+  if (fl >= KM_TLSF_FL_COUNT) {
+    return NULL;
+  }
+  /* the first non-empty list of the class or a larger one */
+  uint32_t sl_map = tlsf->sl_bitmap[fl] & (~0U << sl);
+  if (sl_map == 0) {
+    uint32_t fl_map = tlsf->fl_bitmap & (~0U << (fl + 1));
+    if (fl_map == 0) {
+      return NULL;
+    }
+    fl = ffs32(fl_map);
+    sl_map = tlsf->sl_bitmap[fl];
+  }
+  sl = ffs32(sl_map);
+  km_tlsf_block_t *block = tlsf->blocks[fl][sl];
+  remove_free_block(tlsf, block);
+  /* split off the remainder if it can be a block */
+  size_t remain = block_size(block) - size;
+  if (remain >= KM_TLSF_HEADER_SIZE + KM_TLSF_MIN_SIZE) {
+    block->size = size;
+    km_tlsf_block_t *rest = block_next_phys(block);
+    rest->prev_phys = block;
+    rest->size = (remain - KM_TLSF_HEADER_SIZE) | KM_TLSF_FREE;
+    block_next_phys(rest)->prev_phys = rest;
+    insert_free_block(tlsf, rest);
+  } else {
+    block->size &= ~(size_t) KM_TLSF_FREE;
+  }
+  return block_to_ptr(block);
+}
+
+/**
+ * Free memory to the arena, merged with the free neighbors
+ */
+void km_tlsf_free(km_tlsf_t *tlsf, void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  km_tlsf_block_t *block = block_from_ptr(ptr);
+  block->size |= KM_TLSF_FREE;
+  km_tlsf_block_t *prev = block->prev_phys;
+  if (prev != NULL && block_is_free(prev)) {
+    remove_free_block(tlsf, prev);
+    prev->size += KM_TLSF_HEADER_SIZE + block_size(block);
+    block = prev;
+  }
+  km_tlsf_block_t *next = block_next_phys(block);
+  if (block_is_free(next)) {
+    remove_free_block(tlsf, next);
+    block->size += KM_TLSF_HEADER_SIZE + block_size(next);
+    next = block_next_phys(block);
+  }
+  next->prev_phys = block;
+  insert_free_block(tlsf, block);
+}
+
+/**
+ * Whether the pointer is in the arena
+ */
+bool km_tlsf_owns(km_tlsf_t *tlsf, void *ptr) {
+  return (uint8_t *) ptr >= tlsf->start && (uint8_t *) ptr < tlsf->end;
+}
+
+/**
+ * Get the usage of the arena. The largest free block is found in the
+ * list of the largest size class, so it takes time in proportion to the
+ * length of the list.
+ */
+void km_tlsf_stats(km_tlsf_t *tlsf, km_tlsf_stats_t *stats) {
+  size_t size = tlsf->end - tlsf->start;
+  stats->size = size;
+  stats->free = tlsf->free_bytes;
+  stats->free_blocks = tlsf->free_blocks;
+  stats->used = size - tlsf->free_bytes - tlsf->free_blocks * KM_TLSF_HEADER_SIZE;
+  stats->largest_free = 0;
+  if (tlsf->fl_bitmap != 0) {
+    int fl = fls32(tlsf->fl_bitmap);
+    int sl = fls32(tlsf->sl_bitmap[fl]);
+    for (km_tlsf_block_t *block = tlsf->blocks[fl][sl]; block != NULL; block = block->next_free) {
+      if (block_size(block) > stats->largest_free) {
+        stats->largest_free = block_size(block);
+      }
+    }
+  }
+}
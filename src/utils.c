@@ -57,6 +57,201 @@ void km_list_remove(km_list_t *list, km_list_node_t *node) {
   }
 }
 
+/**
+ * Exchange a node with its direct child. Only links are swapped, so the
+ * items embedding the nodes stay where they are.
+ */
+static void km_heap_swap(km_heap_t *heap, km_heap_node_t *parent, km_heap_node_t *child) {
+  km_heap_node_t *sibling;
+  km_heap_node_t temp = *parent;
+  *parent = *child;
+  *child = temp;
+  parent->parent = child;
+  if (child->left == child) {
+    child->left = parent;
+    sibling = child->right;
+  } else {
+    child->right = parent;
+    sibling = child->left;
+  }
+  if (sibling != NULL) {
+    sibling->parent = child;
+  }
+  if (parent->left != NULL) {
+    parent->left->parent = parent;
+  }
+  if (parent->right != NULL) {
+    parent->right->parent = parent;
+  }
+  if (child->parent == NULL) {
+    heap->min = child;
+  } else if (child->parent->left == parent) {
+    child->parent->left = child;
+  } else {
+    child->parent->right = child;
+  }
+}
+
+/**
+ * Return the link which points to the n-th node (1-based, level order).
+ * The bits of n below the most significant one are the left(0)/right(1)
+ * turns from the root.
+ */
+static km_heap_node_t **km_heap_slot(km_heap_t *heap, uint32_t n, km_heap_node_t **parent) {
+  uint32_t path = 0;
+  uint32_t depth = 0;
+  for (; n >= 2; n /= 2) {
+    path = (path << 1) | (n & 1);
+    depth++;
+  }
+  km_heap_node_t **slot = &heap->min;
+  *parent = NULL;
+  while (depth > 0) {
+    *parent = *slot;
+    slot = (path & 1) ? &(*slot)->right : &(*slot)->left;
+    path >>= 1;
+    depth--;
+  }
+  return slot;
+}
+
+void km_heap_init(km_heap_t *heap) {
+  heap->min = NULL;
+  heap->length = 0;
+}
+
+km_heap_node_t *km_heap_min(km_heap_t *heap) {
+  return heap->min;
+}
+
+void km_heap_insert(km_heap_t *heap, km_heap_node_t *node, km_heap_less_cb less_than) {
+  km_heap_node_t *parent;
+  km_heap_node_t **slot = km_heap_slot(heap, heap->length + 1, &parent);
+  node->left = NULL;
+  node->right = NULL;
+  node->parent = parent;
+  *slot = node;
+  heap->length++;
+  while (node->parent != NULL && less_than(node, node->parent)) {
+    km_heap_swap(heap, node->parent, node);
+  }
+}
+
+void km_heap_remove(km_heap_t *heap, km_heap_node_t *node, km_heap_less_cb less_than) {
+  if (heap->length == 0) {
+    return;
+  }
+  /* detach the last node and move it to the place of the removed node */
+  km_heap_node_t *parent;
+  km_heap_node_t **slot = km_heap_slot(heap, heap->length, &parent);
+  km_heap_node_t *last = *slot;
+  *slot = NULL;
+  heap->length--;
+  if (last == node) {
+    if (heap->min == node) {
+      heap->min = NULL;
+    }
+    return;
+  }
+  last->left = node->left;
+  last->right = node->right;
+  last->parent = node->parent;
+  if (last->left != NULL) {
+    last->left->parent = last;
+  }
+  if (last->right != NULL) {
+    last->right->parent = last;
+  }
+  if (node->parent == NULL) {
+    heap->min = last;
+  } else if (node->parent->left == node) {
+    node->parent->left = last;
+  } else {
+    node->parent->right = last;
+  }
+  /* restore the heap order (sift down, then up) */
+  for (;;) {
+    km_heap_node_t *smallest = last;
+    if (last->left != NULL && less_than(last->left, smallest)) {
+      smallest = last->left;
+    }
+    if (last->right != NULL && less_than(last->right, smallest)) {
+      smallest = last->right;
+    }
+    if (smallest == last) {
+      break;
+    }
+    km_heap_swap(heap, last, smallest);
+  }
+  while (last->parent != NULL && less_than(last, last->parent)) {
+    km_heap_swap(heap, last->parent, last);
+  }
+}
+
+/* slab header, padded to keep the objects 8-byte aligned */
+typedef union {
+  void *next;
+  uint64_t align;
+} km_pool_slab_t;
+
+#define KM_POOL_ALIGN(size) (((size) + 7) & ~((size_t) 7))
+
+void km_pool_init(km_pool_t *pool, size_t obj_size, uint16_t slab_objs) {
+  if (obj_size < sizeof(void *)) {
+    obj_size = sizeof(void *);
+  }
+  pool->obj_size = KM_POOL_ALIGN(obj_size);
+  pool->slab_objs = slab_objs > 0 ? slab_objs : 1;
+  pool->free_list = NULL;
+  pool->slabs = NULL;
+  pool->total = 0;
+  pool->used = 0;
+  pool->high_water = 0;
+  pool->slab_count = 0;
+}
+
+/**
+ * Allocate an object from the pool. A new slab is allocated only when
+ * the free list is empty. Returns NULL if out of memory.
+ */
+void *km_pool_alloc(km_pool_t *pool) {
+  if (pool->free_list == NULL) {
+    km_pool_slab_t *slab = malloc(sizeof(km_pool_slab_t) + pool->obj_size * pool->slab_objs);
+    if (slab == NULL) {
+      return NULL;
+    }
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_count++;
+    pool->total += pool->slab_objs;
+    char *obj = (char *) (slab + 1);
+    for (uint16_t i = 0; i < pool->slab_objs; i++) {
+      *(void **) obj = pool->free_list;
+      pool->free_list = obj;
+      obj += pool->obj_size;
+    }
+  }
+  void *obj = pool->free_list;
+  pool->free_list = *(void **) obj;
+  pool->used++;
+  if (pool->used > pool->high_water) {
+    pool->high_water = pool->used;
+  }
+  return obj;
+}
+
+/**
+ * Return an object to the free list of the pool
+ */
+void km_pool_free(km_pool_t *pool, void *obj) {
+  if (obj == NULL) {
+    return;
+  }
+  *(void **) obj = pool->free_list;
+  pool->free_list = obj;
+  pool->used--;
+}
+
 uint8_t km_hex1(char hex) {
   if (hex >= 'a') {
     return (hex - 'a' + 10);
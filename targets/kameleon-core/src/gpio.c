@@ -116,3 +116,14 @@ int km_gpio_toggle(uint8_t pin) {
   HAL_GPIO_TogglePin(gpio_port_pin[pin].port, gpio_port_pin[pin].pin);
   return 0;
 }
+
+/**
+ * Pin interrupts (EXTI) are not supported yet, so watched pins are polled.
+ */
+int km_gpio_irq_enable(uint8_t pin, km_gpio_irq_mode_t mode, km_gpio_irq_cb cb) {
+  return KM_GPIOPORT_ERROR;
+}
+
+int km_gpio_irq_disable(uint8_t pin) {
+  return KM_GPIOPORT_ERROR;
+}
@@ -218,6 +218,26 @@ void km_micro_delay(uint32_t usec) {
   } while (time_diff / microseconds_cycle < usec);
 }
 
+/**
+ * Sleep until the next interrupt. SysTick wakes up the core every 1 msec.
+ */
+void km_system_wait_until(uint64_t deadline) {
+  if (km_gettime() < deadline && km_tty_available() == 0) {
+    __WFI();
+  }
+}
+
+/**
+ * SysTick may not wake up the core before the deadline in less than 1 msec,
+ * so return to the loop rather than oversleep.
+ */
+void km_system_wait_until_us(uint64_t deadline) {
+  uint64_t now = km_micro_gettime();
+  if (now < deadline && deadline - now >= 1000 && km_tty_available() == 0) {
+    __WFI();
+  }
+}
+
 /**
  * Kaluma Hardware System Initializations
  */
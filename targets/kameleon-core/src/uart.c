@@ -21,7 +21,9 @@
 #include <stdlib.h>
 #include "kameleon_core.h"
 #include "uart.h"
+#include "system.h"
 #include "ringbuffer.h"
+#include "memstats.h"
 
 UART_HandleTypeDef huart1;
 UART_HandleTypeDef huart2;
@@ -59,6 +61,7 @@ km_uart_pins_t km_uart_get_default_pins(uint8_t port) {
  */
 void uart_fill_ringbuffer(uint8_t port, uint8_t ch) {
   ringbuffer_write(&uart_rx_ringbuffer[port], &ch, sizeof(ch));
+  km_system_notify(KM_SYSTEM_EVENT_UART, port);
 }
 
 /**
@@ -94,7 +97,7 @@ int km_uart_setup(uint8_t port, uint32_t baudrate, uint8_t bits,
   puart->Init.Mode = UART_MODE_TX_RX;
   puart->Init.OverSampling = UART_OVERSAMPLING_16;
 
-  read_buffer[port] = (uint8_t *)malloc(buffer_size);
+  read_buffer[port] = (uint8_t *)km_malloc(KM_MEM_UART, buffer_size);
   if (read_buffer[port] == NULL) {
     return KM_UARTPORT_ERROR;
   } else {
@@ -160,7 +163,7 @@ int km_uart_close(uint8_t port) {
     return KM_UARTPORT_ERROR;
 
   if (read_buffer[port]) {
-    free(read_buffer[port]);
+    km_free(read_buffer[port]);
     read_buffer[port] = (uint8_t *)NULL;
   }
 
@@ -20,7 +20,6 @@ set(SOURCES
   ${SOURCES}
   ${TARGET_SRC_DIR}/startup_stm32f411xe.s
   ${TARGET_SRC_DIR}/adc.c
-  ${TARGET_SRC_DIR}/ringbuffer.c
   ${TARGET_SRC_DIR}/system.c
   ${TARGET_SRC_DIR}/gpio.c
   ${TARGET_SRC_DIR}/pwm.c
@@ -37,6 +36,7 @@ set(SOURCES
   ${TARGET_SRC_DIR}/uart.c
   ${TARGET_SRC_DIR}/i2c.c
   ${TARGET_SRC_DIR}/spi.c
+  ${TARGET_SRC_DIR}/worker.c
   ${TARGET_SHARED_DIR}/STM32F4xx_HAL_Driver/Src/stm32f4xx_hal_spi.c
   ${TARGET_SHARED_DIR}/STM32F4xx_HAL_Driver/Src/stm32f4xx_hal_uart.c
   ${TARGET_SHARED_DIR}/STM32F4xx_HAL_Driver/Src/stm32f4xx_hal_i2c.c
@@ -80,7 +80,7 @@ else()
   set(TARGET_LDSCRIPT ${TARGET_SRC_DIR}/STM32F411CETx_FLASH.ld)
 endif()
 
-set(KALUMA_MODULES events gpio led button pwm adc i2c spi uart graphics at storage stream http url startup)
+set(KALUMA_MODULES events gpio led button pwm adc i2c spi uart graphics at storage flash stream http url startup)
 
 set(CMAKE_SYSTEM_PROCESSOR cortex-m4)
 set(CMAKE_C_FLAGS "-mcpu=cortex-m4 -mlittle-endian -mthumb -mfpu=fpv4-sp-d16 -mfloat-abi=hard ${OPT} -Wall -fdata-sections -ffunction-sections")
@@ -0,0 +1,154 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Handle churn benchmark
+ *
+ * Creates and clears many timers like setTimeout()/clearTimeout() do while
+ * other variable sized blocks (like JerryScript external buffers) come and
+ * go, then reports the allocation time and the heap fragmentation. Run it
+ * with "malloc" to compare against plain malloc()/free() handles.
+ *
+ *   $ make bench_churn
+ *   $ ./bench_churn [pool|malloc] [timers]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "system.h"
+#include "io.h"
+
+#define LIVE_TIMERS 64
+#define LIVE_BLOCKS 256
+#define TIMERS_PER_ITERATION 16
+
+extern km_io_loop_t loop;
+
+static bool use_pool = true;
+static uint32_t max_timers = 100000;
+static uint32_t created = 0;
+static km_io_timer_handle_t *timers[LIVE_TIMERS];
+static void *blocks[LIVE_BLOCKS];
+
+static void timer_cb(km_io_timer_handle_t *timer) {}
+
+static km_io_timer_handle_t *alloc_timer() {
+  if (use_pool) {
+    return (km_io_timer_handle_t *) km_io_handle_alloc(KM_IO_TIMER);
+  }
+  return malloc(sizeof(km_io_timer_handle_t));
+}
+
+static void free_timer(km_io_timer_handle_t *timer) {
+  if (use_pool) {
+    km_pool_free(km_io_handle_pool(KM_IO_TIMER), timer);
+  } else {
+    free(timer);
+  }
+}
+
+static void close_cb(km_io_handle_t *handle) {
+  free_timer((km_io_timer_handle_t *) handle);
+}
+
+/**
+ * Measure the raw cost of allocating and freeing a handle
+ */
+static double measure_alloc() {
+  km_io_timer_handle_t *handles[LIVE_TIMERS];
+  for (int i = 0; i < LIVE_TIMERS; i++) {
+    handles[i] = alloc_timer();
+  }
+  uint64_t start = km_micro_gettime();
+  for (uint32_t i = 0; i < max_timers; i++) {
+    uint32_t slot = i % LIVE_TIMERS;
+    free_timer(handles[slot]);
+    handles[slot] = alloc_timer();
+  }
+  uint64_t elapsed = km_micro_gettime() - start;
+  for (int i = 0; i < LIVE_TIMERS; i++) {
+    free_timer(handles[i]);
+  }
+  return (double) elapsed * 1000 / max_timers;
+}
+
+static void idle_cb(km_io_idle_handle_t *idle) {
+  for (int i = 0; i < TIMERS_PER_ITERATION; i++) {
+    uint32_t slot = rand() % LIVE_TIMERS;
+    if (timers[slot] != NULL) {
+      km_io_timer_stop(timers[slot]);
+      km_io_handle_close((km_io_handle_t *) timers[slot], close_cb);
+    }
+    km_io_timer_handle_t *timer = alloc_timer();
+    km_io_timer_init(timer);
+    km_io_timer_start(timer, timer_cb, 3600000, false);
+    timers[slot] = timer;
+    created++;
+
+    /* replace a block of random size in between */
+    uint32_t b = rand() % LIVE_BLOCKS;
+    free(blocks[b]);
+    blocks[b] = malloc(16 + rand() % 512);
+  }
+  if (created >= max_timers) {
+    loop.stop_flag = true;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    use_pool = (strcmp(argv[1], "malloc") != 0);
+  }
+  if (argc > 2) {
+    max_timers = atoi(argv[2]);
+  }
+  srand(1);
+  io_init();
+  loop.time = km_gettime();
+  km_io_idle_handle_t idle;
+  km_io_idle_init(&idle);
+  km_io_idle_start(&idle, idle_cb);
+  km_io_timer_handle_t tick; /* keeps the loop from waiting */
+  km_io_timer_init(&tick);
+  km_io_timer_start(&tick, timer_cb, 0, true);
+
+  uint64_t start = km_micro_gettime();
+  io_run();
+  uint64_t elapsed = km_micro_gettime() - start;
+
+  printf("mode: %s, timers: %u\n", use_pool ? "pool" : "malloc", created);
+  printf("total: %llu us, per timer: %.3f us\n",
+    (unsigned long long) elapsed, (double) elapsed / created);
+  if (use_pool) {
+    km_pool_t *pool = km_io_handle_pool(KM_IO_TIMER);
+    printf("pool: slabs: %u, objects: %u, used: %u, high water: %u\n",
+      pool->slab_count, pool->total, pool->used, pool->high_water);
+  }
+#ifdef __GLIBC__
+  struct mallinfo2 mi = mallinfo2();
+  printf("heap: arena: %zu, in use: %zu, free: %zu, free chunks: %zu\n",
+    mi.arena, mi.uordblks, mi.fordblks, mi.ordblks);
+#endif
+  printf("alloc/free: %.1f ns\n", measure_alloc());
+  return 0;
+}
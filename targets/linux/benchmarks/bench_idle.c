@@ -0,0 +1,78 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Idle benchmark
+ *
+ * Runs the loop with a single 1 sec interval timer (like an idle script
+ * with `setInterval(fn, 1000)`) and reports the CPU utilization.
+ *
+ *   $ make bench_idle
+ *   $ ./bench_idle [seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include "system.h"
+#include "io.h"
+
+extern km_io_loop_t loop;
+
+static uint32_t seconds = 10;
+static uint32_t fired = 0;
+
+static void timer_cb(km_io_timer_handle_t *timer) {
+  fired++;
+  if (fired >= seconds) {
+    loop.stop_flag = true;
+  }
+}
+
+static uint64_t cpu_time() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (uint64_t) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+    usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    seconds = atoi(argv[1]);
+  }
+  io_init();
+  loop.time = km_gettime();
+
+  km_io_timer_handle_t interval;
+  km_io_timer_init(&interval);
+  km_io_timer_start(&interval, timer_cb, 1000, true);
+
+  uint64_t start = km_micro_gettime();
+  uint64_t start_cpu = cpu_time();
+  io_run();
+  uint64_t elapsed = km_micro_gettime() - start;
+  uint64_t elapsed_cpu = cpu_time() - start_cpu;
+
+  printf("fired: %u, wall: %llu us, cpu: %llu us\n", fired,
+    (unsigned long long) elapsed, (unsigned long long) elapsed_cpu);
+  printf("cpu utilization: %.2f %%\n", (double) elapsed_cpu * 100 / elapsed);
+  return 0;
+}
@@ -0,0 +1,107 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Periodic handle benchmark
+ *
+ * Compares a 1 ms interval timer with a periodic handle of the same period
+ * while another timer keeps the loop busy for a random time, and prints
+ * the latency of the callbacks from their schedule.
+ *
+ *   $ make bench_periodic
+ *   $ ./bench_periodic [period_us] [seconds] [catchup]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "system.h"
+#include "io.h"
+#include "linux.h"
+
+extern km_io_loop_t loop;
+
+static uint32_t period = 1000;
+static uint32_t seconds = 5;
+static uint64_t interval_start;
+static uint32_t interval_fired = 0;
+static uint32_t interval_max = 0;
+static uint64_t interval_sum = 0;
+
+static void interval_cb(km_io_timer_handle_t *timer) {
+  interval_fired++;
+  uint64_t due = interval_start + (uint64_t) interval_fired * period;
+  uint64_t now = km_micro_gettime();
+  uint32_t latency = (now > due) ? (uint32_t) (now - due) : 0;
+  interval_sum += latency;
+  if (latency > interval_max) {
+    interval_max = latency;
+  }
+}
+
+static void periodic_cb(km_io_periodic_handle_t *periodic) {
+}
+
+static void load_cb(km_io_timer_handle_t *timer) {
+  km_micro_delay(rand() % (period * 2)); /* busy for up to two periods */
+}
+
+static void stop_cb(km_io_timer_handle_t *timer) {
+  loop.stop_flag = true;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    period = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    seconds = atoi(argv[2]);
+  }
+  km_io_periodic_policy_t policy = KM_IO_PERIODIC_SKIP;
+  if (argc > 3 && atoi(argv[3]) != 0) {
+    policy = KM_IO_PERIODIC_CATCHUP;
+  }
+  io_init();
+  loop.time = km_gettime();
+
+  km_io_timer_handle_t interval, load, stop;
+  km_io_periodic_handle_t periodic;
+  km_io_timer_init(&interval);
+  km_io_timer_init(&load);
+  km_io_timer_init(&stop);
+  km_io_periodic_init(&periodic);
+  interval_start = km_micro_gettime();
+  km_io_timer_start(&interval, interval_cb, period / 1000, true);
+  km_io_periodic_start(&periodic, periodic_cb, period, policy);
+  km_io_timer_start(&load, load_cb, 50, true);
+  km_io_timer_start(&stop, stop_cb, seconds * 1000, false);
+  io_run();
+
+  km_io_periodic_stats_t *stats = &periodic.stats;
+  uint32_t expected = (uint32_t) ((uint64_t) seconds * 1000000 / period);
+  printf("period: %u us, %u s, expected callbacks: %u\n", period, seconds, expected);
+  printf("interval: fired %u, latency avg %.1f us, max %u us\n", interval_fired,
+    interval_fired > 0 ? (double) interval_sum / interval_fired : 0.0, interval_max);
+  printf("periodic (%s): fired %u, late %u, skipped %u, latency avg %.1f us, max %u us\n",
+    policy == KM_IO_PERIODIC_SKIP ? "skip" : "catchup", stats->fired, stats->late,
+    stats->skipped, stats->fired > 0 ? (double) stats->latency_sum / stats->fired : 0.0,
+    stats->max_latency);
+  return 0;
+}
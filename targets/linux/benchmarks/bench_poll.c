@@ -0,0 +1,134 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Poll handle benchmark
+ *
+ * A thread writes timestamps into a number of pipes at a fixed period
+ * while the loop polls the read ends, and measures the latency from a
+ * write to its callback. All pipes are waited in the same epoll wait as
+ * the timers.
+ *
+ *   $ make bench_poll
+ *   $ ./bench_poll [period_us] [writes] [pipes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "system.h"
+#include "io.h"
+#include "linux.h"
+
+#define MAX_PIPES 64
+
+extern km_io_loop_t loop;
+
+static uint32_t period = 100;
+static uint32_t max_writes = 100000;
+static uint32_t num_pipes = 8;
+static int fds[MAX_PIPES][2];
+static volatile bool done = false;
+static uint32_t reads = 0;
+static uint64_t latency_sum = 0;
+static uint32_t latency_max = 0;
+
+static void *write_thread(void *arg) {
+  uint64_t next = km_micro_gettime();
+  for (uint32_t i = 0; i < max_writes; i++) {
+    next += period;
+    while (km_micro_gettime() < next) {}
+    uint64_t now = km_micro_gettime();
+    (void) !write(fds[i % num_pipes][1], &now, sizeof(now));
+  }
+  done = true;
+  return NULL;
+}
+
+static void poll_cb(km_io_poll_handle_t *poll, uint8_t events) {
+  uint64_t stamps[16];
+  ssize_t n;
+  while ((n = read(poll->fd, stamps, sizeof(stamps))) > 0) {
+    uint64_t now = km_micro_gettime();
+    for (int i = 0; i < n / (int) sizeof(uint64_t); i++) {
+      uint32_t latency = (uint32_t) (now - stamps[i]);
+      latency_sum += latency;
+      if (latency > latency_max) {
+        latency_max = latency;
+      }
+      reads++;
+    }
+  }
+}
+
+static void check_cb(km_io_timer_handle_t *timer) {
+  if (done && reads >= max_writes) {
+    loop.stop_flag = true;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    period = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    max_writes = atoi(argv[2]);
+  }
+  if (argc > 3) {
+    num_pipes = atoi(argv[3]);
+    if (num_pipes < 1 || num_pipes > MAX_PIPES) {
+      num_pipes = MAX_PIPES;
+    }
+  }
+  io_init();
+  loop.time = km_gettime();
+
+  km_io_poll_handle_t polls[MAX_PIPES];
+  for (uint32_t i = 0; i < num_pipes; i++) {
+    if (pipe(fds[i]) < 0) {
+      perror("pipe");
+      return 1;
+    }
+    fcntl(fds[i][0], F_SETFL, O_NONBLOCK);
+    km_io_poll_init(&polls[i]);
+    km_io_poll_start(&polls[i], fds[i][0], KM_POLL_READABLE, poll_cb);
+  }
+  km_io_timer_handle_t check;
+  km_io_timer_init(&check);
+  km_io_timer_start(&check, check_cb, 10, true);
+
+  uint64_t start = km_micro_gettime();
+  pthread_t thread;
+  pthread_create(&thread, NULL, write_thread, NULL);
+  io_run();
+  pthread_join(thread, NULL);
+  uint64_t elapsed = km_micro_gettime() - start;
+
+  printf("period: %u us, writes: %u, pipes: %u, reads: %u\n", period,
+    max_writes, num_pipes, reads);
+  printf("latency: avg %.1f us, max %u us\n",
+    reads > 0 ? (double) latency_sum / reads : 0.0, latency_max);
+  printf("loop iterations: %u, elapsed: %.2f s\n",
+    loop.stats.iterations, elapsed / 1000000.0);
+  return 0;
+}
@@ -0,0 +1,204 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Ring buffer benchmark
+ *
+ * Measures write+read throughput for several chunk sizes against the
+ * previous byte-by-byte implementation, the find throughput, and checks
+ * the data passed between a producer thread and a consumer thread.
+ *
+ *   $ make bench_ringbuffer
+ *   $ ./bench_ringbuffer [megabytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ringbuffer.h"
+
+#define BUFFER_SIZE 2048
+
+static uint8_t storage[BUFFER_SIZE];
+static uint32_t total = 64 * 1024 * 1024;
+
+/* previous implementation (byte by byte with modulo) for comparison */
+
+static void legacy_read(ringbuffer_t *rb, uint8_t *buf, uint32_t len) {
+  uint32_t r_ptr = rb->r_ptr;
+  for (uint32_t k = 0; k < len; k++) {
+    buf[k] = rb->buf[r_ptr];
+    r_ptr = (r_ptr + 1) % rb->length;
+  }
+  rb->r_ptr = r_ptr;
+}
+
+static void legacy_write(ringbuffer_t *rb, uint8_t *buf, uint32_t len) {
+  uint32_t w_ptr = rb->w_ptr;
+  for (uint32_t k = 0; k < len; k++) {
+    rb->buf[w_ptr] = buf[k];
+    w_ptr = (w_ptr + 1) % rb->length;
+  }
+  rb->w_ptr = w_ptr;
+}
+
+static int legacy_find(ringbuffer_t *rb, uint8_t ch, uint32_t len) {
+  uint32_t r_ptr = rb->r_ptr % rb->length;
+  for (uint32_t n = 0; n < len; n++) {
+    if (rb->buf[r_ptr] == ch) {
+      return n;
+    }
+    r_ptr = (r_ptr + 1) % rb->length;
+  }
+  return -1;
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double mbps(uint32_t bytes, double seconds) {
+  return bytes / seconds / (1024 * 1024);
+}
+
+static void bench_copy(uint32_t chunk) {
+  uint8_t in[256], out[256];
+  memset(in, 'a', sizeof(in));
+  ringbuffer_t rb;
+  ringbuffer_init(&rb, storage, BUFFER_SIZE);
+  /* keep the buffer half full so that copies wrap around */
+  ringbuffer_write(&rb, in, chunk / 2 + 1);
+  double start = now();
+  for (uint32_t n = 0; n < total; n += chunk) {
+    ringbuffer_write(&rb, in, chunk);
+    ringbuffer_read(&rb, out, chunk);
+  }
+  double elapsed = now() - start;
+
+  ringbuffer_t legacy;
+  ringbuffer_init(&legacy, storage, BUFFER_SIZE);
+  legacy_write(&legacy, in, chunk / 2 + 1);
+  double legacy_start = now();
+  for (uint32_t n = 0; n < total; n += chunk) {
+    legacy_write(&legacy, in, chunk);
+    legacy_read(&legacy, out, chunk);
+  }
+  double legacy_elapsed = now() - legacy_start;
+  printf("chunk %3u: %8.1f MB/s (byte-wise %7.1f MB/s)\n", chunk,
+    mbps(total, elapsed), mbps(total, legacy_elapsed));
+}
+
+static void bench_find() {
+  ringbuffer_t rb;
+  ringbuffer_init(&rb, storage, BUFFER_SIZE);
+  uint8_t fill[BUFFER_SIZE];
+  memset(fill, 'a', sizeof(fill));
+  ringbuffer_write(&rb, fill, BUFFER_SIZE / 2);
+  ringbuffer_read(&rb, fill, BUFFER_SIZE / 2);
+  ringbuffer_write(&rb, fill, BUFFER_SIZE - 1);
+  uint32_t rounds = total / BUFFER_SIZE;
+  volatile int pos = 0;
+  double start = now();
+  for (uint32_t i = 0; i < rounds; i++) {
+    pos += ringbuffer_find(&rb, '\n');
+  }
+  double elapsed = now() - start;
+  double legacy_start = now();
+  for (uint32_t i = 0; i < rounds; i++) {
+    pos += legacy_find(&rb, '\n', BUFFER_SIZE - 1);
+  }
+  double legacy_elapsed = now() - legacy_start;
+  printf("find:      %8.1f MB/s (byte-wise %7.1f MB/s)\n",
+    mbps(rounds * BUFFER_SIZE, elapsed), mbps(rounds * BUFFER_SIZE, legacy_elapsed));
+}
+
+/* producer and consumer threads */
+
+static ringbuffer_t shared;
+
+static void *producer(void *arg) {
+  uint8_t chunk[64];
+  uint32_t seq = 0;
+  while (seq < total) {
+    uint32_t len = 1 + (seq % sizeof(chunk));
+    if (len > total - seq) {
+      len = total - seq;
+    }
+    if (ringbuffer_freespace(&shared) < len) {
+      sched_yield();
+      continue;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+      chunk[i] = (uint8_t) (seq + i);
+    }
+    ringbuffer_write(&shared, chunk, len);
+    seq += len;
+  }
+  return NULL;
+}
+
+static void bench_threads() {
+  ringbuffer_init(&shared, storage, BUFFER_SIZE);
+  pthread_t thread;
+  double start = now();
+  pthread_create(&thread, NULL, producer, NULL);
+  uint8_t chunk[128];
+  uint32_t seq = 0;
+  uint32_t errors = 0;
+  while (seq < total) {
+    uint32_t len = ringbuffer_length(&shared);
+    if (len == 0) {
+      sched_yield();
+      continue;
+    }
+    if (len > sizeof(chunk)) {
+      len = sizeof(chunk);
+    }
+    ringbuffer_read(&shared, chunk, len);
+    for (uint32_t i = 0; i < len; i++) {
+      if (chunk[i] != (uint8_t) (seq + i)) {
+        errors++;
+      }
+    }
+    seq += len;
+  }
+  pthread_join(thread, NULL);
+  double elapsed = now() - start;
+  printf("threads:   %8.1f MB/s, errors: %u\n", mbps(total, elapsed), errors);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    total = atoi(argv[1]) * 1024 * 1024;
+  }
+  bench_copy(1);
+  bench_copy(16);
+  bench_copy(64);
+  bench_copy(256);
+  bench_find();
+  bench_threads();
+  return 0;
+}
@@ -0,0 +1,84 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Timer benchmark
+ *
+ * Arms many timers which are far from due (plus a zero interval timer which
+ * keeps the loop from waiting) and measures the average cost of a loop
+ * iteration.
+ *
+ *   $ make bench_timer
+ *   $ ./bench_timer [timers] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "system.h"
+#include "io.h"
+
+extern km_io_loop_t loop;
+
+static uint32_t iterations = 0;
+static uint32_t max_iterations = 100000;
+static uint32_t fired = 0;
+
+static void idle_cb(km_io_idle_handle_t *idle) {
+  iterations++;
+  if (iterations >= max_iterations) {
+    loop.stop_flag = true;
+  }
+}
+
+static void timer_cb(km_io_timer_handle_t *timer) {
+  fired++;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t count = (argc > 1) ? atoi(argv[1]) : 10000;
+  if (argc > 2) {
+    max_iterations = atoi(argv[2]);
+  }
+  io_init();
+  loop.time = km_gettime();
+
+  km_io_timer_handle_t *timers = malloc(sizeof(km_io_timer_handle_t) * count);
+  for (uint32_t i = 0; i < count; i++) {
+    km_io_timer_init(&timers[i]);
+    km_io_timer_start(&timers[i], timer_cb, 3600000 + i, false);
+  }
+  km_io_timer_handle_t tick;
+  km_io_timer_init(&tick);
+  km_io_timer_start(&tick, timer_cb, 0, true);
+  km_io_idle_handle_t idle;
+  km_io_idle_init(&idle);
+  km_io_idle_start(&idle, idle_cb);
+
+  uint64_t start = km_micro_gettime();
+  io_run();
+  uint64_t elapsed = km_micro_gettime() - start;
+
+  printf("timers: %u, iterations: %u, fired: %u\n", count, iterations, fired);
+  printf("total: %llu us, per iteration: %.3f us\n",
+    (unsigned long long) elapsed, (double) elapsed / iterations);
+  free(timers);
+  return 0;
+}
@@ -0,0 +1,168 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * TLSF allocation latency benchmark
+ *
+ * Runs the same random mix of allocations and frees (sizes like the rx
+ * buffers, the 256-byte storage/flash pages and the work data) on the
+ * TLSF arena and on malloc(), and reports the latency percentiles of
+ * each operation and the fragmentation of the arena at the end.
+ *
+ *   $ make bench_tlsf
+ *   $ ./bench_tlsf [operations] [arena KB]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "tlsf.h"
+
+#define LIVE_BLOCKS 128
+
+static uint32_t operations = 1000000;
+static size_t arena_size = 64 * 1024;
+static uint8_t *arena;
+static km_tlsf_t tlsf;
+static uint32_t *samples;
+
+static inline uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+  return (x > y) - (x < y);
+}
+
+static size_t random_size() {
+  switch (rand() % 4) {
+    case 0: return 256; /* storage/flash page */
+    case 1: return 16 + rand() % 48; /* small handles and work data */
+    case 2: return 64 + rand() % 448; /* rx buffers */
+    default: return 512 + rand() % 1536; /* uart buffers */
+  }
+}
+
+static void *tlsf_alloc(size_t size) {
+  return km_tlsf_malloc(&tlsf, size);
+}
+
+static void tlsf_release(void *ptr) {
+  km_tlsf_free(&tlsf, ptr);
+}
+
+static void report(const char *name, const char *op, uint32_t count) {
+  if (count == 0) {
+    return;
+  }
+  qsort(samples, count, sizeof(uint32_t), compare_u32);
+  uint64_t sum = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    sum += samples[i];
+  }
+  printf("%-6s %-5s avg %6.1f ns, p50 %5u, p99 %5u, p99.9 %6u, max %7u ns\n",
+    name, op, (double) sum / count, samples[count / 2], samples[count * 99 / 100],
+    samples[count * 999 / 1000], samples[count - 1]);
+}
+
+/**
+ * Run the operations with the allocator and report the latencies. The
+ * random sequence is the same for both allocators.
+ */
+static uint32_t run(const char *name, void *(*alloc_fn)(size_t), void (*free_fn)(void *)) {
+  void *blocks[LIVE_BLOCKS] = { NULL };
+  uint32_t allocs = 0, frees = 0, failures = 0;
+  /* the latencies of allocs first, and of frees from the end */
+  uint32_t *free_samples = samples + operations;
+  srand(1);
+  for (uint32_t n = 0; n < operations; n++) {
+    int i = rand() % LIVE_BLOCKS;
+    if (blocks[i] == NULL) {
+      size_t size = random_size();
+      uint64_t start = now_ns();
+      blocks[i] = alloc_fn(size);
+      samples[allocs++] = (uint32_t) (now_ns() - start);
+      if (blocks[i] == NULL) {
+        failures++;
+      } else {
+        memset(blocks[i], 0xA5, size);
+      }
+    } else {
+      uint64_t start = now_ns();
+      free_fn(blocks[i]);
+      *(--free_samples) = (uint32_t) (now_ns() - start);
+      frees++;
+      blocks[i] = NULL;
+    }
+  }
+  report(name, "alloc", allocs);
+  memmove(samples, free_samples, frees * sizeof(uint32_t));
+  report(name, "free", frees);
+  for (int i = 0; i < LIVE_BLOCKS; i++) {
+    if (blocks[i] != NULL) {
+      free_fn(blocks[i]);
+    }
+  }
+  return failures;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    operations = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    arena_size = atoi(argv[2]) * 1024;
+  }
+  arena = malloc(arena_size);
+  samples = malloc(operations * 2 * sizeof(uint32_t));
+  if (arena == NULL || samples == NULL || !km_tlsf_init(&tlsf, arena, arena_size)) {
+    printf("Failed to initialize.\n");
+    return 1;
+  }
+  printf("operations: %u, live blocks: %u, arena: %zu bytes\n", operations, LIVE_BLOCKS, arena_size);
+  run("malloc", malloc, free);
+  uint32_t failures = run("tlsf", tlsf_alloc, tlsf_release);
+
+  /* fragmentation with the live blocks of a second run kept */
+  km_tlsf_stats_t stats;
+  km_tlsf_stats(&tlsf, &stats);
+  printf("tlsf out of memory: %u, free after run: %u in %u block(s)\n",
+    failures, stats.free, stats.free_blocks);
+  srand(2);
+  void *blocks[LIVE_BLOCKS];
+  for (int i = 0; i < LIVE_BLOCKS; i++) {
+    blocks[i] = km_tlsf_malloc(&tlsf, random_size());
+  }
+  for (int i = 0; i < LIVE_BLOCKS; i += 2) {
+    km_tlsf_free(&tlsf, blocks[i]);
+  }
+  km_tlsf_stats(&tlsf, &stats);
+  printf("half freed: used %u, free %u in %u block(s), largest %u, fragmentation %u%%\n",
+    stats.used, stats.free, stats.free_blocks, stats.largest_free,
+    stats.free > 0 ? 100 - (uint32_t) ((uint64_t) stats.largest_free * 100 / stats.free) : 0);
+  free(samples);
+  free(arena);
+  return 0;
+}
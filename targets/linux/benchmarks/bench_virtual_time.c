@@ -0,0 +1,99 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Virtual time benchmark
+ *
+ * Runs a long horizon of interval timers with the virtual clock, where the
+ * loop jumps to the next deadline instead of waiting, then reports the
+ * callback counts and a checksum of the callback order. Two runs with the
+ * same arguments must print the same counts and checksum.
+ *
+ *   $ make bench_virtual_time
+ *   $ ./bench_virtual_time [hours]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "system.h"
+#include "io.h"
+#include "linux.h"
+
+extern km_io_loop_t loop;
+
+static const uint64_t intervals[] = { 1, 7, 10, 100, 1000, 60000 };
+#define TIMER_NUM (sizeof(intervals) / sizeof(intervals[0]))
+
+static km_io_timer_handle_t timers[TIMER_NUM];
+static km_io_timer_handle_t stopper;
+static uint32_t counts[TIMER_NUM];
+static uint32_t checksum = 2166136261U;
+
+static void timer_cb(km_io_timer_handle_t *timer) {
+  uint32_t index = timer - timers;
+  counts[index]++;
+  /* FNV-1a over the order of the callbacks and the loop time */
+  checksum = (checksum ^ index) * 16777619U;
+  checksum = (checksum ^ (uint32_t) loop.time) * 16777619U;
+}
+
+static uint64_t wall_micros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void stopper_cb(km_io_timer_handle_t *timer) {
+  loop.stop_flag = true;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t hours = 1;
+  if (argc > 1) {
+    hours = atoi(argv[1]);
+  }
+  km_system_set_virtual_time(true);
+  io_init();
+  loop.time = km_gettime();
+  for (uint32_t i = 0; i < TIMER_NUM; i++) {
+    km_io_timer_init(&timers[i]);
+    km_io_timer_start(&timers[i], timer_cb, intervals[i], true);
+  }
+  km_io_timer_init(&stopper);
+  km_io_timer_start(&stopper, stopper_cb, (uint64_t) hours * 3600000, false);
+
+  uint64_t virtual_start = km_micro_gettime();
+  uint64_t start = wall_micros();
+  io_run();
+  uint64_t elapsed = wall_micros() - start;
+  uint64_t virtual_elapsed = km_micro_gettime() - virtual_start;
+
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < TIMER_NUM; i++) {
+    printf("interval %6llu ms: %u callbacks\n", (unsigned long long) intervals[i], counts[i]);
+    total += counts[i];
+  }
+  printf("virtual: %.1f s, wall: %.1f ms, callbacks: %u (%.0f/s)\n",
+    virtual_elapsed / 1e6, elapsed / 1e3, total, total / (elapsed / 1e6));
+  printf("iterations: %u, checksum: %08x\n", km_io_stats()->iterations, checksum);
+  return 0;
+}
@@ -0,0 +1,107 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * GPIO watch benchmark
+ *
+ * A thread toggles a simulated pin (acting as the interrupt context) at a
+ * fixed period while the loop watches the pin, and measures the latency
+ * from an edge to its callback and the edges missed.
+ *
+ *   $ make bench_watch
+ *   $ ./bench_watch [period_us] [edges]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "system.h"
+#include "gpio.h"
+#include "io.h"
+#include "linux.h"
+
+#define PIN 5
+
+extern km_io_loop_t loop;
+
+static uint32_t period = 100;
+static uint32_t max_edges = 100000;
+static volatile bool done = false;
+static uint32_t callbacks = 0;
+static uint64_t latency_sum = 0;
+static uint32_t latency_max = 0;
+
+static void *toggle_thread(void *arg) {
+  uint64_t next = km_micro_gettime();
+  for (uint32_t i = 0; i < max_edges; i++) {
+    next += period;
+    while (km_micro_gettime() < next) {}
+    km_gpio_sim_drive(PIN, (i + 1) & 1);
+  }
+  done = true;
+  return NULL;
+}
+
+static void watch_cb(km_io_watch_handle_t *watch) {
+  uint32_t latency = (uint32_t) km_micro_gettime() - watch->edge_time;
+  latency_sum += latency;
+  if (latency > latency_max) {
+    latency_max = latency;
+  }
+  callbacks++;
+}
+
+static void check_cb(km_io_timer_handle_t *timer) {
+  if (done) {
+    loop.stop_flag = true;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    period = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    max_edges = atoi(argv[2]);
+  }
+  km_gpio_init();
+  io_init();
+  loop.time = km_gettime();
+
+  km_io_watch_handle_t watch;
+  km_io_watch_init(&watch);
+  km_io_watch_start(&watch, watch_cb, PIN, KM_IO_WATCH_MODE_CHANGE, 0);
+  km_io_timer_handle_t check;
+  km_io_timer_init(&check);
+  km_io_timer_start(&check, check_cb, 10, true);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, toggle_thread, NULL);
+  io_run();
+  pthread_join(thread, NULL);
+
+  printf("period: %u us, edges: %u, callbacks: %u\n", period, max_edges, callbacks);
+  printf("missed: %u (ring overflow: %u)\n", max_edges - callbacks,
+    km_io_watch_missed_edges(PIN));
+  printf("latency: avg %.1f us, max %u us\n",
+    callbacks > 0 ? (double) latency_sum / callbacks : 0.0, latency_max);
+  return 0;
+}
@@ -0,0 +1,53 @@
+# Benchmarks for the Linux target. These are not built by default:
+#
+#   $ cmake .. -DTARGET=linux
+#   $ make bench_timer bench_idle bench_churn bench_watch bench_ringbuffer
+#   $ make bench_virtual_time bench_poll bench_periodic bench_tlsf
+
+set(BENCH_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+set(BENCH_PORT_SOURCES
+  ${TARGET_SRC_DIR}/adc.c
+  ${TARGET_SRC_DIR}/system.c
+  ${TARGET_SRC_DIR}/gpio.c
+  ${TARGET_SRC_DIR}/pwm.c
+  ${TARGET_SRC_DIR}/tty.c
+  ${TARGET_SRC_DIR}/uart.c
+  ${TARGET_SRC_DIR}/i2c.c
+  ${TARGET_SRC_DIR}/spi.c
+  ${TARGET_SRC_DIR}/worker.c)
+
+set(BENCH_IO_SOURCES
+  ${SRC_DIR}/io.c
+  ${SRC_DIR}/utils.c
+  ${SRC_DIR}/memtags.c
+  ${SRC_DIR}/tlsf.c
+  ${SRC_DIR}/ringbuffer.c
+  ${BENCH_PORT_SOURCES})
+
+add_executable(bench_timer EXCLUDE_FROM_ALL ${BENCH_DIR}/bench_timer.c ${BENCH_IO_SOURCES})
+target_link_libraries(bench_timer c m pthread)
+
+add_executable(bench_idle EXCLUDE_FROM_ALL ${BENCH_DIR}/bench_idle.c ${BENCH_IO_SOURCES})
+target_link_libraries(bench_idle c m pthread)
+
+add_executable(bench_churn EXCLUDE_FROM_ALL ${BENCH_DIR}/bench_churn.c ${BENCH_IO_SOURCES})
+target_link_libraries(bench_churn c m pthread)
+
+add_executable(bench_watch EXCLUDE_FROM_ALL ${BENCH_DIR}/bench_watch.c ${BENCH_IO_SOURCES})
+target_link_libraries(bench_watch c m pthread)
+
+add_executable(bench_virtual_time EXCLUDE_FROM_ALL ${BENCH_DIR}/bench_virtual_time.c ${BENCH_IO_SOURCES})
+target_link_libraries(bench_virtual_time c m pthread)
+
+add_executable(bench_poll EXCLUDE_FROM_ALL ${BENCH_DIR}/bench_poll.c ${BENCH_IO_SOURCES})
+target_link_libraries(bench_poll c m pthread)
+
+add_executable(bench_periodic EXCLUDE_FROM_ALL ${BENCH_DIR}/bench_periodic.c ${BENCH_IO_SOURCES})
+target_link_libraries(bench_periodic c m pthread)
+
+add_executable(bench_ringbuffer EXCLUDE_FROM_ALL ${BENCH_DIR}/bench_ringbuffer.c ${SRC_DIR}/ringbuffer.c)
+target_link_libraries(bench_ringbuffer c m pthread)
+
+add_executable(bench_tlsf EXCLUDE_FROM_ALL ${BENCH_DIR}/bench_tlsf.c ${SRC_DIR}/tlsf.c)
+target_link_libraries(bench_tlsf c m)
@@ -31,4 +31,33 @@
 // #define LED_NUM 1
 // #define BUTTON_NUM 1
 
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Enable or disable the virtual clock. While enabled, the time moves only
+ * by km_delay()/km_micro_delay() and jumps to the next deadline when the
+ * loop would wait. Also enabled by the KALUMA_VIRTUAL_TIME environment
+ * variable at km_system_init().
+ */
+void km_system_set_virtual_time(bool enable);
+bool km_system_is_virtual_time();
+
+/**
+ * Wake up km_system_wait_until() from another thread (e.g. a simulated
+ * interrupt)
+ */
+void km_system_wakeup();
+
+/**
+ * Read the available input of the descriptor into the TTY buffer. Returns
+ * -1 if the descriptor is closed.
+ */
+int km_tty_fill(int fd);
+
+/**
+ * Drive a simulated GPIO pin as an external signal
+ */
+void km_gpio_sim_drive(uint8_t pin, uint8_t value);
+
 #endif /* __LINUX_H */
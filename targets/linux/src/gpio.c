@@ -20,26 +20,101 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include "gpio.h"
+#include "system.h"
+#include "linux.h"
+
+/**
+ * Simulated pins. Writes to a pin (or driving it by km_gpio_sim_drive() as
+ * an external signal) changes its value and raises the pin interrupt on
+ * the enabled edges.
+ */
+#define GPIO_SIM_NUM 32
+
+static volatile uint8_t __gpio_value[GPIO_SIM_NUM];
+static km_gpio_irq_mode_t __gpio_irq_mode[GPIO_SIM_NUM];
+static volatile km_gpio_irq_cb __gpio_irq_cb[GPIO_SIM_NUM];
+
+static void __gpio_set_value(uint8_t pin, uint8_t value) {
+  value = value ? 1 : 0;
+  if (__gpio_value[pin] == value) {
+    return;
+  }
+  __gpio_value[pin] = value;
+  km_gpio_irq_cb cb = __gpio_irq_cb[pin];
+  uint8_t edge = value ? KM_GPIO_IRQ_EDGE_RISE : KM_GPIO_IRQ_EDGE_FALL;
+  if (cb != NULL && (__gpio_irq_mode[pin] & edge)) {
+    cb(pin, value, km_micro_gettime());
+    km_system_wakeup();
+  }
+}
 
 void km_gpio_init() {
+  for (int i = 0; i < GPIO_SIM_NUM; i++) {
+    __gpio_value[i] = 0;
+    __gpio_irq_cb[i] = NULL;
+  }
 }
 
 void km_gpio_cleanup() {
+  km_gpio_init();
 }
 
 int km_gpio_set_io_mode(uint8_t pin, km_gpio_io_mode_t mode) {
+  if (pin >= GPIO_SIM_NUM) {
+    return KM_GPIOPORT_ERROR;
+  }
   return 0;
 }
 
 int km_gpio_write(uint8_t pin, uint8_t value) {
+  if (pin >= GPIO_SIM_NUM) {
+    return KM_GPIOPORT_ERROR;
+  }
+  __gpio_set_value(pin, value);
   return 0;
 }
 
 int km_gpio_read(uint8_t pin) {
-  return 0;
+  if (pin >= GPIO_SIM_NUM) {
+    return KM_GPIOPORT_ERROR;
+  }
+  return __gpio_value[pin];
 }
 
 int km_gpio_toggle(uint8_t pin) {
+  if (pin >= GPIO_SIM_NUM) {
+    return KM_GPIOPORT_ERROR;
+  }
+  __gpio_set_value(pin, !__gpio_value[pin]);
   return 0;
 }
+
+int km_gpio_irq_enable(uint8_t pin, km_gpio_irq_mode_t mode, km_gpio_irq_cb cb) {
+  if (pin >= GPIO_SIM_NUM) {
+    return KM_GPIOPORT_ERROR;
+  }
+  __gpio_irq_mode[pin] = mode;
+  __gpio_irq_cb[pin] = cb;
+  return 0;
+}
+
+int km_gpio_irq_disable(uint8_t pin) {
+  if (pin >= GPIO_SIM_NUM) {
+    return KM_GPIOPORT_ERROR;
+  }
+  __gpio_irq_cb[pin] = NULL;
+  return 0;
+}
+
+/**
+ * Drive the simulated pin as an external signal. The interrupt callback
+ * runs in the calling thread, which acts as the interrupt context, so only
+ * one thread should drive the pins with interrupts.
+ */
+void km_gpio_sim_drive(uint8_t pin, uint8_t value) {
+  if (pin < GPIO_SIM_NUM) {
+    __gpio_set_value(pin, value);
+  }
+}
@@ -0,0 +1,189 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "jerryscript.h"
+#include "system.h"
+#include "gpio.h"
+#include "tty.h"
+#include "io.h"
+#include "repl.h"
+#include "runtime.h"
+
+/**
+ * Without a script, run the REPL as on the boards. With a script (source
+ * or snapshot), run it and exit when no referenced handle is left (the exit
+ * code is 1 if the script throws). With --compile, write the script compiled
+ * to a snapshot (which can be written to flash by .flash -w) and exit.
+ *
+ *   $ ./linux.elf [--stats] [script.js|script.snapshot]
+ *   $ ./linux.elf --compile script.snapshot script.js
+ */
+
+static void print_usage(const char *name) {
+  fprintf(stderr, "Usage: %s [--stats] [script.js|script.snapshot]\n", name);
+  fprintf(stderr, "       %s --compile script.snapshot script.js\n", name);
+}
+
+static uint8_t *read_script(const char *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t *script = (length >= 0) ? (uint8_t *) malloc(length + 1) : NULL;
+  if (script != NULL && fread(script, 1, length, file) != (size_t) length) {
+    free(script);
+    script = NULL;
+  }
+  fclose(file);
+  *size = (size_t) length;
+  return script;
+}
+
+/**
+ * Compile the script to a snapshot file
+ */
+static bool compile_script(const uint8_t *script, size_t size, const char *output) {
+  size_t buffer_size = ((size * 2 + 1024) + 3) & ~3;
+  uint32_t *buffer = (uint32_t *) malloc(buffer_size);
+  if (buffer == NULL) {
+    return false;
+  }
+  size_t snapshot_size = km_runtime_compile(script, size, buffer, buffer_size);
+  bool success = false;
+  if (snapshot_size > 0) {
+    FILE *file = fopen(output, "wb");
+    if (file != NULL) {
+      success = (fwrite(buffer, 1, snapshot_size, file) == snapshot_size);
+      fclose(file);
+    }
+    if (!success) {
+      fprintf(stderr, "Cannot write %s\n", output);
+    }
+  }
+  free(buffer);
+  return success;
+}
+
+/**
+ * Print the run time, loop and memory statistics to stderr
+ */
+static void print_stats(uint64_t start, uint64_t load_time) {
+  km_io_loop_stats_t *stats = km_io_stats();
+  uint32_t callbacks = 0;
+  for (int i = 0; i < KM_IO_PHASE_COUNT; i++) {
+    callbacks += stats->phases[i].callbacks;
+  }
+  fprintf(stderr, "time: %.3f ms (load %.3f ms)\n",
+    (km_micro_gettime() - start) / 1000.0, load_time / 1000.0);
+  fprintf(stderr, "loop: %u iterations, %u callbacks, max lag %u us\n",
+    stats->iterations, callbacks, stats->max_lag);
+  jerry_heap_stats_t heap = {0};
+  if (jerry_get_memory_stats(&heap)) {
+    fprintf(stderr, "heap: total %u, occupied %u, peak %u\n",
+      (unsigned) heap.size, (unsigned) heap.allocated_bytes,
+      (unsigned) heap.peak_allocated_bytes);
+  }
+  const km_boot_trace_t *trace;
+  uint8_t count = km_boot_trace_get(&trace);
+  for (int i = 0; i < count; i++) {
+    fprintf(stderr, "boot: %-8s %-10s %8.3f ms (%.3f ms)\n", trace[i].stage,
+      trace[i].name != NULL ? trace[i].name : "", trace[i].time / 1000.0,
+      trace[i].duration / 1000.0);
+  }
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    fprintf(stderr, "max rss: %ld KB\n", usage.ru_maxrss);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  bool stats = false;
+  const char *path = NULL;
+  const char *output = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stats") == 0) {
+      stats = true;
+    } else if (strcmp(argv[i], "--compile") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (argv[i][0] == '-' || path != NULL) {
+      print_usage(argv[0]);
+      return 2;
+    } else {
+      path = argv[i];
+    }
+  }
+  km_boot_trace_reset();
+  km_system_init();
+  km_boot_trace("system");
+  bool load = (path == NULL) && km_running_script_check();
+  km_tty_init();
+  km_boot_trace("tty");
+  io_init();
+  km_boot_trace("io");
+  if (path == NULL && output != NULL) {
+    print_usage(argv[0]);
+    return 2;
+  }
+  if (path == NULL) {
+    km_repl_init();
+    km_boot_trace("repl");
+    km_runtime_init(load, true);
+    io_run();
+    return 0;
+  }
+  size_t size = 0;
+  uint8_t *script = read_script(path, &size);
+  if (script == NULL) {
+    fprintf(stderr, "Cannot read %s\n", path);
+    return 2;
+  }
+  uint64_t start = km_micro_gettime();
+  km_runtime_init(false, true);
+  bool success;
+  if (output != NULL) {
+    success = compile_script(script, size, output);
+  } else {
+    /* a snapshot is executed in place, so the script is kept until cleanup */
+    uint64_t load_start = km_micro_gettime();
+    if (km_runtime_is_snapshot(script, size)) {
+      success = km_runtime_run_snapshot(script, size);
+    } else {
+      success = km_runtime_run_script(script, size);
+    }
+    uint64_t load_time = km_micro_gettime() - load_start;
+    if (success) {
+      io_run_alive();
+    }
+    if (stats) {
+      print_stats(start, load_time);
+    }
+  }
+  km_runtime_cleanup();
+  free(script);
+  return success ? 0 : 1;
+}
@@ -19,7 +19,18 @@
  * SOFTWARE.
  */
 
+#define _GNU_SOURCE /* ppoll */
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
 #include "system.h"
+#include "fdpoll.h"
 #include "tty.h"
 #include "gpio.h"
 #include "adc.h"
@@ -27,44 +38,231 @@
 #include "i2c.h"
 #include "spi.h"
 #include "uart.h"
+#include "linux.h"
 
 const char km_system_arch[] = "i686";
 const char km_system_platform[] = "linux";
 
+/**
+ * Virtual clock. While enabled, the time does not pass by itself: it moves
+ * forward only by the delays and jumps to the deadline when the loop waits,
+ * so timer heavy scripts run as fast as possible with reproducible ordering.
+ * The clock starts at 1 second, since some handles treat 0 as "no time".
+ */
+static volatile bool __virtual_time = false;
+static uint64_t __virtual_micros = 1000000;
+
+static void __virtual_advance(uint64_t usec) {
+  __atomic_add_fetch(&__virtual_micros, usec, __ATOMIC_RELAXED);
+}
+
+void km_system_set_virtual_time(bool enable) {
+  __virtual_time = enable;
+}
+
+bool km_system_is_virtual_time() {
+  return __virtual_time;
+}
+
 /**
 */
 void km_delay(uint32_t msec) {
+  if (__virtual_time) {
+    __virtual_advance((uint64_t) msec * 1000);
+    return;
+  }
+  usleep(msec * 1000);
 }
 
 /**
+ * Return current time in milliseconds (monotonic clock)
 */
 uint64_t km_gettime() {
-  return 0;
+  return km_micro_gettime() / 1000;
 }
 
 /**
  * Return MAX of the micro seconde counter 44739242
 */
 uint64_t km_micro_maxtime() {
-  return 0;
+  return 0xFFFFFFFFFFFFFFFF; // Max of the uint64()
 }
 /**
  * Return micro seconde counter
 */
 uint64_t km_micro_gettime() {
-  return 0;
+  if (__virtual_time) {
+    return __atomic_load_n(&__virtual_micros, __ATOMIC_RELAXED);
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
 /**
  * micro secoded delay
 */
 void km_micro_delay(uint32_t usec) {
+  if (__virtual_time) {
+    __virtual_advance(usec);
+    return;
+  }
+  usleep(usec);
+}
+
+/**
+ * All waits go through one epoll instance watching the self-pipe (to wake
+ * up from the simulated interrupts), stdin for the TTY and the descriptors
+ * of the poll handles. The events of the poll handles are kept until the
+ * loop takes them by km_poll_events().
+ */
+#define __POLL_EVENTS_MAX 32
+#define __POLL_DATA_WAKEUP (1ULL << 32)
+#define __POLL_DATA_TTY ((1ULL << 32) + 1)
+
+static int __epoll_fd = -1;
+static int __wakeup_fds[2] = { -1, -1 };
+static pthread_once_t __poll_once = PTHREAD_ONCE_INIT;
+static km_poll_event_t __poll_ready[__POLL_EVENTS_MAX];
+static int __poll_ready_count = 0;
+static bool __poll_waited = false;
+
+static void __poll_init() {
+  __epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event ev = { .events = EPOLLIN };
+  if (pipe(__wakeup_fds) == 0) {
+    fcntl(__wakeup_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(__wakeup_fds[1], F_SETFL, O_NONBLOCK);
+    ev.data.u64 = __POLL_DATA_WAKEUP;
+    epoll_ctl(__epoll_fd, EPOLL_CTL_ADD, __wakeup_fds[0], &ev);
+  }
+  ev.data.u64 = __POLL_DATA_TTY;
+  epoll_ctl(__epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &ev);
+}
+
+void km_system_wakeup() {
+  pthread_once(&__poll_once, __poll_init);
+  if (__wakeup_fds[1] >= 0) {
+    char c = 0;
+    (void) !write(__wakeup_fds[1], &c, 1);
+  }
+}
+
+static uint32_t __poll_to_epoll(uint8_t events) {
+  return ((events & KM_POLL_READABLE) ? EPOLLIN : 0) |
+    ((events & KM_POLL_WRITABLE) ? EPOLLOUT : 0);
+}
+
+static int __poll_ctl(int op, int fd, uint8_t events, uint32_t id) {
+  pthread_once(&__poll_once, __poll_init);
+  struct epoll_event ev = { .events = __poll_to_epoll(events), .data.u64 = id };
+  return (epoll_ctl(__epoll_fd, op, fd, &ev) < 0) ? -1 : 0;
+}
+
+int km_poll_add(int fd, uint8_t events, uint32_t id) {
+  return __poll_ctl(EPOLL_CTL_ADD, fd, events, id);
+}
+
+int km_poll_modify(int fd, uint8_t events, uint32_t id) {
+  return __poll_ctl(EPOLL_CTL_MOD, fd, events, id);
+}
+
+int km_poll_remove(int fd) {
+  return __poll_ctl(EPOLL_CTL_DEL, fd, 0, 0);
+}
+
+/**
+ * Wait for the descriptors up to the timeout (us, -1 for infinite). The
+ * epoll instance is waited by ppoll() for the microsecond timeout.
+ */
+static void __poll_wait(int64_t timeout) {
+  pthread_once(&__poll_once, __poll_init);
+  if (__poll_ready_count == __POLL_EVENTS_MAX) {
+    return;
+  }
+  if (timeout != 0) {
+    struct pollfd pfd = { .fd = __epoll_fd, .events = POLLIN };
+    struct timespec ts = { .tv_sec = timeout / 1000000,
+      .tv_nsec = (timeout % 1000000) * 1000 };
+    ppoll(&pfd, 1, (timeout < 0) ? NULL : &ts, NULL);
+  }
+  struct epoll_event events[__POLL_EVENTS_MAX];
+  int n = epoll_wait(__epoll_fd, events, __POLL_EVENTS_MAX - __poll_ready_count, 0);
+  for (int i = 0; i < n; i++) {
+    if (events[i].data.u64 == __POLL_DATA_WAKEUP) {
+      char buf[64];
+      while (read(__wakeup_fds[0], buf, sizeof(buf)) > 0) {}
+    } else if (events[i].data.u64 == __POLL_DATA_TTY) {
+      if (km_tty_fill(STDIN_FILENO) < 0) {
+        epoll_ctl(__epoll_fd, EPOLL_CTL_DEL, STDIN_FILENO, NULL); /* closed */
+      }
+    } else {
+      km_poll_event_t *ready = &__poll_ready[__poll_ready_count++];
+      ready->id = (uint32_t) events[i].data.u64;
+      ready->events = ((events[i].events & EPOLLIN) ? KM_POLL_READABLE : 0) |
+        ((events[i].events & EPOLLOUT) ? KM_POLL_WRITABLE : 0) |
+        ((events[i].events & (EPOLLERR | EPOLLHUP)) ? KM_POLL_ERROR : 0);
+    }
+  }
+}
+
+int km_poll_events(km_poll_event_t *events, int max) {
+  if (__poll_ready_count == 0 && !__poll_waited) {
+    __poll_wait(0);
+  }
+  __poll_waited = false;
+  int n = (__poll_ready_count < max) ? __poll_ready_count : max;
+  memcpy(events, __poll_ready, n * sizeof(km_poll_event_t));
+  memmove(__poll_ready, __poll_ready + n, (__poll_ready_count - n) * sizeof(km_poll_event_t));
+  __poll_ready_count -= n;
+  return n;
+}
+
+/**
+ * Block in a single epoll wait for the deadline (us, UINT64_MAX for none),
+ * a simulated GPIO interrupt, TTY input or the descriptors of the poll
+ * handles. With the virtual clock, the time jumps to the deadline without
+ * waiting.
+ */
+static void __wait_until_us(uint64_t deadline) {
+  uint64_t now = km_micro_gettime();
+  if (deadline <= now || __poll_ready_count > 0) {
+    return;
+  }
+  if (__virtual_time && deadline != UINT64_MAX) {
+    /* take the TTY input and the poll events without waiting */
+    __poll_wait(0);
+    __poll_waited = true;
+    uint64_t micros = km_micro_gettime();
+    if (deadline > micros) {
+      __virtual_advance(deadline - micros);
+    }
+    return;
+  }
+  int64_t timeout = -1;
+  if (deadline != UINT64_MAX) {
+    timeout = (deadline - now > INT64_MAX) ? INT64_MAX : (int64_t) (deadline - now);
+  }
+  __poll_wait(timeout);
+  __poll_waited = true;
+}
+
+void km_system_wait_until(uint64_t deadline) {
+  __wait_until_us((deadline == UINT64_MAX) ? UINT64_MAX : deadline * 1000);
+}
+
+void km_system_wait_until_us(uint64_t deadline) {
+  __wait_until_us(deadline);
 }
 
 /**
  * Kaluma Hardware System Initializations
  */
 void km_system_init() {
+  char *virtual_time = getenv("KALUMA_VIRTUAL_TIME");
+  if (virtual_time != NULL && strcmp(virtual_time, "0") != 0) {
+    km_system_set_virtual_time(true);
+  }
   km_gpio_init();
   km_adc_init();
   km_pwm_init();
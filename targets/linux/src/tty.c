@@ -26,28 +26,105 @@
 #include <stdio.h>
 #include <ctype.h>
 
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
 #include "tty.h"
 #include "system.h"
 #include "ringbuffer.h"
+#include "linux.h"
+
+#define TTY_RX_RINGBUFFER_SIZE 2048
+
+static uint8_t __tty_rx_buffer[TTY_RX_RINGBUFFER_SIZE];
+static ringbuffer_t __tty_rx_ringbuffer;
+static bool __tty_closed = false;
 
 void km_tty_init() {
+  ringbuffer_init(&__tty_rx_ringbuffer, __tty_rx_buffer, sizeof(__tty_rx_buffer));
 }
 
-uint32_t km_tty_available() {
+/**
+ * Called by km_system_wait_until() when stdin is readable. Reads only the
+ * available bytes, so it never blocks.
+ */
+int km_tty_fill(int fd) {
+  int len = 0;
+  if (ioctl(fd, FIONREAD, &len) < 0 || len == 0) {
+    if (fd == STDIN_FILENO) {
+      __tty_closed = true;
+    }
+    return -1; /* end of file */
+  }
+  uint32_t space = ringbuffer_freespace(&__tty_rx_ringbuffer);
+  if ((uint32_t) len > space) {
+    len = space; /* the rest is read in the next wait */
+  }
+  if (len == 0) {
+    return 0;
+  }
+  uint8_t buf[len];
+  int n = read(fd, buf, len);
+  if (n > 0) {
+    ringbuffer_write(&__tty_rx_ringbuffer, buf, n);
+  }
   return 0;
 }
 
+/**
+ * The loop does not wait (so stdin is not read in the epoll wait) while
+ * immediates, polled watches or works are pending, so stdin is also
+ * checked here without blocking when no input is buffered.
+ */
+uint32_t km_tty_available() {
+  uint32_t len = ringbuffer_length(&__tty_rx_ringbuffer);
+  if (len == 0 && !__tty_closed) {
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    if (poll(&pfd, 1, 0) > 0) {
+      km_tty_fill(STDIN_FILENO);
+      len = ringbuffer_length(&__tty_rx_ringbuffer);
+    }
+  }
+  return len;
+}
+
 uint32_t km_tty_read(uint8_t *buf, size_t len) {
-  return 0;
+  if (km_tty_available() >= len) {
+    ringbuffer_read(&__tty_rx_ringbuffer, buf, len);
+    return len;
+  } else {
+    return 0;
+  }
 }
 
 uint32_t km_tty_read_sync(uint8_t *buf, size_t len, uint32_t timeout) {
-  return 0;
+  uint64_t deadline = km_gettime() + timeout;
+  uint32_t read_len = 0;
+  while (read_len < len) {
+    uint32_t available = km_tty_available();
+    if (available > 0) {
+      uint32_t n = (available < len - read_len) ? available : len - read_len;
+      km_tty_read(buf + read_len, n);
+      read_len += n;
+      continue;
+    }
+    uint64_t now = km_gettime();
+    if (now >= deadline) {
+      break;
+    }
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    if (poll(&pfd, 1, (int) (deadline - now)) <= 0 || km_tty_fill(STDIN_FILENO) < 0) {
+      break;
+    }
+  }
+  return read_len;
 }
 
-
 uint8_t km_tty_getc() {
-  return 0;
+  uint8_t ch = 0;
+  while (km_tty_read_sync(&ch, 1, 1000) == 0) {}
+  return ch;
 }
 
 void km_tty_putc(char ch) {
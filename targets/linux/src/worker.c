@@ -0,0 +1,131 @@
+/* Copyright (c) 2017 Kaluma
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "system.h"
+#include "worker.h"
+#include "linux.h"
+
+/**
+ * A pool of threads taking the works from a queue. The number of threads
+ * can be set by the KALUMA_WORKERS environment variable.
+ */
+#define WORKER_THREADS_DEFAULT 4
+#define WORKER_THREADS_MAX 16
+#define WORKER_QUEUE_SIZE 32
+
+typedef struct {
+  uint8_t slot;
+  km_worker_fn fn;
+  void *arg;
+} __worker_job_t;
+
+static pthread_mutex_t __worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __worker_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t __worker_idle = PTHREAD_COND_INITIALIZER;
+static __worker_job_t __worker_queue[WORKER_QUEUE_SIZE];
+static uint32_t __worker_head = 0;
+static uint32_t __worker_count = 0;
+static uint32_t __worker_running = 0;
+static int __worker_threads = 0;
+static uint32_t __worker_done = 0; /* slots done, taken by the loop */
+
+static void *__worker_thread(void *arg) {
+  pthread_mutex_lock(&__worker_mutex);
+  while (true) {
+    while (__worker_count == 0) {
+      pthread_cond_wait(&__worker_queued, &__worker_mutex);
+    }
+    __worker_job_t job = __worker_queue[__worker_head];
+    __worker_head = (__worker_head + 1) % WORKER_QUEUE_SIZE;
+    __worker_count--;
+    __worker_running++;
+    pthread_mutex_unlock(&__worker_mutex);
+    job.fn(job.arg);
+    pthread_mutex_lock(&__worker_mutex);
+    __worker_done |= (1u << job.slot);
+    km_system_wakeup();
+    __worker_running--;
+    if (__worker_count == 0 && __worker_running == 0) {
+      pthread_cond_broadcast(&__worker_idle);
+    }
+  }
+  return NULL;
+}
+
+int km_worker_init() {
+  pthread_mutex_lock(&__worker_mutex);
+  if (__worker_threads == 0) {
+    int threads = WORKER_THREADS_DEFAULT;
+    char *env = getenv("KALUMA_WORKERS");
+    if (env != NULL) {
+      threads = atoi(env);
+      if (threads > WORKER_THREADS_MAX) {
+        threads = WORKER_THREADS_MAX;
+      }
+    }
+    for (int i = 0; i < threads; i++) {
+      pthread_t thread;
+      if (pthread_create(&thread, NULL, __worker_thread, NULL) != 0) {
+        break;
+      }
+      pthread_detach(thread);
+      __worker_threads++;
+    }
+  }
+  pthread_mutex_unlock(&__worker_mutex);
+  return __worker_threads;
+}
+
+void km_worker_cleanup() {
+  pthread_mutex_lock(&__worker_mutex);
+  while (__worker_count > 0 || __worker_running > 0) {
+    pthread_cond_wait(&__worker_idle, &__worker_mutex);
+  }
+  pthread_mutex_unlock(&__worker_mutex);
+}
+
+int km_worker_queue(uint8_t slot, km_worker_fn fn, void *arg) {
+  pthread_mutex_lock(&__worker_mutex);
+  if (__worker_threads == 0 || __worker_count == WORKER_QUEUE_SIZE) {
+    pthread_mutex_unlock(&__worker_mutex);
+    return -1;
+  }
+  __worker_job_t *job = &__worker_queue[(__worker_head + __worker_count) % WORKER_QUEUE_SIZE];
+  job->slot = slot;
+  job->fn = fn;
+  job->arg = arg;
+  __worker_count++;
+  pthread_cond_signal(&__worker_queued);
+  pthread_mutex_unlock(&__worker_mutex);
+  return 0;
+}
+
+uint32_t km_worker_take_done() {
+  pthread_mutex_lock(&__worker_mutex);
+  uint32_t done = __worker_done;
+  __worker_done = 0;
+  pthread_mutex_unlock(&__worker_mutex);
+  return done;
+}
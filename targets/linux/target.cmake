@@ -13,7 +13,6 @@ set(TARGET_INC_DIR ${CMAKE_CURRENT_LIST_DIR}/include)
 set(SOURCES
   ${SOURCES}
   ${TARGET_SRC_DIR}/adc.c
-  ${TARGET_SRC_DIR}/ringbuffer.c
   ${TARGET_SRC_DIR}/system.c
   ${TARGET_SRC_DIR}/gpio.c
   ${TARGET_SRC_DIR}/pwm.c
@@ -22,14 +21,20 @@ set(SOURCES
   ${TARGET_SRC_DIR}/storage.c
   ${TARGET_SRC_DIR}/uart.c
   ${TARGET_SRC_DIR}/i2c.c
-  ${TARGET_SRC_DIR}/spi.c)
+  ${TARGET_SRC_DIR}/spi.c
+  ${TARGET_SRC_DIR}/worker.c)
+
+set(TARGET_MAIN ${TARGET_SRC_DIR}/main.c)
 
 include_directories(${TARGET_INC_DIR})
 
+# poll handles for file descriptors (see include/port/fdpoll.h)
+add_definitions(-DKALUMA_IO_POLL)
+
 set(TARGET_HEAPSIZE 96)
 set(JERRY_TOOLCHAIN toolchain_linux_i686.cmake)
 
-set(KALUMA_MODULES events gpio led button pwm adc i2c spi uart graphics at storage stream http url startup)
+set(KALUMA_MODULES events gpio led button pwm adc i2c spi uart graphics at storage flash stream http url startup)
 
 set(CMAKE_SYSTEM_PROCESSOR amd64)
 set(CMAKE_C_FLAGS "${OPT} -Wall -fdata-sections -ffunction-sections")
@@ -44,5 +49,5 @@ set(CMAKE_CXX_COMPILER ${PREFIX}g++)
 set(CMAKE_LINKER ${PREFIX}ld)
 set(CMAKE_OBJCOPY ${PREFIX}objcopy)
 
-set(TARGET_LIBS c m)
+set(TARGET_LIBS c m pthread)
 set(CMAKE_EXE_LINKER_FLAGS "-u _printf_float -Wl,-Map=linux.map,--cref -Wl,--gc-sections")
\ No newline at end of file
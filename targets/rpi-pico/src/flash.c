@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "flash.h"
+#include "memstats.h"
 //#include "tty.h"
 #include "pico/stdlib.h"
 #include "hardware/flash.h"
@@ -82,7 +83,7 @@ void km_flash_program_begin() {
 
 km_flash_status_t km_flash_program(uint8_t * buf, uint32_t size) {
   uint32_t page_offset = 0;
-  __buff = (uint8_t *)malloc(FLASH_PAGE_SIZE * sizeof(uint8_t)); //256 byte
+  __buff = (uint8_t *)km_malloc(KM_MEM_FLASH, FLASH_PAGE_SIZE * sizeof(uint8_t)); //256 byte
   if (__buff == NULL) {
     return KM_FLASH_FAIL;
   }
@@ -110,13 +111,13 @@ void km_flash_program_end() {
     flash_range_program(CODE_FLASH_OFFSET + __code_offset, (uint8_t *)__buff, FLASH_PAGE_SIZE);
     __code_offset += __remaining_data_size;
   }
-  free(__buff);
-  uint32_t *buff = (uint32_t *)calloc(HEADER_FLASH_SIZE / 4, sizeof(uint32_t)); //256 byte
+  km_free(__buff);
+  uint32_t *buff = (uint32_t *)km_calloc(KM_MEM_FLASH, HEADER_FLASH_SIZE / 4, sizeof(uint32_t)); //256 byte
   uint32_t checksum = __calculate_checksum((uint8_t *)ADDR_FLASH_USER_CODE, __code_offset);
   *buff = __code_offset;
   *(buff + 1) = checksum;
   flash_range_program(HEADER_FLASH_OFFSET, (uint8_t *)buff, HEADER_FLASH_SIZE);
-  free(buff);
+  km_free(buff);
   restore_interrupts(saved_irq);
 }
 
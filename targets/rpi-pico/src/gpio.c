@@ -24,6 +24,8 @@
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
 
+static km_gpio_irq_cb __gpio_irq_cb[30];
+
 static int __check_gpio(uint8_t pin)
 {
   if ((pin <= 28) && !((pin == 23) || (pin == 24))) {
@@ -38,6 +40,11 @@ void km_gpio_init() {
 }
 
 void km_gpio_cleanup() {
+  for (int i = 0; i < 30; i++) {
+    if (__gpio_irq_cb[i] != NULL) {
+      km_gpio_irq_disable(i);
+    }
+  }
   km_gpio_init();
 }
 
@@ -81,3 +88,46 @@ int km_gpio_toggle(uint8_t pin) {
   gpio_put(pin, !out);
   return 0;
 }
+
+static void __gpio_irq_handler(uint gpio, uint32_t events) {
+  km_gpio_irq_cb cb = __gpio_irq_cb[gpio];
+  if (cb == NULL) {
+    return;
+  }
+  uint64_t time = time_us_64();
+  if ((events & GPIO_IRQ_EDGE_FALL) && (events & GPIO_IRQ_EDGE_RISE)) {
+    /* both edges latched, report them in the order ending at the level */
+    uint8_t value = gpio_get(gpio);
+    cb(gpio, !value, time);
+    cb(gpio, value, time);
+  } else if (events & GPIO_IRQ_EDGE_RISE) {
+    cb(gpio, 1, time);
+  } else if (events & GPIO_IRQ_EDGE_FALL) {
+    cb(gpio, 0, time);
+  }
+}
+
+int km_gpio_irq_enable(uint8_t pin, km_gpio_irq_mode_t mode, km_gpio_irq_cb cb) {
+  if (__check_gpio(pin) < 0) {
+    return KM_GPIOPORT_ERROR;
+  }
+  uint32_t events = 0;
+  if (mode & KM_GPIO_IRQ_EDGE_FALL) {
+    events |= GPIO_IRQ_EDGE_FALL;
+  }
+  if (mode & KM_GPIO_IRQ_EDGE_RISE) {
+    events |= GPIO_IRQ_EDGE_RISE;
+  }
+  __gpio_irq_cb[pin] = cb;
+  gpio_set_irq_enabled_with_callback(pin, events, true, __gpio_irq_handler);
+  return 0;
+}
+
+int km_gpio_irq_disable(uint8_t pin) {
+  if (__check_gpio(pin) < 0) {
+    return KM_GPIOPORT_ERROR;
+  }
+  gpio_set_irq_enabled(pin, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, false);
+  __gpio_irq_cb[pin] = NULL;
+  return 0;
+}
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "storage.h"
+#include "memstats.h"
 #include "pico/stdlib.h"
 #include "hardware/flash.h"
 #include "hardware/sync.h"
@@ -204,7 +205,7 @@ int km_storage_set_item(const char *key, char *buf) {
         status = KM_STORAGE_ERROR;
     }
   }
-  storage_data = (storage_data_t *)calloc(STORAGE_SLOT_SIZE, sizeof(uint8_t));
+  storage_data = (storage_data_t *)km_calloc(KM_MEM_STORAGE, STORAGE_SLOT_SIZE, sizeof(uint8_t));
   if (storage_data == NULL) {
     return KM_STORAGE_ERROR;
   }
@@ -227,7 +228,7 @@ int km_storage_set_item(const char *key, char *buf) {
   } else {
     status = slot;
   }
-  free(storage_data);
+  km_free(storage_data);
   return status;
 }
 
@@ -241,14 +242,14 @@ int km_storage_remove_item(const char *key) {
   int slot = get_slot_from_key(key);
   if (slot >= 0) {
     storage_data_t *old_data = get_storage_data(slot);
-    storage_data_t *storage_data = (storage_data_t *)calloc(STORAGE_SLOT_SIZE, sizeof(uint8_t));
+    storage_data_t *storage_data = (storage_data_t *)km_calloc(KM_MEM_STORAGE, STORAGE_SLOT_SIZE, sizeof(uint8_t));
     if (storage_data == NULL) {
       return KM_STORAGE_ERROR;
     }
     memcpy(storage_data, old_data, STORAGE_SLOT_SIZE);
     storage_data->status = STORAGE_STATUS_REMOVED;
     status = storage_write(slot, storage_data);
-    free(storage_data);
+    km_free(storage_data);
   } else {
     status = slot;
   }
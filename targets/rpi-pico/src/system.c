@@ -64,6 +64,27 @@ void km_micro_delay(uint32_t usec) {
   sleep_us(usec);
 }
 
+/**
+ * Sleep with WFE until the deadline or an interrupt (USB, UART, ...)
+ */
+void km_system_wait_until(uint64_t deadline) {
+  if (km_tty_available() > 0) {
+    return;
+  }
+  absolute_time_t until = at_the_end_of_time;
+  if (deadline != UINT64_MAX) {
+    until = from_us_since_boot(deadline * 1000);
+  }
+  best_effort_wfe_or_timeout(until);
+}
+
+void km_system_wait_until_us(uint64_t deadline) {
+  if (km_tty_available() > 0) {
+    return;
+  }
+  best_effort_wfe_or_timeout(from_us_since_boot(deadline));
+}
+
 /**
  * Kaluma Hardware System Initializations
  */
@@ -20,7 +20,9 @@
  */
 #include <stdlib.h>
 #include "uart.h"
+#include "system.h"
 #include "ringbuffer.h"
+#include "memstats.h"
 #include "rpi_pico.h"
 #include "pico/stdlib.h"
 #include "hardware/uart.h"
@@ -51,6 +53,7 @@ static void __uart_fill_ringbuffer(uart_inst_t *uart, uint8_t port) {
     uint8_t ch = uart_getc(uart);
     ringbuffer_write(&__uart_rx_ringbuffer[port], &ch, sizeof(ch));
   }
+  km_system_notify(KM_SYSTEM_EVENT_UART, port);
 }
 
 void __uart_irq_handler_0(void) {
@@ -164,7 +167,7 @@ int km_uart_setup(uint8_t port, uint32_t baudrate, uint8_t bits,
     pt = UART_PARITY_ODD;
   }
   uart_set_format(uart, bits, stop, pt);
-  __read_buffer[port] = (uint8_t *)malloc(buffer_size);
+  __read_buffer[port] = (uint8_t *)km_malloc(KM_MEM_UART, buffer_size);
   if (__read_buffer[port] == NULL) {
     return KM_UARTPORT_ERROR;
   } else {
@@ -241,7 +244,7 @@ int km_uart_close(uint8_t port) {
     return KM_UARTPORT_ERROR;
   }
   if (__read_buffer[port]) {
-    free(__read_buffer[port]);
+    km_free(__read_buffer[port]);
     __read_buffer[port] = (uint8_t *)NULL;
   }
   uart_deinit(uart);
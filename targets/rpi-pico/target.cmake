@@ -19,7 +19,6 @@ set(TARGET_INC_DIR ${CMAKE_CURRENT_LIST_DIR}/include)
 set(SOURCES
   ${SOURCES}
   ${TARGET_SRC_DIR}/adc.c
-  ${TARGET_SRC_DIR}/ringbuffer.c
   ${TARGET_SRC_DIR}/system.c
   ${TARGET_SRC_DIR}/gpio.c
   ${TARGET_SRC_DIR}/pwm.c
@@ -28,14 +27,17 @@ set(SOURCES
   ${TARGET_SRC_DIR}/storage.c
   ${TARGET_SRC_DIR}/uart.c
   ${TARGET_SRC_DIR}/i2c.c
-  ${TARGET_SRC_DIR}/spi.c)
+  ${TARGET_SRC_DIR}/spi.c
+  ${TARGET_SRC_DIR}/worker.c)
 
 include_directories(${TARGET_INC_DIR} )
 
 set(TARGET_HEAPSIZE 192)
+# native allocations (km_malloc) from a fixed TLSF arena of 16KB
+add_definitions(-DKALUMA_TLSF -DKALUMA_TLSF_ARENA_SIZE=16384)
 set(JERRY_TOOLCHAIN toolchain_mcu_cortexm0plus.cmake)
 
-set(KALUMA_MODULES events gpio led button pwm adc i2c spi uart graphics at storage stream http url startup)
+set(KALUMA_MODULES events gpio led button pwm adc i2c spi uart graphics at storage flash stream http url startup)
 
 set(CMAKE_SYSTEM_PROCESSOR cortex-m0plus)
 set(CMAKE_C_FLAGS "-march=armv6-m -mcpu=cortex-m0plus -mthumb ${OPT} -Wall -fdata-sections -ffunction-sections")
@@ -123,13 +123,17 @@ function generateSources() {
       })
     }
   })
-  modules[modules.length - 1].lastModule = true
   var builtinModules = [];
   modules.forEach(mod => {
     if (mod.require) {
       builtinModules.push(mod);
     }
   })
+  // Sorted by name (in byte order as strcmp) for binary search
+  builtinModules.sort((a, b) => (a.name < b.name ? -1 : (a.name > b.name ? 1 : 0)))
+  if (builtinModules.length > 0) {
+    builtinModules[builtinModules.length - 1].lastBuiltinModule = true
+  }
   var view = { modules: modules, builtinModules: builtinModules };
   var rendered_h = mustache.render(template_h, view)
   var rendered_c = mustache.render(template_c, view)
@@ -29,6 +29,7 @@ set(JERRY_ARGS
   --mem-heap=${TARGET_HEAPSIZE}
   --mem-stats=ON
   --snapshot-exec=ON
+  --snapshot-save=ON
   --line-info=ON
   --vm-exec-stop=ON
   --profile=es2015-subset
@@ -65,12 +66,22 @@ add_custom_command(OUTPUT ${KALUMA_GENERATED_C}
 set(KALUMA_INC ${CMAKE_SOURCE_DIR}/include ${CMAKE_SOURCE_DIR}/include/port ${SRC_DIR}/gen ${SRC_DIR}/modules)
 include_directories(${KALUMA_INC} ${JERRY_INC})
 
+# targets may have their own entry point (e.g. linux runs a script file)
+if(NOT DEFINED TARGET_MAIN)
+  set(TARGET_MAIN ${SRC_DIR}/main.c)
+endif()
+
 list(APPEND SOURCES
-  ${SRC_DIR}/main.c
+  ${TARGET_MAIN}
   ${SRC_DIR}/utils.c
+  ${SRC_DIR}/ringbuffer.c
   ${SRC_DIR}/base64.c
   ${SRC_DIR}/io.c
   ${SRC_DIR}/runtime.c
+  ${SRC_DIR}/profiler.c
+  ${SRC_DIR}/memstats.c
+  ${SRC_DIR}/memtags.c
+  ${SRC_DIR}/tlsf.c
   ${SRC_DIR}/repl.c
   ${SRC_DIR}/jerry_port.c
   ${SRC_DIR}/jerryxx.c
@@ -100,6 +111,11 @@ if("storage" IN_LIST KALUMA_MODULES)
   include_directories(${SRC_DIR}/modules/storage)
 endif()
 
+if("flash" IN_LIST KALUMA_MODULES)
+  list(APPEND SOURCES ${SRC_DIR}/modules/flash/module_flash.c)
+  include_directories(${SRC_DIR}/modules/flash)
+endif()
+
 if("uart" IN_LIST KALUMA_MODULES)
   list(APPEND SOURCES ${SRC_DIR}/modules/uart/module_uart.c)
   include_directories(${SRC_DIR}/modules/uart)
@@ -136,4 +152,8 @@ else()
     DEPENDS ${TARGET}.elf)
 
   add_custom_target(kaluma ALL DEPENDS ${TARGET}.hex ${TARGET}.bin)
-endif()
\ No newline at end of file
+endif()
+
+if("${TARGET}" STREQUAL "linux")
+  include(${CMAKE_SOURCE_DIR}/targets/linux/benchmarks/benchmarks.cmake)
+endif()